@@ -29,12 +29,17 @@ class ObjectManager;
 struct Region;
 class Renderer;
 class ResourceCache;
+class SceneryCache;
 class SessionManager;
 
 class Core
 {
 public:
     static void execute();
+
+    // Runs a tool with only the configuration, log and resources available
+    static void executeTool(void (*tool)());
+
     static Core& get();
     void stop();
 
@@ -44,6 +49,7 @@ public:
     DatFile& cellDat();
     DatFile& highresDat();
     ResourceCache& resourceCache();
+    SceneryCache& sceneryCache();
     LandcellManager& landcellManager();
     ObjectManager& objectManager();
     SessionManager& sessionManager();
@@ -57,6 +63,7 @@ private:
     Core();
 
     void init();
+    void initResources();
     void cleanup();
 
     void run();
@@ -70,6 +77,7 @@ private:
     unique_ptr<DatFile> cellDat_;
     unique_ptr<DatFile> highresDat_;
     unique_ptr<ResourceCache> resourceCache_;
+    unique_ptr<SceneryCache> sceneryCache_;
     unique_ptr<LandcellManager> landcellManager_;
     unique_ptr<ObjectManager> objectManager_;
     unique_ptr<SessionManager> sessionManager_;
@@ -20,6 +20,7 @@
 
 #include "Noncopyable.h"
 #include <fstream>
+#include <mutex>
 
 class DatFile : Noncopyable
 {
@@ -29,13 +30,18 @@ public:
     vector<uint8_t> read(uint32_t id) const;
     vector<uint32_t> list() const;
 
+    // Patch version from the header, anything derived from the contents can be keyed on it
+    uint32_t version() const;
+
 private:
     vector<uint8_t> readBlocks(uint32_t position, size_t size) const;
     void listDir(uint32_t position, vector<uint32_t>& result) const;
 
+    mutable mutex mutex_; // protects fs_, landblocks are read from worker threads
     mutable fstream fs_;
     uint32_t blockSize_;
     uint32_t rootPosition_;
+    uint32_t version_;
 };
 
 #endif
@@ -21,6 +21,9 @@
 struct Destructable
 {
     virtual ~Destructable() {}
+
+    // approximate number of bytes held, including GPU memory
+    virtual size_t calcSize() const { return 0; }
 };
 
 #endif
@@ -23,6 +23,23 @@
 
 struct Scene;
 
+// Terrain at many points at once, every array has count elements
+// Outputs that aren't needed may be null
+struct TerrainQuery
+{
+    TerrainQuery();
+
+    size_t count;
+    const fp_t* x;
+    const fp_t* y;
+    fp_t* height;
+    fp_t* normalX;
+    fp_t* normalY;
+    fp_t* normalZ;
+    uint8_t* road;
+    uint8_t* found; // zero where the landblock isn't loaded, LandcellManager only
+};
+
 class Land : public Landcell
 {
 public:
@@ -31,9 +48,19 @@ public:
     static const fp_t kBlockSize;
     static const int kOffsetMapSize = 64;
 
+    // The 3x3 landblocks centered on a land, indexed by [dx + 1][dy + 1]
+    // Entries are null where a neighbor does not exist
+    typedef const Land* Neighbors[3][3];
+
     Land(const void* data, size_t size);
 
-    void init();
+    // May be called from a worker thread, neighbors must not be destroyed meanwhile
+    void init(const Neighbors& neighbors);
+
+    // The results of init, for the world file
+    // May be called from a worker thread
+    vector<uint8_t> bake() const;
+    void initBaked(const void* data, size_t size);
 
     fp_t getHeight(int gridX, int gridY) const;
     uint8_t getRoad(int gridX, int gridY) const;
@@ -43,9 +70,24 @@ public:
 
     Plane calcPlane(fp_t x, fp_t y) const;
     fp_t calcHeight(fp_t x, fp_t y) const;
-    fp_t calcHeightUnbounded(fp_t x, fp_t y) const;
+    fp_t calcHeightUnbounded(const Neighbors& neighbors, fp_t x, fp_t y) const;
+    bool roadAtPoint(fp_t x, fp_t y) const;
+
+    // calcHeight, calcPlane and roadAtPoint for many points in the landblock
+    // Points outside the landblock are extended from the nearest cell
+    // May be called from a worker thread
+    void queryTerrain(const TerrainQuery& query) const;
+
+    // Finds the first hit on the terrain triangles for tMin <= t <= tMax, false if none
+    // The ray is relative to the landblock, t is in units of direction
+    bool castRay(const glm::vec3& origin, const glm::vec3& direction, fp_t tMin, fp_t tMax, fp_t& t) const;
+
+    // bounds of the terrain, and of the offset map once initialized
+    fp_t minHeight() const;
+    fp_t maxHeight() const;
 
     LandcellId id() const override;
+    size_t calcSize() const override;
     uint32_t numStructures() const;
     const uint8_t* normalMap() const;
 
@@ -60,16 +102,39 @@ private:
         uint8_t pad;
     });
 
+    struct ScenePlacement;
+
     void initStaticObjects();
     void initScenes();
-    void initScene(int x, int y, const Scene& scene);
+    void initScene(int x, int y, const Scene& scene, ScenePlacement& placement);
 
-    bool roadAtPoint(fp_t x, fp_t y) const;
+    void initCells();
+    void initHeightTree();
+    bool castRayNode(int level, int nx, int ny, const glm::vec3& origin, const glm::vec3& direction, fp_t tMin, fp_t tMax, fp_t& t) const;
+    bool castRayCell(int ix, int iy, const glm::vec3& origin, const glm::vec3& direction, fp_t tMin, fp_t tMax, fp_t& t) const;
 
     Data data_;
     fp_t heights_[kGridSize][kGridSize];
     uint32_t numStructures_;
 
+    // cells are indexed by x * 8 + y, triangles by cell * 2 + (upper ? 1 : 0)
+    static const int kNumCells = (kGridSize - 1) * (kGridSize - 1);
+    bool splitNESW_[kGridSize][kGridSize];
+    uint8_t cellRoads_[kNumCells]; // road flags of the SW, SE, NW and NE corners in bits 0 to 3
+    fp_t triangleA_[kNumCells * 2]; // z = a * x + b * y + c
+    fp_t triangleB_[kNumCells * 2];
+    fp_t triangleC_[kNumCells * 2];
+    fp_t normalX_[kNumCells * 2];
+    fp_t normalY_[kNumCells * 2];
+    fp_t normalZ_[kNumCells * 2];
+
+    // min/max height quadtree over the cells, bounding the triangles and, once initialized, the offset map
+    // levels are 8x8 (cells), 4x4, 2x2 and 1x1 nodes stored one after another, by x * size + y
+    static const int kNumTreeLevels = 4;
+    static const int kTreeSize = 64 + 16 + 4 + 1;
+    fp_t treeMin_[kTreeSize];
+    fp_t treeMax_[kTreeSize];
+
     vector<uint16_t> offsetMap_;
     fp_t offsetMapBase_;
     fp_t offsetMapScale_;
@@ -77,4 +142,18 @@ private:
     vector<uint8_t> normalMap_;
 };
 
+// Finds the lands for castRayAcrossLands
+class LandFinder
+{
+public:
+    virtual ~LandFinder() {}
+
+    // returns nullptr to pass over the landblock
+    virtual const Land* findLand(LandcellId id) = 0;
+};
+
+// Walks the landblocks under a ray in order and finds the first hit on their terrain within maxDist, false if none
+// Coordinates are relative to the south-west corner of origin, dist is in units of direction
+bool castRayAcrossLands(LandFinder& finder, LandcellId origin, const glm::vec3& start, const glm::vec3& direction, fp_t maxDist, fp_t& dist);
+
 #endif
\ No newline at end of file
@@ -29,6 +29,7 @@ public:
     virtual ~Landcell();
 
     virtual LandcellId id() const = 0;
+    virtual size_t calcSize() const;
     const vector<StaticObject>& staticObjects() const;
     unique_ptr<Destructable>& renderData() const;
 
@@ -18,31 +18,207 @@
 #ifndef BZR_LANDCELLMANAGER_H
 #define BZR_LANDCELLMANAGER_H
 
+#include "Land.h"
 #include "Landcell.h"
 #include "Noncopyable.h"
+#include "Structure.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
+class WorldFile;
+
+/*
+ * Landblocks are streamed in by worker threads in two stages
+ * 1. Parse: read the landblock from the cell dat and construct a Land
+ * 2. Init: initialize the Land (scenery, offset and normal maps) and parse its structures
+ * A Land can't be initialized until all of its neighbors are parsed
+ * The main thread only schedules jobs and commits their results in step()
+ * Jobs are destroyed on the main thread, holding every resource they got until then
+ * Only committed (ready) landcells are visible through find() and iteration
+ *
+ * Besides the landblocks around the center, we load the ones around where the
+ * camera is predicted to be LandcellManager.prefetchTime seconds from now
+ *
+ * Ready landblocks stay resident until they're outside LandcellManager.unloadRadius,
+ * then they're kept in an LRU cache of up to LandcellManager.cacheSize MiB
+ * Coming back to a cached landblock just moves it back in, render data and all
+ *
+ * Ready landblocks live in a square ring buffer of slots indexed by x and y modulo
+ * its width, which is big enough that resident landblocks never share a slot
+ * Iteration visits the ready slots nearest the center first
+ *
+ * Further out, up to LandcellManager.terrainRadius, landblocks are only parsed
+ * They have heights and terrain types for distant terrain, but no scenery or structures
+ *
+ * If LandcellManager.worldFile names a file written by bakeworld, landblocks in it are
+ * read from there and their initialization is a copy instead of a computation
+ */
 class LandcellManager : Noncopyable
 {
 public:
-    typedef unordered_map<LandcellId, unique_ptr<Landcell>> container_type;
-    typedef container_type::iterator iterator;
+    // a ready landblock with its structures, ordered by cell index
+    struct Slot
+    {
+        LandcellId id;
+        unique_ptr<Land> land;
+        vector<unique_ptr<Structure>> structures;
+    };
+
+    typedef vector<Slot*> container_type;
+    typedef container_type::const_iterator iterator;
 
     LandcellManager();
+    ~LandcellManager();
 
     void setCenter(LandcellId center);
     LandcellId center() const;
+    int radius() const;
+    int terrainRadius() const;
+
+    // commits finished jobs and schedules new ones, call once per step
+    void step(fp_t dt);
+
+    // returns nullptr if the landblock isn't ready
+    Slot* findSlot(LandcellId id);
+
+    // returns the land or structure, nullptr if its landblock isn't ready
+    Landcell* find(LandcellId id);
 
-    iterator find(LandcellId id);
-    iterator begin();
-    iterator end();
+    // returns any loaded land, ready or not, nullptr if it isn't loaded
+    // only the heights and terrain types of a land that isn't ready may be used
+    const Land* findTerrain(LandcellId id);
+
+    // Land::queryTerrain across landblocks, on any loaded land
+    // Coordinates are relative to the south-west corner of origin
+    // Points on landblocks that aren't loaded get a height of zero and an upward normal
+    void queryTerrain(LandcellId origin, const TerrainQuery& query);
+
+    // Finds the first hit on the terrain of loaded landblocks within maxDist, false if none
+    // Landblocks still being initialized are passed over, their height trees are being rebuilt
+    // Coordinates are relative to the south-west corner of origin, dist is in units of direction
+    bool castRay(LandcellId origin, const glm::vec3& start, const glm::vec3& direction, fp_t maxDist, fp_t& dist);
+
+    iterator begin() const;
+    iterator end() const;
 
 private:
+    enum class JobType
+    {
+        kParse,
+        kInit
+    };
+
+    struct Job
+    {
+        JobType type;
+        LandcellId id;
+
+        // kInit only, pinned until the job is committed
+        Land* land;
+        Land::Neighbors neighbors;
+
+        // results
+        unique_ptr<Land> parsedLand;
+        vector<unique_ptr<Structure>> structures;
+        exception_ptr error;
+
+        // everything the job got from the resource cache, released with the job on the main thread
+        vector<ResourcePtr> resources;
+    };
+
+    // ready, cached and distant terrain lands, none of which a worker is touching
+    struct RayLandFinder : public LandFinder
+    {
+        explicit RayLandFinder(LandcellManager& manager) : manager_(manager)
+        {}
+
+        const Land* findLand(LandcellId id) override;
+
+        LandcellManager& manager_;
+    };
+
+    struct CacheEntry
+    {
+        LandcellId id;
+        unique_ptr<Land> land;
+        vector<unique_ptr<Structure>> structures;
+        size_t size;
+    };
+
     void load();
+    void schedule();
+    void scheduleParse(LandcellId around, vector<unique_ptr<Job>>& newJobs);
+    void scheduleTerrain(vector<unique_ptr<Job>>& newJobs);
+    void queueParse(LandcellId id, vector<unique_ptr<Job>>& newJobs);
+    void evict();
+    void unload(Slot& slot);
+    void commit(unique_ptr<Job> job);
+    void cache(CacheEntry entry);
+    bool restore(LandcellId id);
+    void pin(const Job& job, int delta);
+    Land* findLand(LandcellId id);
+    Slot& slotAt(LandcellId id);
+    void sortSlots();
+    bool isWithin(LandcellId id, int radius) const;
+    void predict(fp_t dt);
+    void updateStats(LandcellId oldCenter);
+
+    void run();
+    void execute(Job& job) const;
 
-    container_type data_;
     LandcellId center_;
     int radius_;
+    int unloadRadius_;
+    int terrainRadius_;
+    unique_ptr<WorldFile> worldFile_; // may be null
+
+    // ready landblocks
+    vector<Slot> slots_;
+    int slotsWidth_;
+    container_type order_; // occupied slots, nearest first
+    bool orderDirty_;
+
+    // main thread state
+    unordered_map<LandcellId, unique_ptr<Land>> staging_; // parsed, not yet ready
+    unordered_map<LandcellId, unique_ptr<Land>> terrain_; // parsed, only needed for distant terrain
+    unordered_set<LandcellId> parsing_;
+    unordered_set<LandcellId> initializing_;
+    unordered_set<LandcellId> missing_;
+    unordered_map<LandcellId, int> pins_;
+
+    // recently evicted landblocks, most recent first
+    list<CacheEntry> cache_;
+    unordered_map<LandcellId, list<CacheEntry>::iterator> cacheIndex_;
+    size_t cacheSize_;
+    size_t cacheBudget_;
+
+    // prefetching
+    fp_t prefetchTime_;
+    bool hasLastPosition_;
+    glm::vec2 lastPosition_;
+    glm::vec2 velocity_;
+    LandcellId predictedCenter_;
+    unordered_set<LandcellId> prefetched_; // loaded ahead of time, not entered yet
+
+    // stats
+    int numEdgeReady_; // landblocks that were ready when they came into radius
+    int numEdgeMissing_; // and those that weren't
+    int numPrefetchHits_; // prefetched landblocks that came into radius
+    int numPrefetchWasted_; // prefetched landblocks evicted before that
+    int numCacheHits_; // landblocks restored from the cache
+
+    mutex mutex_; // protects class variables after this point, except threads_
+    condition_variable jobCondition_;
+    bool done_;
+    deque<unique_ptr<Job>> pendingJobs_;
+    vector<unique_ptr<Job>> finishedJobs_;
+    vector<thread> threads_;
 };
 
 #endif
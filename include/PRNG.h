@@ -63,4 +63,8 @@ static const int32_t RND_TIME_WEATH2    = 0x00013255;
 // generates a number 0.0 to 1.0
 double prng(uint32_t cell_x, uint32_t cell_y, uint32_t seed);
 
+// result[i] = prng(cell_x, cell_y, seed + i) for i < count
+// a single loop the compiler can vectorize, for evaluating all objects of a scene at once
+void prngSeries(uint32_t cell_x, uint32_t cell_y, uint32_t seed, size_t count, double* result);
+
 #endif
\ No newline at end of file
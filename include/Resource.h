@@ -74,6 +74,7 @@ enum class ResourceType : uint32_t
     kMotionTable = 0x09000000,
     kSound = 0x0A000000,
     kEnvironment = 0x0D000000,
+    kDegradeInfo = 0x11000000,
     kScene = 0x12000000,
     kRegion = 0x13000000,
     kSoundTable = 0x20000000,
@@ -20,6 +20,8 @@
 
 #include "Noncopyable.h"
 #include "Resource.h"
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
 class ResourceCache : Noncopyable
@@ -27,8 +29,19 @@ class ResourceCache : Noncopyable
 public:
     ResourcePtr get(uint32_t resourceId);
 
+    // Until called again with nullptr, every resource get returns on this thread is also added to held,
+    // as is our own copy when another thread loaded the same resource first
+    // Workers hold what they get for the main thread to release, so the last reference to a resource,
+    // and the render data it may own, is never dropped on a worker
+    void hold(vector<ResourcePtr>* held);
+
 private:
+    // with mutex_ locked
+    void addHeld(const ResourcePtr& resource);
+
+    mutex mutex_; // protects data_ and held_
     unordered_map<uint32_t, weak_ptr<const Resource>> data_;
+    unordered_map<thread::id, vector<ResourcePtr>*> held_;
 };
 
 #endif
\ No newline at end of file
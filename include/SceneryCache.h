@@ -0,0 +1,56 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_SCENERYCACHE_H
+#define BZR_SCENERYCACHE_H
+
+#include "LandcellId.h"
+#include "Noncopyable.h"
+#include "StaticObject.h"
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * Keeps the scenery placed on each landblock in a file next to the configuration
+ * Placement only depends on the dat files, so the file is rebuilt whenever their versions change
+ * Disabled unless SceneryCache.enabled is set
+ */
+class SceneryCache : Noncopyable
+{
+public:
+    SceneryCache();
+
+    // Appends the cached scenery of a landblock, returns false if it has not been cached
+    // May be called from a worker thread
+    bool load(LandcellId id, vector<StaticObject>& staticObjects) const;
+
+    // May be called from a worker thread
+    void save(LandcellId id, const StaticObject* staticObjects, size_t count);
+
+private:
+    bool read(const string& path);
+    void write(const string& path);
+    static void writeRecord(ostream& os, LandcellId id, const vector<uint8_t>& objects);
+
+    const bool enabled_;
+    mutable mutex mutex_; // protects objects_ and fs_
+    unordered_map<LandcellId, vector<uint8_t>> objects_; // baked static objects
+    ofstream fs_;
+};
+
+#endif
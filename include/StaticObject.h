@@ -21,6 +21,7 @@
 #include "Resource.h"
 
 class BinReader;
+class BinWriter;
 
 struct StaticObject
 {
@@ -30,4 +31,11 @@ struct StaticObject
 
 void read(BinReader& reader, StaticObject& staticObject);
 
+// Compact form for the files we write ourselves
+// The resource id and the upper three rows of the transform, column-major
+static const size_t kBakedStaticObjectSize = sizeof(uint32_t) + sizeof(float) * 12;
+
+void readBaked(BinReader& reader, StaticObject& staticObject);
+void writeBaked(BinWriter& writer, const StaticObject& staticObject);
+
 #endif
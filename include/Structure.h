@@ -26,13 +26,32 @@ struct Environment;
 class Structure : public Landcell
 {
 public:
+    // AC: CCellPortal
+    struct Portal
+    {
+        uint16_t portalSide;
+        uint16_t portalId; // triangle fan of the environment part
+        uint16_t cellId; // n of the structure on the other side, 0xFFFF for outside
+        uint16_t exactMatch;
+    };
+
+    static const uint16_t kOutsideCellId = 0xFFFF;
+
     Structure(const void* data, size_t size);
 
     LandcellId id() const override;
+    size_t calcSize() const override;
     const Location& location() const;
     const vector<ResourcePtr>& surfaces() const;
     const Environment& environment() const;
     uint16_t partNum() const;
+    const vector<Portal>& portals() const;
+
+    // whether a structure with the given n may be visible from this one
+    bool canSee(uint16_t cellId) const;
+
+    // whether this may be visible from outside of any structure
+    bool isSeenOutside() const;
 
 private:
     LandcellId id_;
@@ -40,6 +59,9 @@ private:
     vector<ResourcePtr> surfaces_;
     ResourcePtr environment_;
     uint16_t partNum_;
+    vector<Portal> portals_;
+    vector<uint16_t> visibleCells_; // sorted
+    bool seenOutside_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_WORLDFILE_H
+#define BZR_WORLDFILE_H
+
+#include "LandcellId.h"
+#include "Noncopyable.h"
+#include <fstream>
+#include <mutex>
+
+/*
+ * A world file holds every landblock already initialized, written by the bakeworld tool
+ * It's mapped into memory, so loading a landblock is a page-in rather than a compute job
+ * Layout: a Header, an IndexEntry for each landblock by x * 256 + y, then the blocks
+ * Each block is the land data from the cell dat followed by the output of Land::bake
+ */
+class WorldFile : Noncopyable
+{
+public:
+    static const int kNumBlocks = 256 * 256;
+
+    PACK(struct Header
+    {
+        uint32_t magic;
+        uint32_t formatVersion;
+        uint32_t portalVersion;
+        uint32_t cellVersion;
+    });
+
+    PACK(struct IndexEntry
+    {
+        uint64_t offset; // zero if the landblock does not exist
+        uint32_t landSize;
+        uint32_t bakedSize;
+    });
+
+    struct Block
+    {
+        const uint8_t* land;
+        size_t landSize;
+        const uint8_t* baked;
+        size_t bakedSize;
+    };
+
+    static const uint32_t kMagic = 0x57525A42; // BZRW
+    static const uint32_t kFormatVersion = 1;
+
+    // Throws if the file was baked from different dats
+    explicit WorldFile(const string& path);
+    ~WorldFile();
+
+    // Returns false if the landblock isn't in the file
+    // May be called from a worker thread
+    bool find(LandcellId id, Block& block) const;
+
+private:
+    void unmap();
+
+    const uint8_t* data_;
+    size_t size_;
+};
+
+// Blocks may be added in any order from any thread
+class WorldFileWriter : Noncopyable
+{
+public:
+    explicit WorldFileWriter(const string& path);
+
+    void add(LandcellId id, const vector<uint8_t>& land, const vector<uint8_t>& baked);
+
+    // Writes the index, no blocks may be added afterwards
+    void finish();
+
+    uint64_t size() const;
+
+private:
+    mutable mutex mutex_; // protects all members
+    ofstream fs_;
+    vector<WorldFile::IndexEntry> index_;
+    uint64_t position_;
+};
+
+#endif
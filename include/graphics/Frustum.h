@@ -0,0 +1,77 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_FRUSTUM_H
+#define BZR_GRAPHICS_FRUSTUM_H
+
+// Bounding volumes to cull, as a structure of arrays
+// Each is a box given by its center and half extents grown by a radius,
+// so spheres have zero extents and boxes have zero radius
+struct CullBatch
+{
+    void clear();
+    void addSphere(const glm::vec3& center, fp_t radius);
+    void addBox(const glm::vec3& center, const glm::vec3& extents);
+    size_t size() const;
+
+    vector<float> x;
+    vector<float> y;
+    vector<float> z;
+    vector<float> extentX;
+    vector<float> extentY;
+    vector<float> extentZ;
+    vector<float> radius;
+};
+
+// What a renderer drew and culled in the last frame
+struct CullStats
+{
+    CullStats() : drawn(0), culled(0)
+    {}
+
+    int drawn;
+    int culled;
+};
+
+class Frustum
+{
+public:
+    // The vertex shaders bend the world down around the camera as if on a sphere this big,
+    // FrameConstants::worldRadius
+    static const fp_t kWorldRadius;
+
+    Frustum(const glm::mat4& projectionViewMat, const glm::vec3& cameraPosition);
+
+    // visible[i] is set to 0 if volume i is entirely outside of a plane, otherwise 1
+    // Volumes are lowered as the world is bent around the camera before testing
+    // Returns the number visible
+    size_t cull(const CullBatch& batch, vector<uint8_t>& visible) const;
+
+private:
+    static const int kNumPlanes = 6;
+
+    float cameraX_;
+    float cameraY_;
+
+    // a * x + b * y + c * z + d >= 0 inside, normalized
+    float a_[kNumPlanes];
+    float b_[kNumPlanes];
+    float c_[kNumPlanes];
+    float d_[kNumPlanes];
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_IMPOSTORRENDERER_H
+#define BZR_GRAPHICS_IMPOSTORRENDERER_H
+
+#include "graphics/Program.h"
+#include "graphics/RenderQueue.h"
+#include "physics/Sphere.h"
+#include "Noncopyable.h"
+#include "Resource.h"
+#include <unordered_map>
+
+class MeshRenderData;
+struct Model;
+
+/*
+ * Distant scenery is drawn as quads facing the camera, textured with pictures of it
+ * An impostor is kViews pictures taken around the z axis of a model or setup, baked into
+ * a slot of one atlas when first asked for, the least recently used one gives up its slot when it's full
+ */
+class ImpostorRenderer : Noncopyable
+{
+public:
+    // ImpostorVertexShader.glsl has the same
+    static const int kViews = 8;
+
+    struct Part
+    {
+        const Model* model;
+        MeshRenderData* mesh;
+        glm::mat4 transform; // in the space of the resource
+    };
+
+    struct Instance
+    {
+        glm::vec4 bounds; // center and radius
+        glm::vec4 info; // slot, yaw, fade, unused
+    };
+
+    // in pixels
+    ImpostorRenderer(int atlasSize, int cellSize);
+    ~ImpostorRenderer();
+
+    // the slot of the resource's impostor and its bounds in the resource's space
+    // -1 if it isn't baked yet, it's baked later if there's room
+    int find(const ResourcePtr& resource, Sphere& bounds);
+
+    // the next resource to bake this frame, false when there's nothing more
+    bool nextBake(ResourcePtr& resource);
+
+    // with the frame constants bound for each view
+    void bake(const ResourcePtr& resource, const vector<Part>& parts);
+
+    void render(const vector<Instance>& instances);
+
+private:
+    struct Impostor
+    {
+        ResourcePtr resource;
+        int slot;
+        Sphere bounds;
+        bool baked;
+        uint32_t lastUsed; // frame
+    };
+
+    int allocateSlot();
+    void initGeometry();
+
+    int cellSize_;
+    int cellsPerRow_;
+
+    Program program_;
+    GLuint vertexArray_;
+    GLuint vertexBuffer_;
+    GLuint instanceBuffer_;
+
+    GLuint texture_;
+    GLuint depthBuffer_;
+    GLuint framebuffer_;
+
+    RenderQueue queue_;
+
+    unordered_map<const Resource*, Impostor> impostors_;
+    vector<int> freeSlots_;
+    vector<ResourcePtr> pending_;
+    uint32_t frame_;
+    int bakesThisFrame_;
+    bool mipmapsStale_;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_LANDARRAY_H
+#define BZR_GRAPHICS_LANDARRAY_H
+
+#include "Destructable.h"
+#include "Noncopyable.h"
+
+class Land;
+
+// Draws full detail lands with one instanced draw
+// Each land is uploaded to a layer of a set of texture arrays (heights, cell textures and normals)
+// and LandInstancedVertexShader.glsl builds its vertices from a grid shared by all lands
+class LandArray : Noncopyable
+{
+public:
+    // capacity is the most lands drawn in a frame
+    LandArray(int capacity);
+    ~LandArray();
+
+    void add(const Land& land, const glm::vec2& position, bool skirts);
+
+    // draws everything added since the last call
+    void render();
+
+    // bytes of texture memory per land
+    static size_t calcLayerSize();
+
+private:
+    // stored in the land's render data, layers are recycled so check the serial
+    struct Tag : public Destructable
+    {
+        int layer;
+        uint32_t serial; // 0 until uploaded
+        GLfloat skirtDepth;
+    };
+
+    struct Instance
+    {
+        GLfloat x;
+        GLfloat y;
+        GLfloat layer;
+        GLfloat skirtDepth;
+    };
+
+    int allocLayer();
+    void upload(const Land& land, int layer);
+    void initGrid();
+    void initTextures();
+
+    int capacity_;
+    uint32_t frame_;
+    uint32_t nextSerial_;
+    vector<uint32_t> layerSerials_;
+    vector<uint32_t> layerFrames_; // last frame each layer was drawn, for recycling
+
+    vector<Instance> instances_; // lands with skirts first
+    vector<Instance> instancesWithoutSkirts_;
+
+    GLuint vertexArray_;
+    GLuint gridBuffer_;
+    GLuint instanceBuffer_;
+    GLsizei surfaceVertexCount_;
+    GLsizei skirtVertexCount_;
+
+    GLuint heightTexture_;
+    GLuint cellTexture_;
+    GLuint normalTexture_;
+};
+
+#endif
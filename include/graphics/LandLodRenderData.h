@@ -0,0 +1,62 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_LANDLODRENDERDATA_H
+#define BZR_GRAPHICS_LANDLODRENDERDATA_H
+
+#include "Destructable.h"
+#include "Noncopyable.h"
+
+class Land;
+
+// A square chunk of distant landblocks drawn as one coarse grid
+class LandLodRenderData : public Destructable, Noncopyable
+{
+public:
+    // landblocks per side
+    static const int kChunkSize = 8;
+
+    // the coarsest level has one quad per landblock
+    static const int kMaxLevel = 3;
+
+    // indexed by [x][y] within the chunk, null where the chunk has a hole
+    typedef const Land* Lands[kChunkSize][kChunkSize];
+
+    // level 1 has a quad every 2 cells, level 2 every 4 cells, etc
+    // terrainColors are the average linear color of each terrain texture
+    LandLodRenderData(const Lands& lands, int level, const vector<glm::vec3>& terrainColors);
+    ~LandLodRenderData();
+
+    void render();
+
+    size_t calcSize() const override;
+
+    // of the vertices, skirts included
+    fp_t minHeight() const;
+    fp_t maxHeight() const;
+
+private:
+    GLuint vertexArray_;
+    GLuint vertexBuffer_;
+    GLuint indexBuffer_;
+    GLsizei vertexCount_;
+    GLsizei indexCount_;
+    fp_t minHeight_;
+    fp_t maxHeight_;
+};
+
+#endif
@@ -23,13 +23,28 @@
 
 class Land;
 
+// The textures blended on a cell, four terrain layers then a road layer
+// See LandVertexShader.glsl for how they're used
+struct LandCellTextures
+{
+    uint8_t textures[5];
+    uint8_t blendTextures[5];
+    uint8_t rotations[5]; // number of 90 degree ccw rotations
+    uint8_t roadScale;
+};
+
+LandCellTextures calcLandCellTextures(const Land& land, int x, int y);
+
 class LandRenderData : public Destructable, Noncopyable
 {
 public:
     LandRenderData(const Land& land);
     ~LandRenderData();
 
-    void render();
+    // skirts hide cracks where a land meets coarser distant terrain
+    void render(bool skirts);
+
+    size_t calcSize() const override;
 
 private:
     void initGeometry(const Land& land);
@@ -38,6 +53,7 @@ private:
     GLuint vertexArray_;
     GLuint vertexBuffer_;
     GLsizei vertexCount_;
+    GLsizei skirtVertexCount_;
 
     GLuint normalTexture_;
 };
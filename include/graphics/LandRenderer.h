@@ -18,12 +18,22 @@
 #ifndef BZR_GRAPHICS_LANDRENDERER_H
 #define BZR_GRAPHICS_LANDRENDERER_H
 
+#include "graphics/Frustum.h"
+#include "graphics/LandLodRenderData.h"
 #include "graphics/Program.h"
+#include "graphics/UploadScheduler.h"
+#include "LandcellId.h"
 #include "Noncopyable.h"
+#include <unordered_map>
 
 class Land;
+class LandArray;
 
-class LandRenderer : Noncopyable
+// Lands without render data yet are skipped until the upload scheduler creates it,
+// LandArray uploads its own layers as it goes
+// Distant terrain chunks are kept across frames and rebuilt through the upload scheduler too,
+// the old chunk is drawn until its replacement is ready
+class LandRenderer : public UploadScheduler::Uploader, Noncopyable
 {
 public:
     LandRenderer();
@@ -31,25 +41,84 @@ public:
 
     void render(const glm::mat4& projectionMat, const glm::mat4& viewMat);
 
-    void setLightPosition(const glm::vec3& lightPosition);
+    // creates the render data of a land
+    size_t upload(const void* item) override;
+
+    // full detail lands only
+    const CullStats& cullStats() const;
 
 private:
-    void renderLand(
-        const Land& land,
-        const glm::mat4& projectionMat,
-        const glm::mat4& viewMat,
-        const glm::vec3& position);
-    
+    struct VisibleLand
+    {
+        const Land* land;
+        glm::vec3 position;
+        bool skirts;
+    };
+
+    struct LodChunk
+    {
+        LodChunk() : level(0), mask(0), wantedLevel(0), wantedMask(0), lastFrame(0)
+        {}
+
+        // what renderData was built with
+        int level;
+        uint64_t mask; // landblocks in the chunk, bit x * kChunkSize + y
+        unique_ptr<LandLodRenderData> renderData;
+
+        // what it should be built with, and the lands to build it from, set every frame
+        int wantedLevel;
+        uint64_t wantedMask;
+        LandLodRenderData::Lands lands;
+
+        glm::vec3 position; // of its first landblock, relative to the center
+        uint32_t lastFrame; // in range
+    };
+
+    // builds the render data of LodChunks, the items are their ids
+    class LodChunkUploader : public UploadScheduler::Uploader
+    {
+    public:
+        LodChunkUploader(unordered_map<LandcellId, LodChunk>& chunks, const vector<glm::vec3>& terrainColors);
+
+        size_t upload(const void* item) override;
+
+    private:
+        unordered_map<LandcellId, LodChunk>& chunks_;
+        const vector<glm::vec3>& terrainColors_;
+    };
+
+    void renderLand(const Land& land, const glm::vec3& position, bool skirts);
+    void renderLod(const Frustum& frustum);
+
     void initProgram();
+    void initInstancedProgram();
+    void initLodProgram();
     void initTerrainTexture();
     void initBlendTexture();
 
     Program program_;
+    Program instancedProgram_;
+    Program lodProgram_;
 
     GLuint terrainTexture_;
     GLuint blendTexture_;
 
-    glm::vec3 lightPosition_;
+    // only with LandRenderer.instanced
+    unique_ptr<LandArray> landArray_;
+
+    // distant terrain
+    vector<glm::vec3> terrainColors_;
+    unordered_map<LandcellId, LodChunk> lodChunks_; // by the id of the chunk's first landblock
+    LodChunkUploader lodChunkUploader_;
+    uint32_t lodFrame_;
+    vector<LodChunk*> lodVisible_;
+    CullBatch lodCullBatch_;
+
+    // per frame culling state
+    vector<VisibleLand> visibleLands_;
+    CullBatch cullBatch_;
+    vector<uint8_t> visible_;
+    CullStats cullStats_;
 };
 
 #endif
@@ -0,0 +1,120 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_MESHBUFFER_H
+#define BZR_GRAPHICS_MESHBUFFER_H
+
+#include "Noncopyable.h"
+#include <map>
+
+struct VertexAttribute
+{
+    GLuint index;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset; // bytes into a vertex
+};
+
+/*
+ * A vertex buffer and an index buffer that the meshes of one vertex format are suballocated from,
+ * so they all draw with the same vertex array, by base vertex and index offset
+ * Free space is kept in a first fit free list per buffer, coalesced as ranges are freed,
+ * and the buffers double in size, copied on the GPU, when nothing fits
+ * Indices are GL_UNSIGNED_SHORT, relative to the base vertex of their mesh
+ */
+class MeshBuffer : Noncopyable
+{
+public:
+    // in vertices and indices
+    struct Allocation
+    {
+        Allocation() : vertexOffset(0), vertexCount(0), indexOffset(0), indexCount(0)
+        {}
+
+        size_t vertexOffset;
+        size_t vertexCount;
+        size_t indexOffset;
+        size_t indexCount;
+    };
+
+    struct Stats
+    {
+        Stats() : allocations(0), vertexCapacity(0), vertexUsed(0), indexCapacity(0), indexUsed(0), freeRanges(0), largestFreeBytes(0), freeBytes(0)
+        {}
+
+        // used over capacity, of both buffers in bytes
+        float utilization() const;
+
+        // how much of the free space isn't in the largest free range
+        float fragmentation() const;
+
+        int allocations;
+        size_t vertexCapacity;
+        size_t vertexUsed;
+        size_t indexCapacity;
+        size_t indexUsed;
+        int freeRanges;
+        size_t largestFreeBytes;
+        size_t freeBytes;
+    };
+
+    MeshBuffer(size_t vertexSize, const vector<VertexAttribute>& attributes);
+    ~MeshBuffer();
+
+    // copies the vertices and indices through the upload scheduler
+    Allocation allocate(const void* vertexData, size_t vertexCount, const uint16_t* indexData, size_t indexCount);
+    void free(const Allocation& allocation);
+
+    GLuint vertexArray() const;
+
+    Stats stats() const;
+
+private:
+    // offsets and sizes of free ranges, in elements
+    struct FreeList
+    {
+        FreeList() : capacity(0), used(0)
+        {}
+
+        // returns false when nothing is big enough
+        bool allocate(size_t count, size_t& offset);
+        void free(size_t offset, size_t count);
+        void grow(size_t newCapacity);
+
+        map<size_t, size_t> ranges;
+        size_t capacity;
+        size_t used;
+    };
+
+    static void growBuffer(GLenum target, GLuint& buffer, size_t oldSize, size_t newSize);
+
+    size_t allocateVertices(size_t count);
+    size_t allocateIndices(size_t count);
+    void setAttributes();
+
+    size_t vertexSize_;
+    vector<VertexAttribute> attributes_;
+    GLuint vertexArray_;
+    GLuint vertexBuffer_;
+    GLuint indexBuffer_;
+    FreeList vertices_;
+    FreeList indices_;
+    int allocations_;
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_MESHBUILDER_H
+#define BZR_GRAPHICS_MESHBUILDER_H
+
+#include "Resource.h"
+#include "TriangleFan.h"
+#include <unordered_map>
+
+struct Vertex;
+
+/*
+ * Builds the vertices and indexed triangle lists of a mesh, a batch per surface
+ * Vertices are shared by every fan index with the same vertex and texture coordinates,
+ * fans are split into triangles, and the triangles of each batch are reordered for the
+ * post-transform vertex cache, after Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+ * With overdraw ordering, the reordered triangles are then split into clusters where the
+ * cache starts over anyway, and the clusters that face out from the middle of the batch,
+ * and so are likely to hide the others, are moved first
+ * Builds don't touch GL, so they can run anywhere
+ */
+class MeshBuilder
+{
+public:
+    struct Batch
+    {
+        ResourcePtr surface;
+        int indexCount;
+    };
+
+    struct Stats
+    {
+        Stats() : fanVertices(0), vertices(0), triangles(0), listCacheMisses(0), cacheMisses(0)
+        {}
+
+        int fanVertices; // a vertex per fan index, as fans were drawn before
+        int vertices; // shared
+        int triangles;
+
+        // transformed vertices with a FIFO cache of kReportCacheSize, over triangles is the ACMR
+        int listCacheMisses; // in the order of the fans
+        int cacheMisses; // reordered
+    };
+
+    // vx, vy, vz, nx, ny, nz, s, t
+    static const int kComponentsPerVertex = 8;
+
+    static const int kReportCacheSize = 16;
+
+    explicit MeshBuilder(bool overdrawOrder);
+
+    // hit geometry goes in a last batch of hitSurface, unless it's null
+    void build(const vector<ResourcePtr>& surfaces,
+        const vector<Vertex>& vertices,
+        const vector<TriangleFan>& triangleFans,
+        const vector<TriangleFan>& hitTriangleFans,
+        const ResourcePtr& hitSurface);
+
+    // indices are for GL_TRIANGLES, each batch follows the last
+    const vector<float>& vertexData() const;
+    const vector<uint16_t>& indexData() const;
+    const vector<Batch>& batches() const;
+    const Stats& stats() const;
+
+    static int countCacheMisses(const uint16_t* indices, size_t count, int cacheSize);
+
+private:
+    void addFan(const vector<Vertex>& vertices, const TriangleFan& triangleFan, bool hit);
+    uint16_t addVertex(const Vertex& vertex, const TriangleFan::Index& index, bool hit);
+    void optimizeBatch(size_t first, size_t count);
+    void orderForOverdraw(size_t first, size_t count);
+    glm::vec3 position(uint16_t index) const;
+
+    bool overdrawOrder_;
+
+    vector<float> vertexData_;
+    vector<uint16_t> indexData_;
+    vector<Batch> batches_;
+    Stats stats_;
+
+    // vertex and texture coordinate index to shared vertex
+    unordered_map<uint64_t, uint16_t> sharedVertices_;
+};
+
+#endif
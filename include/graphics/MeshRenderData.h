@@ -18,15 +18,21 @@
 #ifndef BZR_GRAPHICS_MESHRENDERDATA_H
 #define BZR_GRAPHICS_MESHRENDERDATA_H
 
+#include "graphics/MeshBuffer.h"
+#include "graphics/MeshBuilder.h"
+#include "graphics/RenderQueue.h"
 #include "Destructable.h"
 #include "Noncopyable.h"
 #include "Resource.h"
 
+struct ImgColor;
 struct Model;
 class Structure;
 struct Vertex;
 struct TriangleFan;
 
+// A range of the renderer's mesh buffer, with a batch of indices per surface
+// Vertices are quantized, see PackedVertex in MeshRenderData.cpp
 class MeshRenderData : public Destructable, Noncopyable
 {
 public:
@@ -34,24 +40,48 @@ public:
     MeshRenderData(const Structure& structure);
     ~MeshRenderData();
 
-    void render();
+    // the vertex format of the renderer's mesh buffer
+    static size_t vertexSize();
+    static vector<VertexAttribute> vertexAttributes();
+
+    // queues a draw per batch, filling in the texture, vertex array and indices of draw,
+    // and applying the position matrix to its world matrix
+    // distance orders the draws, textureDistance is how near their textures are seen
+    void enqueue(RenderQueue& queue, RenderQueue::Pass pass, float distance, float textureDistance, RenderQueue::Draw draw);
+
+    // from the quantized positions to the model's space, instance matrices need it too
+    const glm::mat4& positionMatrix() const;
+
+
+    // creates the textures the upload scheduler hasn't got to yet, for draws that can't wait
+    void uploadTextures();
+
+    // per draw of every batch
+    int triangleCount() const;
+
+    size_t calcSize() const override;
 
 private:
-    struct Batch
-    {
-        ResourcePtr surface;
-        int indexCount;
-    };
+    typedef MeshBuilder::Batch Batch;
+
+    static const ImgColor& getImgColor(const Batch& batch);
+
+    // the placeholder texture until the upload scheduler creates it
+    static GLuint getTexture(const Batch& batch, float distance);
 
     void init(const vector<ResourcePtr>& surfaces,
         const vector<Vertex>& vertices,
         const vector<TriangleFan>& triangleFans,
         const vector<TriangleFan>& hitTriangleFans);
 
+    // meshes can outlive the renderer, in resources
+    weak_ptr<MeshBuffer> meshBuffer_;
+    MeshBuffer::Allocation allocation_;
     GLuint vertexArray_;
-    GLuint vertexBuffer_;
-    GLuint indexBuffer_;
+    glm::mat4 positionMat_;
     vector<Batch> batches_;
+    int triangleCount_;
+    size_t size_;
 };
 
 #endif
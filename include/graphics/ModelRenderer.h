@@ -18,47 +18,117 @@
 #ifndef BZR_GRAPHICS_MODELRENDERER_H
 #define BZR_GRAPHICS_MODELRENDERER_H
 
-#include "graphics/Program.h"
+#include "graphics/Frustum.h"
+#include "graphics/ImpostorRenderer.h"
+#include "graphics/RenderQueue.h"
+#include "graphics/UploadScheduler.h"
 #include "Noncopyable.h"
 #include "Resource.h"
 
+class MeshRenderData;
+class OcclusionCuller;
 struct Model;
 struct Setup;
 
-class ModelRenderer : Noncopyable
+// Static objects are drawn instanced, grouped by model, unless ModelRenderer.instanced is false
+// Models with degrade info are swapped for less detailed ones with distance, unless ModelRenderer.degrade is false
+// Static objects of lands beyond ModelRenderer.impostorDistance fade into impostors over ModelRenderer.impostorFade
+// Models without a mesh yet are skipped until the upload scheduler creates it
+class ModelRenderer : public UploadScheduler::Uploader, Noncopyable
 {
 public:
-    struct DepthSortedModel
+    ModelRenderer();
+    ~ModelRenderer();
+
+    // bakes the impostors that were missing last frame, before the frame constants are bound
+    void bakeImpostors();
+
+    // queues the models to draw, impostors are drawn straight away
+    void render(const glm::mat4& projectionMat, const glm::mat4& viewMat);
+
+    // creates the mesh of a model
+    size_t upload(const void* item) override;
+
+    // of the models of objects, static objects and the parts of their setups
+    const CullStats& cullStats() const;
+
+    // triangles queued last frame, by the index in its degrade info of the model drawn
+    const vector<int>& degradeTriangles() const;
+
+    const CullStats& impostorCullStats() const;
+
+private:
+    struct VisibleModel
     {
         const Model* model;
         glm::mat4 worldMat;
-        glm::vec3 worldPos;
+        fp_t scale; // the largest of worldMat
+        float fade; // less than 1 while fading into an impostor
     };
 
-    ModelRenderer();
-    ~ModelRenderer();
+    // a static model drawn instanced
+    struct Instance
+    {
+        const Model* model;
+        glm::mat4 worldMat;
+        float distance; // from the camera
+    };
 
-    void render(const glm::mat4& projectionMat, const glm::mat4& viewMat);
+    // an object or static object, whose models are visibleModels_[first, last)
+    struct VisibleObject
+    {
+        uint64_t key; // for the occlusion culler
+        size_t first;
+        size_t last;
+    };
 
-private:
-    void renderOne(const ResourcePtr& resource,
-        const glm::mat4& projectionMat,
-        const glm::mat4& viewMat,
-        const glm::mat4& worldMat);
-
-    void renderSetup(const Setup& setup,
-        const glm::mat4& projectionMat,
-        const glm::mat4& viewMat,
-        const glm::mat4& worldMat);
-
-    void renderModel(const Model& model,
-        const glm::mat4& projectionMat,
-        const glm::mat4& viewMat,
-        const glm::mat4& worldMat,
-        bool firstPass);
-
-    Program program_;
-    vector<DepthSortedModel> depthSortList_;
+    void addObject(uint64_t key, const ResourcePtr& resource, const glm::mat4& worldMat, float fade);
+    void addOne(const ResourcePtr& resource, const glm::mat4& worldMat, float fade);
+    void addSetup(const Setup& setup, const glm::mat4& worldMat, float fade);
+    void addModel(const Model& model, const glm::mat4& worldMat, float fade);
+    float addImpostor(const ResourcePtr& resource, const glm::mat4& worldMat, const glm::vec3& cameraPosition);
+
+    void enqueueModel(const Model& model, const glm::mat4& worldMat, RenderQueue::Pass pass, float distance, float fade);
+    void enqueueInstanced();
+    void cullOccluded(OcclusionCuller& occlusionCuller);
+    void renderImpostors(const Frustum& frustum);
+
+    const Model& selectDegrade(const Model& model, fp_t distance, size_t& level) const;
+
+    // the level nearest to level with render data, which is updated, null if none has any
+    const Model* findResidentDegrade(const Model& model, size_t& level) const;
+
+    static MeshRenderData& getMesh(const Model& model);
+
+    bool instanced_;
+    bool degrade_;
+
+    // only with a ModelRenderer.impostorDistance
+    unique_ptr<ImpostorRenderer> impostorRenderer_;
+    fp_t impostorDistance_;
+    fp_t impostorFade_;
+    GLuint instanceBuffer_;
+
+    // per frame culling state
+    vector<VisibleModel> visibleModels_;
+    size_t numDynamicModels_; // the models of objects come first, then static objects
+    vector<VisibleObject> objects_;
+    CullBatch cullBatch_;
+    vector<uint8_t> visible_;
+    CullStats cullStats_;
+    vector<int> degradeTriangles_;
+
+    // static models to draw instanced, sorted by model
+    vector<Instance> instances_;
+    vector<glm::mat4> instanceData_;
+
+    // per frame impostor state
+    vector<ImpostorRenderer::Instance> impostors_;
+    vector<ImpostorRenderer::Instance> visibleImpostors_;
+    CullBatch impostorCullBatch_;
+    vector<uint8_t> impostorVisible_;
+    CullStats impostorCullStats_;
+    vector<ImpostorRenderer::Part> bakeParts_;
 };
 
 #endif
\ No newline at end of file
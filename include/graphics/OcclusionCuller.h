@@ -0,0 +1,101 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_OCCLUSIONCULLER_H
+#define BZR_GRAPHICS_OCCLUSIONCULLER_H
+
+#include "graphics/Program.h"
+#include "LandcellId.h"
+#include "Noncopyable.h"
+#include "ObjectId.h"
+#include <unordered_map>
+
+/*
+ * Occlusion culling with GL_ANY_SAMPLES_PASSED queries on bounding boxes
+ * Objects are drawn or not by what their last test found, and tested again this frame
+ * after the opaque pass, so waiting on results never stalls, at the cost of anything
+ * coming into view a frame late. Objects not tested yet, or with the camera inside their box, are visible
+ */
+class OcclusionCuller : Noncopyable
+{
+public:
+    struct Stats
+    {
+        Stats() : checked(0), occluded(0)
+        {}
+
+        int checked;
+        int occluded;
+    };
+
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    // picks up the results that are in from earlier tests
+    void begin();
+
+    // keys are built from ids rather than addresses, which are reused once a landblock is unloaded
+    // and would inherit what was last found for whatever was there before
+    static uint64_t objectKey(ObjectId id);
+    static uint64_t structureKey(LandcellId id);
+    // the index-th static object of a landblock or structure
+    static uint64_t staticObjectKey(LandcellId id, size_t index);
+
+    // whether the object was visible when it was last tested, and tests it this frame
+    // the box is in world space
+    bool check(uint64_t key, const glm::vec3& center, const glm::vec3& extents);
+
+    // tests the boxes checked this frame against the depth drawn so far
+    void end();
+
+    // of the last frame
+    const Stats& stats() const;
+    float occludedFraction() const;
+
+private:
+    struct Entry
+    {
+        GLuint query;
+        bool pending; // the query hasn't been read
+        bool visible;
+        uint32_t lastChecked; // frame
+    };
+
+    struct Test
+    {
+        GLuint query;
+        glm::vec3 center;
+        glm::vec3 extents;
+    };
+
+    void initGeometry();
+
+    Program program_;
+    Uniform<glm::vec3> boxCenter_;
+    Uniform<glm::vec3> boxExtents_;
+    GLuint vertexArray_;
+    GLuint vertexBuffer_;
+    GLuint indexBuffer_;
+
+    unordered_map<uint64_t, Entry> entries_;
+    vector<GLuint> freeQueries_;
+    vector<Test> tests_;
+    uint32_t frame_;
+    Stats stats_;
+};
+
+#endif
@@ -29,14 +29,46 @@ public:
 
     void create();
     void attach(GLenum type, const GLchar* source);
+
+    // also binds the FrameConstants and DrawConstants blocks, if the program has them
     void link();
     void use();
     GLint getUniform(const GLchar* name);
     void destroy();
+    GLuint handle() const;
 
 private:
+    void bindUniformBlock(const GLchar* name, GLuint binding);
+
     GLuint handle_;
     LiteralUnorderedMap<GLint> uniforms_;
 };
 
+// A uniform whose location is looked up once, after the program is linked
+// Set with the program in use
+template<class T>
+class Uniform
+{
+public:
+    Uniform() : location_(-1)
+    {}
+
+    void init(Program& program, const GLchar* name)
+    {
+        location_ = program.getUniform(name);
+    }
+
+    void set(const T& value) const;
+
+private:
+    GLint location_;
+};
+
+template<> void Uniform<GLint>::set(const GLint& value) const;
+template<> void Uniform<GLfloat>::set(const GLfloat& value) const;
+template<> void Uniform<glm::vec3>::set(const glm::vec3& value) const;
+template<> void Uniform<glm::vec4>::set(const glm::vec4& value) const;
+template<> void Uniform<glm::mat3>::set(const glm::mat3& value) const;
+template<> void Uniform<glm::mat4>::set(const glm::mat4& value) const;
+
 #endif
\ No newline at end of file
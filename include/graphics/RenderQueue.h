@@ -0,0 +1,134 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_RENDERQUEUE_H
+#define BZR_GRAPHICS_RENDERQUEUE_H
+
+#include "Noncopyable.h"
+
+class Program;
+class UniformRing;
+
+/*
+ * Renderers queue their draws and the queue submits them once a frame
+ * Draws are radix sorted by a 64 bit key
+ *   opaque: pass, program, texture, vertex array, then front to back
+ *   transparent: pass, back to front, program, texture, vertex array
+ * and program, texture and vertex array binds that wouldn't change anything are skipped
+ * The renderer binds FrameConstants, the world matrices of single draws are written to
+ * the uniform ring in sorted order, a chunk at a time right before the chunk is drawn,
+ * and each draw binds its DrawConstants by offset
+ * Transparent depth is the float distance from the camera, whose bits sort like the floats
+ */
+class RenderQueue : Noncopyable
+{
+public:
+    enum class Pass
+    {
+        kOpaque,
+        kTransparent
+    };
+
+    struct Draw
+    {
+        Draw() :
+            program(nullptr),
+            texture(0),
+            vertexArray(0),
+            mode(GL_TRIANGLES),
+            indexCount(0),
+            indexOffset(0),
+            baseVertex(0),
+            instanceBuffer(0),
+            instanceOffset(0),
+            instanceCount(0),
+            fade(1.0f)
+        {}
+
+        Program* program;
+        GLuint texture;
+        GLuint vertexArray;
+        GLenum mode;
+        GLsizei indexCount;
+        size_t indexOffset; // bytes, indices are GL_UNSIGNED_SHORT
+        GLint baseVertex; // added to the indices
+
+        // instanceCount is 0 for one draw with worldMat, otherwise there are that many
+        // world matrices at instanceOffset bytes into instanceBuffer, for attributes 3 to 6
+        glm::mat4 worldMat;
+        GLuint instanceBuffer;
+        size_t instanceOffset;
+        GLsizei instanceCount;
+
+        // less than 1 to dither out a single draw, see Dither.glsl
+        float fade;
+    };
+
+    struct Stats
+    {
+        Stats() : draws(0), unsortedStateChanges(0), stateChanges(0)
+        {}
+
+        int draws;
+        int unsortedStateChanges; // had the draws been submitted in the order they were queued
+        int stateChanges;
+    };
+
+    explicit RenderQueue(UniformRing& uniformRing);
+
+    // distance is from the camera
+    void add(Pass pass, float distance, const Draw& draw);
+
+    // sorts everything queued, call once before submitting the passes
+    void sort();
+
+    // draws what's queued for a pass, with program in place of the draws' own if it isn't null
+    void submit(Pass pass, Program* program = nullptr);
+
+    // forgets everything queued
+    void clear();
+
+    // of the last frame
+    const Stats& stats() const;
+
+private:
+    struct Packet
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    static uint64_t calcKey(Pass pass, float distance, const Draw& draw);
+    void sortPackets();
+    int countStateChanges() const;
+    void setInstanceAttributes(const Draw& draw);
+    // for the draws of the pass from first on, up to chunkSize of them, returns where the chunk ends
+    size_t writeDrawConstants(Pass pass, size_t first, size_t chunkSize, size_t stride);
+    void flushDrawConstants(size_t stride);
+
+    UniformRing& uniformRing_;
+    vector<Draw> draws_;
+    vector<Packet> packets_;
+    vector<Packet> scratch_;
+    vector<size_t> drawConstantsOffsets_; // in the uniform ring, per packet
+    vector<size_t> chunkPackets_; // waiting to be flushed
+    vector<uint8_t> chunkData_;
+    vector<GLuint> instancedVertexArrays_; // that have attributes 3 to 6 enabled
+    Stats stats_;
+};
+
+#endif
@@ -25,9 +25,17 @@
 #endif
 
 class LandRenderer;
+class MeshBuffer;
 class ModelRenderer;
+class OcclusionCuller;
+class Program;
+class RenderQueue;
 class SkyRenderer;
 class StructureRenderer;
+class TextureResidency;
+class TransparencyBuffer;
+class UniformRing;
+class UploadScheduler;
 
 class Renderer : Noncopyable
 {
@@ -42,8 +50,40 @@ public:
     GLfloat textureMaxAnisotropy() const;
     bool renderHitGeometry() const;
 
+    // whether meshes are built with MeshBuilder's overdraw ordering
+    bool overdrawOrder() const;
+
+    RenderQueue& renderQueue();
+
+    // per draw constants are streamed through it
+    UniformRing& uniformRing();
+
+    // render data is created through it, at the end of each scene
+    UploadScheduler& uploadScheduler();
+
+    // that every MeshRenderData is allocated from, they hold on to it weakly as they can outlive the renderer
+    const shared_ptr<MeshBuffer>& meshBuffer();
+
+    // every TextureRenderData is registered with it
+    TextureResidency& textureResidency();
+
+    // null without Renderer.occlusionCulling
+    OcclusionCuller* occlusionCuller();
+
+    // writes FrameConstants to their own buffer and binds it, not the uniform ring, as that
+    // is orphaned when it fills up and what it held before is gone for the draws after
+    void bindFrameConstants(const glm::mat4& projectionMat, const glm::mat4& viewMat, const glm::vec3& cameraPosition);
+
+    // ModelVertexShader.glsl and ModelInstancedVertexShader.glsl with ModelFragmentShader.glsl,
+    // shared by structures and models
+    Program& meshProgram();
+    Program& meshInstancedProgram();
+
 private:
     void createWindow();
+    void initMeshPrograms();
+    void renderScene(const glm::mat4& projectionMat, const glm::mat4& viewMat);
+    void logStats();
 #ifdef OCULUSVR
     void initOVR();
     void cleanupOVR();
@@ -54,6 +94,9 @@ private:
     GLenum textureMinFilter_;
     GLfloat textureMaxAnisotropy_;
     bool renderHitGeometry_;
+    bool overdrawOrder_;
+    int statsInterval_; // frames between logging stats, 0 for never
+    int framesSinceStats_;
 
     bool videoInit_;
     SDL_Window* window_;
@@ -70,6 +113,17 @@ private:
     GLuint framebuffer_;
 #endif
 
+    GLuint frameConstantsBuffer_;
+    unique_ptr<UniformRing> uniformRing_;
+    unique_ptr<UploadScheduler> uploadScheduler_;
+    unique_ptr<TextureResidency> textureResidency_;
+    shared_ptr<MeshBuffer> meshBuffer_;
+    unique_ptr<RenderQueue> renderQueue_;
+    unique_ptr<Program> meshProgram_;
+    unique_ptr<Program> meshInstancedProgram_;
+    unique_ptr<TransparencyBuffer> transparencyBuffer_; // only with Renderer.orderIndependentTransparency
+    unique_ptr<OcclusionCuller> occlusionCuller_;
+
     unique_ptr<SkyRenderer> skyRenderer_;
     unique_ptr<LandRenderer> landRenderer_;
     unique_ptr<StructureRenderer> structureRenderer_;
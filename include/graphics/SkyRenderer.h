@@ -37,6 +37,7 @@ private:
     void initTexture();
 
     Program program_;
+    Uniform<glm::mat4> rotationMat_;
     GLuint vertexArray_;
     GLuint vertexBuffer_;
     GLsizei vertexCount_;
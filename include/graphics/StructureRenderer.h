@@ -18,28 +18,105 @@
 #ifndef BZR_GRAPHICS_STRUCTURERENDERER_H
 #define BZR_GRAPHICS_STRUCTURERENDERER_H
 
-#include "graphics/Program.h"
+#include "graphics/Frustum.h"
+#include "graphics/UploadScheduler.h"
+#include "Destructable.h"
+#include "LandcellManager.h"
 #include "Noncopyable.h"
+#include <map>
 
+class MeshRenderData;
 class Structure;
 
-class StructureRenderer : Noncopyable
+/*
+ * When the camera is inside a structure, only the structures reachable from it
+ * through portals that are on screen and in its visible cell list are drawn
+ * Structures that are seen outside are drawn when the camera is outside or
+ * can see outside through a portal
+ * StructureRenderer.portalCulling can be set to false to draw everything
+ *
+ * Structures with the same environment part and surfaces share one MeshRenderData,
+ * structures without one yet are skipped until the upload scheduler creates it
+ */
+class StructureRenderer : public UploadScheduler::Uploader, Noncopyable
 {
 public:
     StructureRenderer();
     ~StructureRenderer();
 
+    // queues the structures to draw
     void render(const glm::mat4& projectionMat, const glm::mat4& viewMat);
 
+    // creates the mesh of a structure
+    size_t upload(const void* item) override;
+
+    // of the structures that passed portal culling
+    const CullStats& cullStats() const;
+
 private:
-    void renderStructure(
-        const Structure& structure,
-        const glm::mat4& projectionMat,
-        const glm::mat4& view,
-        const glm::vec3& position,
-        const glm::quat& rotation);
-
-    Program program_;
+    // stored in the structure's render data
+    struct Tag : public Destructable
+    {
+        shared_ptr<MeshRenderData> mesh;
+
+        // an even share of the mesh
+        size_t calcSize() const override;
+    };
+
+    struct MeshKey
+    {
+        uint32_t environmentId;
+        uint16_t partNum;
+        vector<uint32_t> surfaceIds;
+
+        bool operator<(const MeshKey& other) const;
+    };
+
+    struct VisibleStructure
+    {
+        const Structure* structure;
+        glm::vec3 blockPosition;
+    };
+
+    // screen space bounds of what can be seen through a chain of portals, in NDC
+    struct PortalView
+    {
+        glm::vec2 min;
+        glm::vec2 max;
+    };
+
+    const Structure* findCameraStructure(const LandcellManager::Slot& slot, const glm::vec3& blockPosition) const;
+    void flood(const Structure& structure, const PortalView& view, int depth);
+    bool calcPortalView(const Structure& structure, const Structure::Portal& portal, PortalView& view) const;
+
+    void addSeenOutside();
+    void addStructure(const Structure& structure, const glm::vec3& blockPosition);
+    void enqueueStructure(const Structure& structure, const glm::vec3& blockPosition);
+    static MeshKey makeMeshKey(const Structure& structure);
+
+    // null if neither the structure nor another with the same key has a mesh yet
+    MeshRenderData* findMesh(const Structure& structure);
+    MeshRenderData& getMesh(const Structure& structure);
+
+    bool portalCulling_;
+
+    map<MeshKey, weak_ptr<MeshRenderData>> meshes_;
+    size_t meshesPruneSize_; // expired meshes are pruned when there are this many
+
+    // per frame flood state
+    const LandcellManager::Slot* cameraSlot_;
+    const Structure* cameraStructure_;
+    glm::vec3 cameraBlockPosition_;
+    glm::mat4 projectionViewMat_;
+    vector<bool> reached_; // indexed like cameraSlot_->structures
+    vector<bool> onPath_;
+    bool seesOutside_;
+
+    // per frame culling state
+    vector<VisibleStructure> visibleStructures_;
+    CullBatch cullBatch_;
+    vector<uint8_t> visible_;
+    CullStats cullStats_;
 };
 
 #endif
\ No newline at end of file
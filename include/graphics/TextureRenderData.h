@@ -23,6 +23,7 @@
 
 struct ImgColor;
 
+// Registered with the texture residency manager, which can evict it when it isn't used
 class TextureRenderData : public Destructable, Noncopyable
 {
 public:
@@ -30,9 +31,32 @@ public:
     ~TextureRenderData();
 
     void bind();
+    GLuint handle() const;
+
+    // marks it used this frame, at distance
+    void touch(float distance);
+
+    // resets the render data of its ImgColor, deleting this
+    void evict();
+
+    // GL_TEXTURE_BASE_LEVEL, the mipmaps above are never sampled
+    void setBaseLevel(int level);
+
+    int lastUsedFrame() const;
+    float nearestDistance() const; // of the last frame it was used
+    int maxLevel() const;
+
+    // with its mipmaps
+    size_t calcSize() const override;
 
 private:
+    const ImgColor& imgColor_;
     GLuint handle_;
+    size_t size_;
+    int maxLevel_;
+    int baseLevel_;
+    int lastUsedFrame_;
+    float nearestDistance_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_TEXTURERESIDENCY_H
+#define BZR_GRAPHICS_TEXTURERESIDENCY_H
+
+#include "Noncopyable.h"
+#include <unordered_set>
+
+class TextureRenderData;
+
+/*
+ * Keeps the textures on the GPU within TextureResidency.budget MiB, 0 for no budget
+ * When they add up to more, the ones used longest ago are evicted and uploaded again
+ * if they're used again. Textures used in the last few frames are never evicted
+ * With a TextureResidency.mipClampDistance, textures only used further away than that
+ * have their base level raised by one for every doubling of the distance
+ */
+class TextureResidency : Noncopyable
+{
+public:
+    struct Stats
+    {
+        Stats() : textures(0), bytes(0), evicted(0)
+        {}
+
+        int textures;
+        size_t bytes;
+        int evicted;
+    };
+
+    TextureResidency();
+
+    // evicts every texture, while there's still a context to delete them in
+    ~TextureResidency();
+
+    // TextureRenderData adds and removes itself
+    void add(TextureRenderData& texture);
+    void remove(TextureRenderData& texture);
+
+    // counted up by update
+    int frame() const;
+
+    // evicts and clamps after the frame's draws
+    void update();
+
+    // of the last frame
+    const Stats& stats() const;
+
+private:
+    struct CompareByLastUsed;
+
+    void clampBaseLevels();
+    void evict();
+
+    size_t budget_;
+    fp_t mipClampDistance_;
+    int frame_;
+
+    unordered_set<TextureRenderData*> textures_;
+    size_t bytes_;
+    vector<TextureRenderData*> candidates_;
+    Stats stats_;
+};
+
+#endif
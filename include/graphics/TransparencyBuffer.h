@@ -0,0 +1,62 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_TRANSPARENCYBUFFER_H
+#define BZR_GRAPHICS_TRANSPARENCYBUFFER_H
+
+#include "graphics/Program.h"
+#include "Noncopyable.h"
+
+// Weighted blended order independent transparency (McGuire and Bavoil 2013)
+// Transparent surfaces are accumulated with program() between begin and end,
+// in any order, and then composited over the framebuffer that was bound at begin
+class TransparencyBuffer : Noncopyable
+{
+public:
+    TransparencyBuffer();
+    ~TransparencyBuffer();
+
+    // ModelVertexShader.glsl with ModelOitFragmentShader.glsl
+    Program& program();
+
+    // binds and clears the buffer, with a copy of the depth of the current framebuffer
+    void begin();
+
+    // composites the buffer and restores the framebuffer and blending
+    void end();
+
+private:
+    void resize(GLsizei width, GLsizei height);
+    void destroyTargets();
+
+    Program program_;
+    Program compositeProgram_;
+    GLuint vertexArray_; // empty, the composite triangle has no attributes
+
+    GLuint framebuffer_;
+    GLuint accumTexture_;
+    GLuint revealageTexture_;
+    GLuint depthBuffer_;
+    GLsizei width_;
+    GLsizei height_;
+
+    // the framebuffer and viewport at begin
+    GLint previousFramebuffer_;
+    GLint viewport_[4];
+};
+
+#endif
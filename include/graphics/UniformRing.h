@@ -0,0 +1,78 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_UNIFORMRING_H
+#define BZR_GRAPHICS_UNIFORMRING_H
+
+#include "Noncopyable.h"
+
+// Binding points of the uniform blocks shared by the shaders, bound by Program::link
+enum UniformBlockBinding
+{
+    kFrameConstantsBinding = 0, // FrameConstants.glsl
+    kDrawConstantsBinding = 1 // DrawConstants.glsl
+};
+
+// FrameConstants.glsl, std140
+struct FrameConstants
+{
+    glm::mat4 projectionMatrix;
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionViewMatrix;
+    glm::vec4 normalMatrix[3]; // mat3 columns are padded to vec4
+    glm::vec4 cameraPosition;
+    glm::vec3 lightPosition;
+    float worldRadius; // Frustum::kWorldRadius
+};
+
+// DrawConstants.glsl, std140
+struct DrawConstants
+{
+    glm::mat4 worldMatrix;
+    float fade;
+    float padding[3];
+};
+
+// A uniform buffer that uniform data is streamed through
+// Writes go after the last one, unsynchronized, and the buffer is orphaned when it fills up,
+// so nothing waits on draws that still read what was written before
+// Bindings refer to the buffer, not its storage, so after a write any range written before it
+// may be gone: draw with what's written before writing anything else
+class UniformRing : Noncopyable
+{
+public:
+    explicit UniformRing(size_t size);
+    ~UniformRing();
+
+    // the stride between blocks bound separately
+    size_t align(size_t size) const;
+
+    // copies size bytes, no more than size(), and returns their offset
+    size_t write(const void* data, size_t size);
+
+    void bind(UniformBlockBinding binding, size_t offset, size_t size) const;
+
+    size_t size() const;
+
+private:
+    GLuint buffer_;
+    size_t size_;
+    size_t offset_;
+    size_t alignment_;
+};
+
+#endif
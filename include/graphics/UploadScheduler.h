@@ -0,0 +1,104 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BZR_GRAPHICS_UPLOADSCHEDULER_H
+#define BZR_GRAPHICS_UPLOADSCHEDULER_H
+
+#include "Noncopyable.h"
+
+/*
+ * Render data is created when there's budget for it instead of as soon as it's drawn
+ * Renderers request what they are missing while they draw, skip it or draw a placeholder,
+ * and at the end of the scene the requests are served, most important first, until
+ * UploadScheduler.budgetMs milliseconds or UploadScheduler.budgetKb KiB have been spent
+ * Buffer and texture data goes through a staging buffer of UploadScheduler.stagingSize MiB,
+ * so the copies are done by the GPU when it gets to them, instead of by the driver while we wait
+ */
+class UploadScheduler : Noncopyable
+{
+public:
+    // creates the render data of items, for the renderers that own them
+    class Uploader
+    {
+    public:
+        virtual ~Uploader() {}
+
+        // returns the bytes uploaded
+        virtual size_t upload(const void* item) = 0;
+    };
+
+    struct Stats
+    {
+        Stats() : requested(0), uploaded(0), bytes(0)
+        {}
+
+        int requested;
+        int uploaded;
+        size_t bytes;
+    };
+
+    UploadScheduler();
+    ~UploadScheduler();
+
+    // items only have to stay alive until the end of the scene, requested again every frame
+    // until they are uploaded, the largest priority first, of a radius over a distance
+    void request(Uploader& uploader, const void* item, float priority);
+
+    // serves the requests of this frame within the budget
+    void run();
+
+    // a grey texel, for textures not uploaded yet
+    GLuint placeholderTexture() const;
+
+    // glBufferData of the bound buffer of target, with GL_STATIC_DRAW
+    void bufferData(GLenum target, size_t size, const void* data);
+
+    // glBufferSubData of the bound buffer of target
+    void bufferSubData(GLenum target, size_t offset, size_t size, const void* data);
+
+    // glTexImage2D and glCompressedTexImage2D of the bound texture, level 0 of GL_TEXTURE_2D
+    void texImage2D(GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* data, size_t size);
+    void compressedTexImage2D(GLenum internalFormat, GLsizei width, GLsizei height, const void* data, size_t size);
+
+    // of the last frame
+    const Stats& stats() const;
+
+private:
+    struct Request
+    {
+        Uploader* uploader;
+        const void* item;
+        float priority;
+    };
+
+    // copies data to the staging buffer, returns its offset, or -1 when it doesn't fit at all
+    ptrdiff_t stage(const void* data, size_t size);
+
+    double budgetSeconds_;
+    size_t budgetBytes_;
+
+    vector<Request> requests_;
+    Stats stats_;
+
+    GLuint stagingBuffer_;
+    size_t stagingSize_;
+    size_t stagingOffset_;
+
+    GLuint placeholderTexture_;
+};
+
+#endif
@@ -36,6 +36,9 @@ public:
     BSPNode(BinReader& reader, BSPTreeType treeType, uint32_t nodeType);
     virtual ~BSPNode() {}
 
+    // zero radius if the node has none
+    const Sphere& bounds() const;
+
 protected:
     BSPNode();
 
@@ -37,6 +37,10 @@ struct CellStruct
     vector<TriangleFan> triangleFans;
     vector<TriangleFan> hitTriangleFans;
     unique_ptr<BSPNode> hitTree;
+
+    // bounds of the vertices
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
 };
 
 // AC: CEnvironment
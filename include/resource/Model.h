@@ -18,6 +18,7 @@
 #ifndef BZR_MODEL_H
 #define BZR_MODEL_H
 
+#include "physics/Sphere.h"
 #include "Destructable.h"
 #include "Resource.h"
 #include "Vertex.h"
@@ -37,6 +38,11 @@ struct Model : public ResourceImpl<ResourceType::kModel>
     vector<TriangleFan> hitTriangleFans;
     unique_ptr<BSPNode> hitTree;
     bool needsDepthSort;
+    Sphere bounds; // of what's drawn
+
+    // the models of degradeInfo less detailed than this one, null for the rest
+    ResourcePtr degradeInfo;
+    vector<ResourcePtr> degrades;
 
     mutable unique_ptr<Destructable> renderData;
 };
@@ -236,5 +236,28 @@ def main():
         n.build(os.path.join('output', 'bzr$appext'), 'link', link_inputs)
         n.default(os.path.join('output', 'bzr$appext'))
 
+        # each directory in tools is a program linked with everything but our main
+        # these aren't built by default, use e.g. ninja output/bakeworld
+        tool_link_inputs = [f for f in link_inputs if f != os.path.join('build', 'main.o')]
+
+        for toolname in sorted(os.listdir('tools')):
+            tool_dir = os.path.join('tools', toolname)
+            tool_inputs = []
+
+            for filename in sorted(os.listdir(tool_dir)):
+                name, ext = os.path.splitext(filename)
+                if ext != '.cpp':
+                    continue
+
+                in_file = os.path.join(tool_dir, filename)
+                implicit = includes(in_file)
+                implicit.append(os.path.join('include', 'basic.h'))
+
+                out_file = os.path.join('build', tool_dir, name + '.o')
+                n.build(out_file, 'cxx', in_file, implicit)
+                tool_inputs.append(out_file)
+
+            n.build(os.path.join('output', toolname + '$appext'), 'link', tool_link_inputs + tool_inputs)
+
 if __name__ == '__main__':
     main()
@@ -29,6 +29,7 @@
 #include "Log.h"
 #include "ObjectManager.h"
 #include "ResourceCache.h"
+#include "SceneryCache.h"
 #include "util.h"
 
 static const fp_t kStepRate = 60.0;
@@ -44,6 +45,15 @@ void Core::execute()
     g_singleton->cleanup();
 }
 
+void Core::executeTool(void (*tool)())
+{
+    assert(!g_singleton);
+    g_singleton.reset(new Core{});
+    g_singleton->initResources();
+    tool();
+    g_singleton->cleanup();
+}
+
 Core& Core::get()
 {
     return *g_singleton;
@@ -84,6 +94,11 @@ ResourceCache& Core::resourceCache()
     return *resourceCache_;
 }
 
+SceneryCache& Core::sceneryCache()
+{
+    return *sceneryCache_;
+}
+
 LandcellManager& Core::landcellManager()
 {
     return *landcellManager_;
@@ -121,21 +136,10 @@ Core::Core() : done_(false)
 
 void Core::init()
 {
-    if(SDL_Init(SDL_INIT_TIMER) < 0)
-    {
-        throwSDLError();
-    }
-
-    config_.reset(new Config{});
-    log_.reset(new Log{});
-    portalDat_.reset(new DatFile{"data/client_portal.dat"});
-    cellDat_.reset(new DatFile{"data/client_cell_1.dat"});
-    highresDat_.reset(new DatFile{"data/client_highres.dat"});
-    resourceCache_.reset(new ResourceCache{});
+    initResources();
     landcellManager_.reset(new LandcellManager{});
     objectManager_.reset(new ObjectManager{});
     sessionManager_.reset(new SessionManager{});
-    region_ = resourceCache_->get(0x13000000);
     camera_.reset(new Camera{});
 #ifndef HEADLESS
     renderer_.reset(new Renderer{});
@@ -165,6 +169,23 @@ void Core::init()
 #endif
 }
 
+void Core::initResources()
+{
+    if(SDL_Init(SDL_INIT_TIMER) < 0)
+    {
+        throwSDLError();
+    }
+
+    config_.reset(new Config{});
+    log_.reset(new Log{});
+    portalDat_.reset(new DatFile{"data/client_portal.dat"});
+    cellDat_.reset(new DatFile{"data/client_cell_1.dat"});
+    highresDat_.reset(new DatFile{"data/client_highres.dat"});
+    resourceCache_.reset(new ResourceCache{});
+    sceneryCache_.reset(new SceneryCache{});
+    region_ = resourceCache_->get(0x13000000);
+}
+
 void Core::cleanup()
 {
 #ifndef HEADLESS
@@ -174,6 +195,7 @@ void Core::cleanup()
     sessionManager_.reset();
     objectManager_.reset();
     landcellManager_.reset();
+    sceneryCache_.reset();
     resourceCache_.reset();
     portalDat_.reset();
     cellDat_.reset();
@@ -343,5 +365,6 @@ void Core::step(fp_t dt)
         landcellManager_->setCenter(LandcellId(id.x(), id.y() + 1));
     }
 
+    landcellManager_->step(dt);
     camera_->step(dt);
 }
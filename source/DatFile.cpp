@@ -85,10 +85,13 @@ DatFile::DatFile(const string& path) :
 
     blockSize_ = headerBlock.fileInfo.blockSize - sizeof(uint32_t); // exclude next block position
     rootPosition_ = headerBlock.fileInfo.rootPosition;
+    version_ = headerBlock.fileInfo.gamePackVersion;
 }
 
 vector<uint8_t> DatFile::read(uint32_t id) const
 {
+    lock_guard<mutex> lock(mutex_);
+
     uint32_t position = rootPosition_;
 
     for(;;)
@@ -127,11 +130,18 @@ vector<uint8_t> DatFile::read(uint32_t id) const
 
 vector<uint32_t> DatFile::list() const
 {
+    lock_guard<mutex> lock(mutex_);
+
     vector<uint32_t> result;
     listDir(rootPosition_, result);
     return result;
 }
 
+uint32_t DatFile::version() const
+{
+    return version_;
+}
+
 vector<uint8_t> DatFile::readBlocks(uint32_t position, size_t size) const
 {
     vector<uint8_t> result(size);
@@ -19,17 +19,25 @@
 #include "resource/Region.h"
 #include "resource/Scene.h"
 #include "BinReader.h"
+#include "BinWriter.h"
 #include "Core.h"
 #include "DatFile.h"
-#include "LandcellManager.h"
 #include "PRNG.h"
 #include "ResourceCache.h"
-#include <glm/gtc/matrix_transform.hpp>
+#include "SceneryCache.h"
 #include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BZR_LAND_SSE
+#endif
 
 const fp_t Land::kCellSize = fp_t(24.0);
 const fp_t Land::kBlockSize = fp_t(192.0);
 
+// structure count, offset map and normal map, and the static object count
+static const size_t kBakedFixedSize = sizeof(uint32_t) + sizeof(float) * 2 +
+    Land::kOffsetMapSize * Land::kOffsetMapSize * (sizeof(uint16_t) + 3) + sizeof(uint32_t);
+
 static fp_t cubic(fp_t p[4], fp_t x)
 {
     return p[1] + fp_t(0.5) * x * (p[2] - p[0] + x * (fp_t(2.0) * p[0] - fp_t(5.0) * p[1] + fp_t(4.0) * p[2] - p[3] + x * (fp_t(3.0) * (p[1] - p[2]) + p[3] - p[0])));
@@ -48,6 +56,145 @@ static fp_t bicubic(fp_t p[4][4], fp_t x, fp_t y)
     return cubic(arr, x);
 }
 
+static bool isUpperTriangle(bool splitNESW, fp_t fx, fp_t fy)
+{
+    return splitNESW ? fy > 1.0 - fx : fy > fx;
+}
+
+static Plane calcTrianglePlane(const Land& land, int ix, int iy, bool splitNESW, bool upper)
+{
+    const fp_t kCellSize = Land::kCellSize;
+    int ix2 = min(ix + 1, Land::kGridSize - 1);
+    int iy2 = min(iy + 1, Land::kGridSize - 1);
+
+    glm::vec3 v1(ix * kCellSize, iy * kCellSize, land.getHeight(ix, iy));
+    glm::vec3 v2((ix + 1) * kCellSize, iy * kCellSize, land.getHeight(ix2, iy));
+    glm::vec3 v3(ix * kCellSize, (iy + 1) * kCellSize, land.getHeight(ix, iy2));
+    glm::vec3 v4((ix + 1) * kCellSize, (iy + 1) * kCellSize, land.getHeight(ix2, iy2));
+
+    if(splitNESW)
+    {
+        // 3---4
+        // |\  |
+        // | \ |
+        // |  \|
+        // 1---2
+        if(upper)
+        {
+            // upper right half
+            return Plane(v2, v4, v3);
+        }
+        else
+        {
+            // lower left half
+            return Plane(v1, v2, v3);
+        }
+    }
+    else
+    {
+        // 3---4
+        // |  /|
+        // | / |
+        // |/  |
+        // 1---2
+        if(upper)
+        {
+            // upper left half
+            return Plane(v1, v4, v3);
+        }
+        else
+        {
+            // lower right half
+            return Plane(v1, v2, v4);
+        }
+    }
+}
+
+// roadAtPoint for a cell with the given corner road flags, without branches
+static bool isRoad(int roads, fp_t fx, fp_t fy)
+{
+    const fp_t kRoadHalfWidth = fp_t(5.0);
+
+    bool r1 = (roads & 0x1) != 0;
+    bool r2 = (roads & 0x2) != 0;
+    bool r3 = (roads & 0x4) != 0;
+    bool r4 = (roads & 0x8) != 0;
+
+    bool west = fx < kRoadHalfWidth;
+    bool east = fx > Land::kCellSize - kRoadHalfWidth;
+    bool south = fy < kRoadHalfWidth;
+    bool north = fy > Land::kCellSize - kRoadHalfWidth;
+
+    // TODO diagonals?
+    return (r1 & r2 & r3 & r4) |
+        (r1 & ((r2 & south) | (r3 & west) | (west & south))) |
+        (r2 & east & (r4 | south)) |
+        (r3 & north & (r4 | west)) |
+        (r4 & east & north);
+}
+
+static int treeIndex(int level, int x, int y)
+{
+    static const int kLevelOffsets[] = { 0, 64, 80, 84 };
+    int size = (Land::kGridSize - 1) >> level;
+    return kLevelOffsets[level] + x * size + y;
+}
+
+// Narrows [tMin, tMax] to where the ray is over the square, false if it never is
+static bool clipRay(const glm::vec3& origin, const glm::vec3& direction, fp_t x0, fp_t y0, fp_t size, fp_t& tMin, fp_t& tMax)
+{
+    fp_t lo[] = { x0, y0 };
+
+    for(int axis = 0; axis < 2; axis++)
+    {
+        if(direction[axis] == 0.0)
+        {
+            if(origin[axis] < lo[axis] || origin[axis] > lo[axis] + size)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        fp_t t0 = (lo[axis] - origin[axis]) / direction[axis];
+        fp_t t1 = (lo[axis] + size - origin[axis]) / direction[axis];
+
+        tMin = max(tMin, min(t0, t1));
+        tMax = min(tMax, max(t0, t1));
+    }
+
+    return tMin <= tMax;
+}
+
+// Scratch space shared by the cells of a landblock while placing scenery
+struct Land::ScenePlacement
+{
+    // random values for every object in a scene
+    vector<double> random;
+
+    // objects that made it to the terrain tests
+    vector<uint32_t> candidates;
+    vector<glm::vec3> positions;
+    vector<fp_t> x;
+    vector<fp_t> y;
+    vector<fp_t> height;
+    vector<fp_t> normalZ;
+    vector<uint8_t> road;
+};
+
+TerrainQuery::TerrainQuery() :
+    count(0),
+    x(nullptr),
+    y(nullptr),
+    height(nullptr),
+    normalX(nullptr),
+    normalY(nullptr),
+    normalZ(nullptr),
+    road(nullptr),
+    found(nullptr)
+{}
+
 Land::Land(const void* data, size_t size) : numStructures_(0)
 {
     if(size != sizeof(Data))
@@ -66,9 +213,12 @@ Land::Land(const void* data, size_t size) : numStructures_(0)
             heights_[x][y] = region.landHeights[data_.heightIndices[x][y]];
         }
     }
+
+    initCells();
+    initHeightTree();
 }
 
-void Land::init()
+void Land::init(const Neighbors& neighbors)
 {
     if(!offsetMap_.empty())
     {
@@ -95,7 +245,7 @@ void Land::init()
         {
             fp_t lx = static_cast<fp_t>(sx - edgeSize) / static_cast<fp_t>(sampleSize - 1) * kBlockSize;
             fp_t ly = static_cast<fp_t>(sy - edgeSize) / static_cast<fp_t>(sampleSize - 1) * kBlockSize;
-            sample[sx + sy * totalSampleSize] = calcHeightUnbounded(lx, ly);
+            sample[sx + sy * totalSampleSize] = calcHeightUnbounded(neighbors, lx, ly);
         }
     }
 
@@ -189,6 +339,73 @@ void Land::init()
             normalMap_[(ox + oy * kOffsetMapSize) * 3 + 2] = static_cast<uint8_t>(n.z * fp_t(0xFF));
         }
     }
+
+    initHeightTree();
+}
+
+vector<uint8_t> Land::bake() const
+{
+    assert(!offsetMap_.empty());
+
+    vector<uint8_t> data(kBakedFixedSize + staticObjects_.size() * kBakedStaticObjectSize);
+    BinWriter writer(data.data(), data.size());
+
+    writer.writeInt(numStructures_);
+    writer.writeFloat(static_cast<float>(offsetMapBase_));
+    writer.writeFloat(static_cast<float>(offsetMapScale_));
+    writer.writeRaw(offsetMap_.data(), offsetMap_.size() * sizeof(uint16_t));
+    writer.writeRaw(normalMap_.data(), normalMap_.size());
+    writer.writeInt(static_cast<uint32_t>(staticObjects_.size()));
+
+    for(const StaticObject& staticObject : staticObjects_)
+    {
+        writeBaked(writer, staticObject);
+    }
+
+    assert(writer.remaining() == 0);
+
+    return data;
+}
+
+void Land::initBaked(const void* data, size_t size)
+{
+    if(!offsetMap_.empty())
+    {
+        return;
+    }
+
+    if(size < kBakedFixedSize)
+    {
+        throw runtime_error("Bad baked land length");
+    }
+
+    BinReader reader(data, size);
+
+    numStructures_ = reader.readInt();
+    offsetMapBase_ = reader.readFloat();
+    offsetMapScale_ = reader.readFloat();
+
+    offsetMap_.resize(kOffsetMapSize * kOffsetMapSize);
+    memcpy(offsetMap_.data(), reader.readRaw(offsetMap_.size() * sizeof(uint16_t)), offsetMap_.size() * sizeof(uint16_t));
+
+    normalMap_.resize(kOffsetMapSize * kOffsetMapSize * 3);
+    memcpy(normalMap_.data(), reader.readRaw(normalMap_.size()), normalMap_.size());
+
+    uint32_t numStaticObjects = reader.readInt();
+
+    if(reader.remaining() != numStaticObjects * kBakedStaticObjectSize)
+    {
+        throw runtime_error("Bad baked land length");
+    }
+
+    staticObjects_.resize(numStaticObjects);
+
+    for(StaticObject& staticObject : staticObjects_)
+    {
+        readBaked(reader, staticObject);
+    }
+
+    initHeightTree();
 }
 
 fp_t Land::getHeight(int gridX, int gridY) const
@@ -213,10 +430,7 @@ uint8_t Land::getTerrainScene(int gridX, int gridY) const
 
 bool Land::isSplitNESW(int gridX, int gridY) const
 {
-    // credits to Akilla
-    uint32_t cell_x = id().x() * 8 + gridX;
-    uint32_t cell_y = id().y() * 8 + gridY;
-    return prng(cell_x, cell_y, RND_MID_DIAG) >= 0.5;
+    return splitNESW_[gridX][gridY];
 }
 
 Plane Land::calcPlane(fp_t x, fp_t y) const
@@ -232,47 +446,9 @@ Plane Land::calcPlane(fp_t x, fp_t y) const
     fp_t fy = modf(y / kCellSize, &diy);
     int iy = static_cast<int>(diy);
 
-    glm::vec3 v1(ix * kCellSize, iy * kCellSize, getHeight(ix, iy));
-    glm::vec3 v2((ix + 1) * kCellSize, iy * kCellSize, getHeight(min(ix + 1, kGridSize - 1), iy));
-    glm::vec3 v3(ix * kCellSize, (iy + 1) * kCellSize, getHeight(ix, min(iy + 1, kGridSize - 1)));
-    glm::vec3 v4((ix + 1) * kCellSize, (iy + 1) * kCellSize, getHeight(min(ix + 1, kGridSize - 1), min(iy + 1, kGridSize - 1)));
+    bool splitNESW = isSplitNESW(ix, iy);
 
-    if(isSplitNESW(ix, iy))
-    {
-        // 3---4
-        // |\  |
-        // | \ |
-        // |  \|
-        // 1---2
-        if(fy > 1.0 - fx)
-        {
-            // upper right half
-            return Plane(v2, v4, v3);
-        }
-        else
-        {
-            // lower left half
-            return Plane(v1, v2, v3);
-        }
-    }
-    else
-    {
-        // 3---4
-        // |  /|
-        // | / |
-        // |/  |
-        // 1---2
-        if(fy > fx)
-        {
-            // upper left half
-            return Plane(v1, v4, v3);
-        }
-        else
-        {
-            // lower right half
-            return Plane(v1, v2, v4);
-        }
-    }
+    return calcTrianglePlane(*this, ix, iy, splitNESW, isUpperTriangle(splitNESW, fx, fy));
 }
 
 fp_t Land::calcHeight(fp_t x, fp_t y) const
@@ -280,50 +456,58 @@ fp_t Land::calcHeight(fp_t x, fp_t y) const
     return calcPlane(x, y).calcZ(x, y);
 }
 
-fp_t Land::calcHeightUnbounded(fp_t x, fp_t y) const
+fp_t Land::calcHeightUnbounded(const Neighbors& neighbors, fp_t x, fp_t y) const
 {
-    int lx = id().x();
-    int ly = id().y();
+    int dx = 0;
+    int dy = 0;
 
     while(x < 0.0)
     {
-        lx--;
+        dx--;
         x += kBlockSize;
     }
 
     while(x >= kBlockSize)
     {
-        lx++;
+        dx++;
         x -= kBlockSize;
     }
 
     while(y < 0.0)
     {
-        ly--;
+        dy--;
         y += kBlockSize;
     }
 
     while(y >= kBlockSize)
     {
-        ly++;
+        dy++;
         y -= kBlockSize;
     }
 
-    if(lx < 0x00 || lx > 0xFF || ly < 0x00 || ly > 0xFF)
+    if(dx < -1 || dx > 1 || dy < -1 || dy > 1)
     {
         return fp_t(0.0);
     }
 
-    auto it = Core::get().landcellManager().find(LandcellId(lx, ly));
+    const Land* land = neighbors[dx + 1][dy + 1];
 
-    if(it == Core::get().landcellManager().end())
+    if(land == nullptr)
     {
         return fp_t(0.0);
     }
 
-    Land& land = static_cast<Land&>(*it->second);
+    return land->calcHeight(x, y);
+}
+
+fp_t Land::minHeight() const
+{
+    return treeMin_[kTreeSize - 1];
+}
 
-    return land.calcHeight(x, y);
+fp_t Land::maxHeight() const
+{
+    return treeMax_[kTreeSize - 1];
 }
 
 LandcellId Land::id() const
@@ -331,6 +515,14 @@ LandcellId Land::id() const
     return LandcellId(data_.fileId);
 }
 
+size_t Land::calcSize() const
+{
+    return sizeof(*this) +
+        offsetMap_.capacity() * sizeof(uint16_t) +
+        normalMap_.capacity() * sizeof(uint8_t) +
+        Landcell::calcSize();
+}
+
 uint32_t Land::numStructures() const
 {
     return numStructures_;
@@ -341,6 +533,200 @@ const uint8_t* Land::normalMap() const
     return normalMap_.data();
 }
 
+void Land::initCells()
+{
+    for(int x = 0; x < kGridSize; x++)
+    {
+        for(int y = 0; y < kGridSize; y++)
+        {
+            // credits to Akilla
+            uint32_t cellX = id().x() * 8 + x;
+            uint32_t cellY = id().y() * 8 + y;
+            splitNESW_[x][y] = prng(cellX, cellY, RND_MID_DIAG) >= 0.5;
+        }
+    }
+
+    for(int x = 0; x < kGridSize - 1; x++)
+    {
+        for(int y = 0; y < kGridSize - 1; y++)
+        {
+            int cell = x * (kGridSize - 1) + y;
+
+            cellRoads_[cell] = static_cast<uint8_t>(
+                (getRoad(x, y) ? 0x1 : 0) |
+                (getRoad(x + 1, y) ? 0x2 : 0) |
+                (getRoad(x, y + 1) ? 0x4 : 0) |
+                (getRoad(x + 1, y + 1) ? 0x8 : 0));
+
+            for(int upper = 0; upper < 2; upper++)
+            {
+                Plane plane = calcTrianglePlane(*this, x, y, splitNESW_[x][y], upper != 0);
+
+                int triangle = cell * 2 + upper;
+                triangleA_[triangle] = -plane.normal.x / plane.normal.z;
+                triangleB_[triangle] = -plane.normal.y / plane.normal.z;
+                triangleC_[triangle] = -plane.dist / plane.normal.z;
+                normalX_[triangle] = plane.normal.x;
+                normalY_[triangle] = plane.normal.y;
+                normalZ_[triangle] = plane.normal.z;
+            }
+        }
+    }
+}
+
+void Land::initHeightTree()
+{
+    for(int x = 0; x < kGridSize - 1; x++)
+    {
+        for(int y = 0; y < kGridSize - 1; y++)
+        {
+            fp_t minHeight = min(min(heights_[x][y], heights_[x + 1][y]), min(heights_[x][y + 1], heights_[x + 1][y + 1]));
+            fp_t maxHeight = max(max(heights_[x][y], heights_[x + 1][y]), max(heights_[x][y + 1], heights_[x + 1][y + 1]));
+
+            if(!offsetMap_.empty())
+            {
+                // the offset map samples touching this cell
+                int ox0 = x * (kOffsetMapSize - 1) / (kGridSize - 1);
+                int oy0 = y * (kOffsetMapSize - 1) / (kGridSize - 1);
+                int ox1 = ((x + 1) * (kOffsetMapSize - 1) + kGridSize - 2) / (kGridSize - 1);
+                int oy1 = ((y + 1) * (kOffsetMapSize - 1) + kGridSize - 2) / (kGridSize - 1);
+
+                uint16_t minOffset = 0xFFFF;
+                uint16_t maxOffset = 0;
+
+                for(int ox = ox0; ox <= ox1; ox++)
+                {
+                    for(int oy = oy0; oy <= oy1; oy++)
+                    {
+                        minOffset = min(minOffset, offsetMap_[ox + oy * kOffsetMapSize]);
+                        maxOffset = max(maxOffset, offsetMap_[ox + oy * kOffsetMapSize]);
+                    }
+                }
+
+                // keep the triangles inside, they're what rays hit
+                minHeight += min(offsetMapBase_ + minOffset / fp_t(0xFFFF) * offsetMapScale_, fp_t(0.0));
+                maxHeight += max(offsetMapBase_ + maxOffset / fp_t(0xFFFF) * offsetMapScale_, fp_t(0.0));
+            }
+
+            treeMin_[treeIndex(0, x, y)] = minHeight;
+            treeMax_[treeIndex(0, x, y)] = maxHeight;
+        }
+    }
+
+    for(int level = 1; level < kNumTreeLevels; level++)
+    {
+        int size = (kGridSize - 1) >> level;
+
+        for(int x = 0; x < size; x++)
+        {
+            for(int y = 0; y < size; y++)
+            {
+                fp_t minHeight = numeric_limits<fp_t>::max();
+                fp_t maxHeight = -numeric_limits<fp_t>::max();
+
+                for(int child = 0; child < 4; child++)
+                {
+                    int childIndex = treeIndex(level - 1, x * 2 + (child & 1), y * 2 + (child >> 1));
+                    minHeight = min(minHeight, treeMin_[childIndex]);
+                    maxHeight = max(maxHeight, treeMax_[childIndex]);
+                }
+
+                treeMin_[treeIndex(level, x, y)] = minHeight;
+                treeMax_[treeIndex(level, x, y)] = maxHeight;
+            }
+        }
+    }
+}
+
+bool Land::castRayNode(int level, int nx, int ny, const glm::vec3& origin, const glm::vec3& direction, fp_t tMin, fp_t tMax, fp_t& t) const
+{
+    fp_t size = kCellSize * static_cast<fp_t>(1 << level);
+
+    if(!clipRay(origin, direction, nx * size, ny * size, size, tMin, tMax))
+    {
+        return false;
+    }
+
+    // skip the node if the ray stays above or below it the whole way
+    int node = treeIndex(level, nx, ny);
+    fp_t z0 = origin.z + direction.z * tMin;
+    fp_t z1 = origin.z + direction.z * tMax;
+
+    if(min(z0, z1) > treeMax_[node] || max(z0, z1) < treeMin_[node])
+    {
+        return false;
+    }
+
+    if(level == 0)
+    {
+        return castRayCell(nx, ny, origin, direction, tMin, tMax, t);
+    }
+
+    // visit the children in the order the ray crosses them, so the first hit is the nearest
+    // a ray crosses at most three, and never both of the two in the middle of this order
+    int ax = direction.x < 0.0 ? 1 : 0;
+    int ay = direction.y < 0.0 ? 1 : 0;
+
+    int order[4][2] =
+    {
+        { ax, ay },
+        { 1 - ax, ay },
+        { ax, 1 - ay },
+        { 1 - ax, 1 - ay }
+    };
+
+    for(int i = 0; i < 4; i++)
+    {
+        if(castRayNode(level - 1, nx * 2 + order[i][0], ny * 2 + order[i][1], origin, direction, tMin, tMax, t))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Land::castRayCell(int ix, int iy, const glm::vec3& origin, const glm::vec3& direction, fp_t tMin, fp_t tMax, fp_t& t) const
+{
+    int cell = ix * (kGridSize - 1) + iy;
+    bool hit = false;
+
+    for(int upper = 0; upper < 2; upper++)
+    {
+        int triangle = cell * 2 + upper;
+        glm::vec3 normal(normalX_[triangle], normalY_[triangle], normalZ_[triangle]);
+        fp_t dist = -triangleC_[triangle] * normalZ_[triangle];
+
+        fp_t denom = glm::dot(normal, direction);
+
+        if(denom == 0.0)
+        {
+            continue;
+        }
+
+        fp_t th = -(glm::dot(normal, origin) + dist) / denom;
+
+        if(th < tMin || th > tMax || (hit && th >= t))
+        {
+            continue;
+        }
+
+        // the plane is hit within the cell, make sure it's on this triangle's half
+        fp_t fx = (origin.x + direction.x * th) / kCellSize - static_cast<fp_t>(ix);
+        fp_t fy = (origin.y + direction.y * th) / kCellSize - static_cast<fp_t>(iy);
+
+        if(isUpperTriangle(splitNESW_[ix][iy], fx, fy) != (upper != 0))
+        {
+            continue;
+        }
+
+        t = th;
+        hit = true;
+    }
+
+    return hit;
+}
+
 void Land::initStaticObjects()
 {
     // AC: CLandBlockInfo
@@ -403,8 +789,19 @@ void Land::initStaticObjects()
 
 void Land::initScenes()
 {
+    SceneryCache& sceneryCache = Core::get().sceneryCache();
+
+    if(sceneryCache.load(id(), staticObjects_))
+    {
+        return;
+    }
+
+    size_t firstScenery = staticObjects_.size();
+
     const Region& region = Core::get().region();
 
+    ScenePlacement placement;
+
     for(int x = 0; x < kGridSize; x++)
     {
         for(int y = 0; y < kGridSize; y++)
@@ -436,19 +833,60 @@ void Land::initScenes()
 
             const Scene& scene = sceneType.scenes[sceneNum]->cast<Scene>();
 
-            initScene(x, y, scene);
+            initScene(x, y, scene, placement);
         }
     }
+
+    sceneryCache.save(id(), staticObjects_.data() + firstScenery, staticObjects_.size() - firstScenery);
 }
 
-void Land::initScene(int x, int y, const Scene& scene)
+void Land::initScene(int x, int y, const Scene& scene, ScenePlacement& placement)
 {
     uint32_t cellX = id().x() * 8 + x;
     uint32_t cellY = id().y() * 8 + y;
+    uint32_t numObjects = static_cast<uint32_t>(scene.objects.size());
+
+    // generate the random values for every object at once, most objects are rejected by the first
+    placement.random.resize(numObjects * 3);
+    double* freq = placement.random.data();
+    double* dispX = freq + numObjects;
+    double* dispY = dispX + numObjects;
+
+    prngSeries(cellX, cellY, RND_SCENE_FREQ, numObjects, freq);
+    prngSeries(cellX, cellY, RND_SCENE_DISP_X, numObjects, dispX);
+    prngSeries(cellX, cellY, RND_SCENE_DISP_Y, numObjects, dispY);
 
+    // the scene rotation as a matrix, cellPos = rot * tempPos
     double sceneRot = prng(cellX, cellY, RND_SCENE_ROT);
+    fp_t rot[2][2];
 
-    for(uint32_t i = 0; i < scene.objects.size(); i++)
+    if(sceneRot >= 0.75)
+    {
+        rot[0][0] = 0.0; rot[0][1] = 1.0;
+        rot[1][0] = -1.0; rot[1][1] = 0.0;
+    }
+    else if(sceneRot >= 0.5)
+    {
+        rot[0][0] = -1.0; rot[0][1] = 0.0;
+        rot[1][0] = 0.0; rot[1][1] = -1.0;
+    }
+    else if(sceneRot >= 0.25)
+    {
+        rot[0][0] = 0.0; rot[0][1] = -1.0;
+        rot[1][0] = 1.0; rot[1][1] = 0.0;
+    }
+    else
+    {
+        rot[0][0] = 0.0; rot[0][1] = 1.0;
+        rot[1][0] = 1.0; rot[1][1] = 0.0;
+    }
+
+    placement.candidates.clear();
+    placement.positions.clear();
+    placement.x.clear();
+    placement.y.clear();
+
+    for(uint32_t i = 0; i < numObjects; i++)
     {
         const Scene::ObjectDesc& objectDesc = scene.objects[i];
 
@@ -459,68 +897,80 @@ void Land::initScene(int x, int y, const Scene& scene)
             continue;
         }
 
-        if(prng(cellX, cellY, RND_SCENE_FREQ + i) >= objectDesc.frequency)
+        if(freq[i] >= objectDesc.frequency)
         {
             // object hidden
             continue;
         }
 
         // calculate position within block
-        glm::vec3 cellPos = objectDesc.position;
-        
+        glm::vec3 tempPos = objectDesc.position;
+
         if(objectDesc.displace.x > 0.0)
         {
-            cellPos.x += static_cast<fp_t>(prng(cellX, cellY, RND_SCENE_DISP_X + i) * objectDesc.displace.x);
+            tempPos.x += static_cast<fp_t>(dispX[i] * objectDesc.displace.x);
         }
 
         if(objectDesc.displace.y > 0.0)
         {
-            cellPos.y += static_cast<fp_t>(prng(cellX, cellY, RND_SCENE_DISP_Y + i) * objectDesc.displace.y);
-        }
-
-        glm::vec3 tempPos = cellPos;
-
-        if(sceneRot >= 0.75)
-        {
-            cellPos.x = tempPos.y;
-            cellPos.y = -tempPos.x;
-        }
-        else if(sceneRot >= 0.5)
-        {
-            cellPos.x = -tempPos.x;
-            cellPos.y = -tempPos.y;
-        }
-        else if(sceneRot >= 0.25)
-        {
-            cellPos.x = -tempPos.y;
-            cellPos.y = tempPos.x;
-        }
-        else
-        {
-            cellPos.x = tempPos.y;
-            cellPos.y = tempPos.x;
+            tempPos.y += static_cast<fp_t>(dispY[i] * objectDesc.displace.y);
         }
 
-        glm::vec3 blockPos = cellPos + glm::vec3(x * kCellSize, y * kCellSize, 0.0);
+        glm::vec3 blockPos(
+            rot[0][0] * tempPos.x + rot[0][1] * tempPos.y + x * kCellSize,
+            rot[1][0] * tempPos.x + rot[1][1] * tempPos.y + y * kCellSize,
+            tempPos.z);
 
         if(blockPos.x < 0.0 || blockPos.x >= kBlockSize || blockPos.y < 0.0 || blockPos.y >= kBlockSize)
         {
             continue;
         }
 
-        if(roadAtPoint(blockPos.x, blockPos.y))
+        placement.candidates.push_back(i);
+        placement.positions.push_back(blockPos);
+        placement.x.push_back(blockPos.x);
+        placement.y.push_back(blockPos.y);
+    }
+
+    size_t numCandidates = placement.candidates.size();
+
+    if(numCandidates == 0)
+    {
+        return;
+    }
+
+    placement.height.resize(numCandidates);
+    placement.normalZ.resize(numCandidates);
+    placement.road.resize(numCandidates);
+
+    TerrainQuery query;
+    query.count = numCandidates;
+    query.x = placement.x.data();
+    query.y = placement.y.data();
+    query.height = placement.height.data();
+    query.normalZ = placement.normalZ.data();
+    query.road = placement.road.data();
+    queryTerrain(query);
+
+    ResourceCache& resourceCache = Core::get().resourceCache();
+
+    for(size_t c = 0; c < numCandidates; c++)
+    {
+        uint32_t i = placement.candidates[c];
+        const Scene::ObjectDesc& objectDesc = scene.objects[i];
+
+        if(placement.road[c])
         {
             continue;
         }
 
-        Plane landPlane = calcPlane(blockPos.x, blockPos.y);
-
-        if(landPlane.normal.z < objectDesc.minSlope || landPlane.normal.z > objectDesc.maxSlope)
+        if(placement.normalZ[c] < objectDesc.minSlope || placement.normalZ[c] > objectDesc.maxSlope)
         {
             continue;
         }
 
-        blockPos.z += landPlane.calcZ(blockPos.x, blockPos.y);
+        glm::vec3 blockPos = placement.positions[c];
+        blockPos.z += placement.height[c];
 
         // calculate scale
         fp_t scale = static_cast<fp_t>(objectDesc.minScale * pow(objectDesc.maxScale / objectDesc.minScale, prng(cellX, cellY, RND_SCENE_SCALE1 + i)));
@@ -529,14 +979,17 @@ void Land::initScene(int x, int y, const Scene& scene)
         fp_t randRot = static_cast<fp_t>(prng(cellX, cellY, RND_SCENE_OBJROT + i)) * glm::radians(objectDesc.maxRotation);
         glm::quat rotation = glm::angleAxis(randRot, glm::vec3(0.0, 0.0, 1.0)) * objectDesc.rotation;
 
-        glm::mat4 translateMat = glm::translate(glm::mat4{}, blockPos);
-        glm::mat4 rotateMat = glm::mat4_cast(rotation);
-        glm::mat4 scaleMat = glm::scale(glm::mat4{}, glm::vec3{scale, scale, scale});
+        // translate * rotate * scale, built directly
+        glm::mat4 transform = glm::mat4_cast(rotation);
+        transform[0] *= scale;
+        transform[1] *= scale;
+        transform[2] *= scale;
+        transform[3] = glm::vec4(blockPos, 1.0);
 
         // add static object
         StaticObject staticObject;
-        staticObject.resource = Core::get().resourceCache().get(objectDesc.resourceId);
-        staticObject.transform = translateMat * rotateMat * scaleMat;
+        staticObject.resource = resourceCache.get(objectDesc.resourceId);
+        staticObject.transform = transform;
         staticObjects_.push_back(staticObject);
     }
 }
@@ -546,8 +999,6 @@ bool Land::roadAtPoint(fp_t x, fp_t y) const
     assert(x >= 0.0 && x < kBlockSize);
     assert(y >= 0.0 && y < kBlockSize);
 
-    const fp_t kRoadHalfWidth = fp_t(5.0);
-
     fp_t dix;
     fp_t fx = modf(x / kCellSize, &dix);
     int ix = static_cast<int>(dix);
@@ -556,69 +1007,222 @@ bool Land::roadAtPoint(fp_t x, fp_t y) const
     fp_t fy = modf(y / kCellSize, &diy);
     int iy = static_cast<int>(diy);
 
-    int r1 = getRoad(ix, iy);
-    int r2 = getRoad(ix + 1, iy);
-    int r3 = getRoad(ix, iy + 1);
-    int r4 = getRoad(ix + 1, iy + 1);
+    return isRoad(cellRoads_[ix * (kGridSize - 1) + iy], fx, fy);
+}
 
-    if(r1 && r2 && r3 && r4)
-    {
-        return true;
-    }
+bool Land::castRay(const glm::vec3& origin, const glm::vec3& direction, fp_t tMin, fp_t tMax, fp_t& t) const
+{
+    return castRayNode(kNumTreeLevels - 1, 0, 0, origin, direction, tMin, tMax, t);
+}
+
+void Land::queryTerrain(const TerrainQuery& query) const
+{
+    // work in chunks small enough for the stack
+    // With SSE2, finding the triangles and evaluating their planes is done four points at a time,
+    // only the loads from the per-triangle tables are scalar, SSE2 has no gathers
+    static const size_t kChunkSize = 256;
+
+    int triangles[kChunkSize];
+    fp_t fxs[kChunkSize];
+    fp_t fys[kChunkSize];
 
-    if(r1)
+    for(size_t begin = 0; begin < query.count; begin += kChunkSize)
     {
-        if(r2 && fy < kRoadHalfWidth)
+        size_t count = min(kChunkSize, query.count - begin);
+        const fp_t* x = query.x + begin;
+        const fp_t* y = query.y + begin;
+        size_t i = 0;
+
+#ifdef BZR_LAND_SSE
+        static_assert(sizeof(fp_t) == sizeof(float), "The SSE path needs fp_t to be float");
+        static_assert(kGridSize - 1 == 8, "The SSE path shifts by the cells per row");
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 cellSize = _mm_set1_ps(kCellSize);
+        const __m128 maxCell = _mm_set1_ps(static_cast<float>(kGridSize - 2));
+
+        for(; i + 4 <= count; i += 4)
         {
-            return true;
+            __m128 cx = _mm_div_ps(_mm_loadu_ps(x + i), cellSize);
+            __m128 cy = _mm_div_ps(_mm_loadu_ps(y + i), cellSize);
+
+            // truncating after clamping is the same as clamping after flooring
+            __m128i ix = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(cx, zero), maxCell));
+            __m128i iy = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(cy, zero), maxCell));
+            __m128 fx = _mm_sub_ps(cx, _mm_cvtepi32_ps(ix));
+            __m128 fy = _mm_sub_ps(cy, _mm_cvtepi32_ps(iy));
+
+            __m128i cell = _mm_add_epi32(_mm_slli_epi32(ix, 3), iy);
+
+            int cells[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cells), cell);
+
+            __m128 splitNESW = _mm_castsi128_ps(_mm_set_epi32(
+                -static_cast<int>(splitNESW_[cells[3] >> 3][cells[3] & 7]),
+                -static_cast<int>(splitNESW_[cells[2] >> 3][cells[2] & 7]),
+                -static_cast<int>(splitNESW_[cells[1] >> 3][cells[1] & 7]),
+                -static_cast<int>(splitNESW_[cells[0] >> 3][cells[0] & 7])));
+
+            __m128 upper = _mm_or_ps(
+                _mm_and_ps(splitNESW, _mm_cmpgt_ps(fy, _mm_sub_ps(one, fx))),
+                _mm_andnot_ps(splitNESW, _mm_cmpgt_ps(fy, fx)));
+
+            __m128i triangle = _mm_add_epi32(_mm_slli_epi32(cell, 1), _mm_srli_epi32(_mm_castps_si128(upper), 31));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(triangles + i), triangle);
+            _mm_storeu_ps(fxs + i, fx);
+            _mm_storeu_ps(fys + i, fy);
         }
+#endif
 
-        if(r3 && fx < kRoadHalfWidth)
+        for(; i < count; i++)
         {
-            return true;
+            fp_t cx = x[i] / kCellSize;
+            fp_t cy = y[i] / kCellSize;
+            int ix = min(max(static_cast<int>(floor(cx)), 0), kGridSize - 2);
+            int iy = min(max(static_cast<int>(floor(cy)), 0), kGridSize - 2);
+            fp_t fx = cx - static_cast<fp_t>(ix);
+            fp_t fy = cy - static_cast<fp_t>(iy);
+
+            int cell = ix * (kGridSize - 1) + iy;
+            bool splitNESW = splitNESW_[ix][iy];
+            bool upper = (splitNESW & (fy > fp_t(1.0) - fx)) | (!splitNESW & (fy > fx));
+
+            triangles[i] = cell * 2 + upper;
+            fxs[i] = fx;
+            fys[i] = fy;
         }
 
-        if(fx < kRoadHalfWidth && fy < kRoadHalfWidth)
+        if(query.height != nullptr)
         {
-            return true;
+            fp_t* height = query.height + begin;
+            size_t j = 0;
+
+#ifdef BZR_LAND_SSE
+            for(; j + 4 <= count; j += 4)
+            {
+                const int* t = triangles + j;
+                __m128 a = _mm_set_ps(triangleA_[t[3]], triangleA_[t[2]], triangleA_[t[1]], triangleA_[t[0]]);
+                __m128 b = _mm_set_ps(triangleB_[t[3]], triangleB_[t[2]], triangleB_[t[1]], triangleB_[t[0]]);
+                __m128 c = _mm_set_ps(triangleC_[t[3]], triangleC_[t[2]], triangleC_[t[1]], triangleC_[t[0]]);
+
+                __m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + j)), _mm_mul_ps(b, _mm_loadu_ps(y + j))), c);
+                _mm_storeu_ps(height + j, h);
+            }
+#endif
+
+            for(; j < count; j++)
+            {
+                int t = triangles[j];
+                height[j] = triangleA_[t] * x[j] + triangleB_[t] * y[j] + triangleC_[t];
+            }
         }
-    }
 
-    if(r2)
-    {
-        if(r4 && fx > kCellSize - kRoadHalfWidth)
+        if(query.normalX != nullptr)
         {
-            return true;
+            fp_t* normalX = query.normalX + begin;
+
+            for(size_t j = 0; j < count; j++)
+            {
+                normalX[j] = normalX_[triangles[j]];
+            }
         }
 
-        if(fx > kCellSize - kRoadHalfWidth && fy < kRoadHalfWidth)
+        if(query.normalY != nullptr)
         {
-            return true;
+            fp_t* normalY = query.normalY + begin;
+
+            for(size_t j = 0; j < count; j++)
+            {
+                normalY[j] = normalY_[triangles[j]];
+            }
         }
-    }
 
-    if(r3)
-    {
-        if(r4 && fy > kCellSize - kRoadHalfWidth)
+        if(query.normalZ != nullptr)
         {
-            return true;
+            fp_t* normalZ = query.normalZ + begin;
+
+            for(size_t j = 0; j < count; j++)
+            {
+                normalZ[j] = normalZ_[triangles[j]];
+            }
         }
 
-        if(fx < kRoadHalfWidth && fy > kCellSize - kRoadHalfWidth)
+        if(query.road != nullptr)
         {
-            return true;
+            uint8_t* road = query.road + begin;
+
+            for(size_t j = 0; j < count; j++)
+            {
+                road[j] = isRoad(cellRoads_[triangles[j] / 2], fxs[j], fys[j]);
+            }
+        }
+
+        if(query.found != nullptr)
+        {
+            memset(query.found + begin, 1, count);
         }
     }
+}
+
+bool castRayAcrossLands(LandFinder& finder, LandcellId origin, const glm::vec3& start, const glm::vec3& direction, fp_t maxDist, fp_t& dist)
+{
+    // walk the landblocks under the ray in order
+    int bx = static_cast<int>(floor(start.x / Land::kBlockSize));
+    int by = static_cast<int>(floor(start.y / Land::kBlockSize));
 
-    if(r4)
+    int stepX = direction.x < 0.0 ? -1 : 1;
+    int stepY = direction.y < 0.0 ? -1 : 1;
+
+    fp_t infinity = numeric_limits<fp_t>::infinity();
+    fp_t nextX = direction.x == 0.0 ? infinity : (static_cast<fp_t>(bx + (stepX > 0 ? 1 : 0)) * Land::kBlockSize - start.x) / direction.x;
+    fp_t nextY = direction.y == 0.0 ? infinity : (static_cast<fp_t>(by + (stepY > 0 ? 1 : 0)) * Land::kBlockSize - start.y) / direction.y;
+    fp_t deltaX = direction.x == 0.0 ? infinity : Land::kBlockSize / fabs(direction.x);
+    fp_t deltaY = direction.y == 0.0 ? infinity : Land::kBlockSize / fabs(direction.y);
+
+    fp_t t = 0.0;
+
+    while(t <= maxDist)
     {
-        if(fx > kCellSize - kRoadHalfWidth && fy > kCellSize - kRoadHalfWidth)
+        fp_t tNext = min(min(nextX, nextY), maxDist);
+
+        int x = origin.x() + bx;
+        int y = origin.y() + by;
+
+        if(x >= 0 && x <= 0xFF && y >= 0 && y <= 0xFF)
         {
-            return true;
+            const Land* land = finder.findLand(LandcellId(x, y));
+
+            if(land != nullptr)
+            {
+                glm::vec3 blockStart = start - glm::vec3(bx * Land::kBlockSize, by * Land::kBlockSize, 0.0);
+
+                if(land->castRay(blockStart, direction, t, tNext, dist))
+                {
+                    return true;
+                }
+            }
         }
-    }
 
-    // TODO diagonals?
+        if(tNext >= maxDist)
+        {
+            break;
+        }
+
+        if(nextX < nextY)
+        {
+            bx += stepX;
+            t = nextX;
+            nextX += deltaX;
+        }
+        else
+        {
+            by += stepY;
+            t = nextY;
+            nextY += deltaY;
+        }
+    }
 
     return false;
 }
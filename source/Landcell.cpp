@@ -20,6 +20,18 @@
 Landcell::~Landcell()
 {}
 
+size_t Landcell::calcSize() const
+{
+    size_t size = staticObjects_.capacity() * sizeof(StaticObject);
+
+    if(renderData_)
+    {
+        size += renderData_->calcSize();
+    }
+
+    return size;
+}
+
 const vector<StaticObject>& Landcell::staticObjects() const
 {
     return staticObjects_;
@@ -16,25 +16,164 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "LandcellManager.h"
+#include "Camera.h"
 #include "Config.h"
 #include "Core.h"
 #include "DatFile.h"
-#include "Land.h"
 #include "Log.h"
-#include "Structure.h"
+#include "ResourceCache.h"
+#include "WorldFile.h"
 #include <algorithm>
 
-LandcellManager::LandcellManager()
+// we parse more landblocks than we initialize so the ones that
+// get initialized have all their neighbors
+static const int kParseMargin = 2;
+
+// weight of the newest sample in the smoothed camera velocity
+static const fp_t kVelocitySmoothing = fp_t(0.1);
+
+// anything faster than this is a teleport, not motion
+static const fp_t kMaxSpeed = fp_t(1000.0);
+
+struct CompareByDistance
+{
+    CompareByDistance(LandcellId center) : center_(center)
+    {}
+
+    template<class T>
+    bool operator()(const T& a, const T& b) const
+    {
+        return center_.calcSquareDistance(a->id) < center_.calcSquareDistance(b->id);
+    }
+
+    LandcellId center_;
+};
+
+struct CompareSlotsByDistance
+{
+    CompareSlotsByDistance(LandcellId center) : center_(center)
+    {}
+
+    bool operator()(const LandcellManager::Slot* a, const LandcellManager::Slot* b) const
+    {
+        return center_.calcSquareDistance(a->id) < center_.calcSquareDistance(b->id);
+    }
+
+    LandcellId center_;
+};
+
+struct CompareByKey
+{
+    CompareByKey(const vector<int>& keys) : keys_(keys)
+    {}
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        return keys_[a] < keys_[b];
+    }
+
+    const vector<int>& keys_;
+};
+
+LandcellManager::LandcellManager() :
+    orderDirty_(false),
+    cacheSize_(0),
+    hasLastPosition_(false),
+    numEdgeReady_(0),
+    numEdgeMissing_(0),
+    numPrefetchHits_(0),
+    numPrefetchWasted_(0),
+    numCacheHits_(0),
+    done_(false)
 {
-    radius_ = Core::get().config().getInt("LandcellManager.radius", 5);
+    Config& config = Core::get().config();
+
+    radius_ = config.getInt("LandcellManager.radius", 5);
+    unloadRadius_ = config.getInt("LandcellManager.unloadRadius", radius_ + kParseMargin);
+
+    if(unloadRadius_ < radius_ + kParseMargin)
+    {
+        throw runtime_error("Bad value for LandcellManager.unloadRadius");
+    }
+
+    // resident landblocks are within the unload radius of either the center or the
+    // predicted center, which is at most one block further than the radius away
+    slotsWidth_ = 2 * unloadRadius_ + radius_ + 2;
+    slots_.resize(slotsWidth_ * slotsWidth_);
+
+    terrainRadius_ = config.getInt("LandcellManager.terrainRadius", radius_ * 4);
+
+    if(terrainRadius_ < radius_)
+    {
+        throw runtime_error("Bad value for LandcellManager.terrainRadius");
+    }
+
+    cacheBudget_ = static_cast<size_t>(config.getInt("LandcellManager.cacheSize", 64)) * 1024 * 1024;
+    prefetchTime_ = config.getFloat("LandcellManager.prefetchTime", 2.0);
+
+    string worldFilePath = config.getString("LandcellManager.worldFile", "");
+
+    if(!worldFilePath.empty())
+    {
+        worldFile_.reset(new WorldFile{worldFilePath});
+    }
+
+    int defaultNumThreads = max(static_cast<int>(thread::hardware_concurrency()) - 1, 1);
+    int numThreads = config.getInt("LandcellManager.numThreads", defaultNumThreads);
+
+    if(numThreads < 1)
+    {
+        throw runtime_error("Bad value for LandcellManager.numThreads");
+    }
+
+    for(int i = 0; i < numThreads; i++)
+    {
+        threads_.push_back(thread(bind(&LandcellManager::run, this)));
+    }
+}
+
+LandcellManager::~LandcellManager()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        done_ = true;
+    }
+
+    jobCondition_.notify_all();
+
+    for(thread& t : threads_)
+    {
+        t.join();
+    }
 }
 
 void LandcellManager::setCenter(LandcellId c)
 {
     if(c != center_)
     {
-        LOG(Misc, Info) << "new center=" << c.x() << ", " << c.y() << "\n";
+        LandcellId oldCenter = center_;
         center_ = c;
+
+        if(!hasLastPosition_ || oldCenter.calcSquareDistance(c) > 2)
+        {
+            // first center or a teleport, forget about previous motion
+            hasLastPosition_ = false;
+            velocity_ = glm::vec2{};
+            predictedCenter_ = c;
+        }
+        else
+        {
+            updateStats(oldCenter);
+        }
+
+        LOG(Misc, Info) << "new center=" << c.x() << ", " << c.y()
+            << " edge ready=" << numEdgeReady_ << "/" << numEdgeReady_ + numEdgeMissing_
+            << " prefetch hits=" << numPrefetchHits_
+            << " wasted=" << numPrefetchWasted_
+            << " cache hits=" << numCacheHits_
+            << " cache size=" << cacheSize_ / 1024 << "KiB\n";
+
+        orderDirty_ = true;
         load();
     }
 }
@@ -44,97 +183,900 @@ LandcellId LandcellManager::center() const
     return center_;
 }
 
-LandcellManager::iterator LandcellManager::find(LandcellId id)
+int LandcellManager::radius() const
 {
-    return data_.find(id);
+    return radius_;
 }
 
-LandcellManager::iterator LandcellManager::begin()
+int LandcellManager::terrainRadius() const
 {
-    return data_.begin();
+    return terrainRadius_;
 }
 
-LandcellManager::iterator LandcellManager::end()
+void LandcellManager::step(fp_t dt)
 {
-    return data_.end();
+    predict(dt);
+
+    vector<unique_ptr<Job>> finishedJobs;
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        finishedJobs.swap(finishedJobs_);
+    }
+
+    if(!finishedJobs.empty())
+    {
+        for(unique_ptr<Job>& job : finishedJobs)
+        {
+            commit(move(job));
+        }
+
+        evict();
+        schedule();
+    }
+
+    sortSlots();
 }
 
-void LandcellManager::load()
+LandcellManager::Slot* LandcellManager::findSlot(LandcellId id)
+{
+    if(id.x() < 0x00 || id.x() > 0xFF || id.y() < 0x00 || id.y() > 0xFF)
+    {
+        return nullptr;
+    }
+
+    Slot& slot = slotAt(id);
+
+    if(!slot.land || slot.id.x() != id.x() || slot.id.y() != id.y())
+    {
+        return nullptr;
+    }
+
+    return &slot;
+}
+
+Landcell* LandcellManager::find(LandcellId id)
+{
+    Slot* slot = findSlot(id);
+
+    if(slot == nullptr)
+    {
+        return nullptr;
+    }
+
+    if(!id.isStructure())
+    {
+        return slot->land.get();
+    }
+
+    size_t index = id.n() - 0x0100;
+
+    if(index >= slot->structures.size())
+    {
+        return nullptr;
+    }
+
+    return slot->structures[index].get();
+}
+
+const Land* LandcellManager::findTerrain(LandcellId id)
+{
+    const Land* land = findLand(id);
+
+    if(land != nullptr)
+    {
+        return land;
+    }
+
+    auto terrainIt = terrain_.find(id);
+
+    if(terrainIt != terrain_.end())
+    {
+        return terrainIt->second.get();
+    }
+
+    auto cacheIt = cacheIndex_.find(id);
+
+    if(cacheIt != cacheIndex_.end())
+    {
+        return cacheIt->second->land.get();
+    }
+
+    return nullptr;
+}
+
+void LandcellManager::queryTerrain(LandcellId origin, const TerrainQuery& query)
 {
-    // we grab more landblocks than we need so the ones that actually
-    // get initialized have all their neighbors
-    int sloppyRadius = radius_ + 2;
+    // group the points by landblock, then answer each group with one batch
+    vector<int> keys(query.count);
+    vector<uint32_t> order(query.count);
 
-    for(int x = max(center_.x() - sloppyRadius, 0); x <= min(center_.x() + sloppyRadius, 0xFF); x++)
+    for(size_t i = 0; i < query.count; i++)
     {
-        for(int y = max(center_.y() - sloppyRadius, 0); y <= min(center_.y() + sloppyRadius, 0xFF); y++)
+        int x = origin.x() + static_cast<int>(floor(query.x[i] / Land::kBlockSize));
+        int y = origin.y() + static_cast<int>(floor(query.y[i] / Land::kBlockSize));
+
+        if(x >= 0 && x <= 0xFF && y >= 0 && y <= 0xFF)
         {
-            LandcellId landId(x, y);
+            keys[i] = x * 256 + y;
+        }
+        else
+        {
+            keys[i] = -1;
+        }
+
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    sort(order.begin(), order.end(), CompareByKey(keys));
+
+    vector<fp_t> x(query.count);
+    vector<fp_t> y(query.count);
+    vector<fp_t> height(query.height != nullptr ? query.count : 0);
+    vector<fp_t> normalX(query.normalX != nullptr ? query.count : 0);
+    vector<fp_t> normalY(query.normalY != nullptr ? query.count : 0);
+    vector<fp_t> normalZ(query.normalZ != nullptr ? query.count : 0);
+    vector<uint8_t> road(query.road != nullptr ? query.count : 0);
+
+    for(size_t begin = 0; begin < query.count; )
+    {
+        int key = keys[order[begin]];
+        size_t end = begin + 1;
+
+        while(end < query.count && keys[order[end]] == key)
+        {
+            end++;
+        }
 
-            if(center_.calcSquareDistance(landId) > sloppyRadius * sloppyRadius)
+        const Land* land = nullptr;
+
+        if(key >= 0)
+        {
+            land = findTerrain(LandcellId(key / 256, key % 256));
+        }
+
+        size_t count = end - begin;
+
+        if(land != nullptr)
+        {
+            fp_t offsetX = static_cast<fp_t>(key / 256 - origin.x()) * Land::kBlockSize;
+            fp_t offsetY = static_cast<fp_t>(key % 256 - origin.y()) * Land::kBlockSize;
+
+            for(size_t j = 0; j < count; j++)
             {
-                continue;
+                x[j] = query.x[order[begin + j]] - offsetX;
+                y[j] = query.y[order[begin + j]] - offsetY;
             }
 
-            if(data_.find(landId) != data_.end())
+            TerrainQuery landQuery;
+            landQuery.count = count;
+            landQuery.x = x.data();
+            landQuery.y = y.data();
+            landQuery.height = height.empty() ? nullptr : height.data();
+            landQuery.normalX = normalX.empty() ? nullptr : normalX.data();
+            landQuery.normalY = normalY.empty() ? nullptr : normalY.data();
+            landQuery.normalZ = normalZ.empty() ? nullptr : normalZ.data();
+            landQuery.road = road.empty() ? nullptr : road.data();
+            land->queryTerrain(landQuery);
+        }
+        else
+        {
+            fill(height.begin(), height.begin() + (height.empty() ? 0 : count), fp_t(0.0));
+            fill(normalX.begin(), normalX.begin() + (normalX.empty() ? 0 : count), fp_t(0.0));
+            fill(normalY.begin(), normalY.begin() + (normalY.empty() ? 0 : count), fp_t(0.0));
+            fill(normalZ.begin(), normalZ.begin() + (normalZ.empty() ? 0 : count), fp_t(1.0));
+            fill(road.begin(), road.begin() + (road.empty() ? 0 : count), uint8_t(0));
+        }
+
+        for(size_t j = 0; j < count; j++)
+        {
+            uint32_t i = order[begin + j];
+
+            if(query.height != nullptr)
             {
-                continue;
+                query.height[i] = height[j];
             }
 
-            vector<uint8_t> data = Core::get().cellDat().read(landId.value());
+            if(query.normalX != nullptr)
+            {
+                query.normalX[i] = normalX[j];
+            }
 
-            if(data.empty())
+            if(query.normalY != nullptr)
             {
-                continue;
+                query.normalY[i] = normalY[j];
+            }
+
+            if(query.normalZ != nullptr)
+            {
+                query.normalZ[i] = normalZ[j];
+            }
+
+            if(query.road != nullptr)
+            {
+                query.road[i] = road[j];
             }
 
-            data_[landId].reset(new Land(data.data(), data.size()));
+            if(query.found != nullptr)
+            {
+                query.found[i] = land != nullptr;
+            }
         }
+
+        begin = end;
     }
+}
 
-    for(auto it = data_.begin(); it != data_.end(); ++it)
+bool LandcellManager::castRay(LandcellId origin, const glm::vec3& start, const glm::vec3& direction, fp_t maxDist, fp_t& dist)
+{
+    RayLandFinder finder(*this);
+    return castRayAcrossLands(finder, origin, start, direction, maxDist, dist);
+}
+
+const Land* LandcellManager::RayLandFinder::findLand(LandcellId id)
+{
+    Slot* slot = manager_.findSlot(id);
+
+    if(slot != nullptr)
+    {
+        return slot->land.get();
+    }
+
+    auto terrainIt = manager_.terrain_.find(id);
+
+    if(terrainIt != manager_.terrain_.end())
+    {
+        return terrainIt->second.get();
+    }
+
+    auto cacheIt = manager_.cacheIndex_.find(id);
+
+    if(cacheIt != manager_.cacheIndex_.end())
     {
-        if(center_.calcSquareDistance(it->first) <= radius_ * radius_)
+        return cacheIt->second->land.get();
+    }
+
+    return nullptr;
+}
+
+LandcellManager::iterator LandcellManager::begin() const
+{
+    return order_.begin();
+}
+
+LandcellManager::iterator LandcellManager::end() const
+{
+    return order_.end();
+}
+
+void LandcellManager::load()
+{
+    // cancel jobs that haven't been started and are no longer needed
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        for(auto it = pendingJobs_.begin(); it != pendingJobs_.end(); /**/)
         {
-            if(it->first.isStructure())
+            Job& job = **it;
+
+            if(job.type == JobType::kParse &&
+               !isWithin(job.id, radius_ + kParseMargin) &&
+               center_.calcSquareDistance(job.id) > terrainRadius_ * terrainRadius_)
             {
-                continue;
+                parsing_.erase(job.id);
+                it = pendingJobs_.erase(it);
+            }
+            else if(job.type == JobType::kInit && !isWithin(job.id, radius_))
+            {
+                initializing_.erase(job.id);
+                pin(job, -1);
+                it = pendingJobs_.erase(it);
+            }
+            else
+            {
+                ++it;
             }
+        }
+    }
+
+    evict();
+    schedule();
+    sortSlots();
+}
+
+void LandcellManager::schedule()
+{
+    vector<unique_ptr<Job>> newJobs;
+
+    scheduleParse(center_, newJobs);
+    scheduleParse(predictedCenter_, newJobs);
+    scheduleTerrain(newJobs);
+
+    for(auto& pair : staging_)
+    {
+        if(!isWithin(pair.first, radius_) || initializing_.count(pair.first) != 0)
+        {
+            continue;
+        }
 
-            Land& land = static_cast<Land&>(*it->second);
+        unique_ptr<Job> job(new Job());
+        job->type = JobType::kInit;
+        job->id = pair.first;
+        job->land = pair.second.get();
 
-            land.init();
+        bool neighborsParsed = true;
 
-            for(uint32_t i = 0; i < land.numStructures(); i++)
+        for(int dx = -1; dx <= 1; dx++)
+        {
+            for(int dy = -1; dy <= 1; dy++)
             {
-                LandcellId structId(land.id().x(), land.id().y(), (uint16_t)(0x0100 + i));
+                job->neighbors[dx + 1][dy + 1] = nullptr;
 
-                if(data_.find(structId) != data_.end())
+                int nx = pair.first.x() + dx;
+                int ny = pair.first.y() + dy;
+
+                if(nx < 0x00 || nx > 0xFF || ny < 0x00 || ny > 0xFF)
                 {
                     continue;
                 }
 
-                vector<uint8_t> data = Core::get().cellDat().read(structId.value());
+                LandcellId neighborId(nx, ny);
+                const Land* neighbor = findLand(neighborId);
 
-                if(data.empty())
+                if(neighbor == nullptr && missing_.count(neighborId) == 0)
                 {
-                    throw runtime_error("Structure not found");
+                    neighborsParsed = false;
                 }
 
-                data_[structId].reset(new Structure(data.data(), data.size()));
+                job->neighbors[dx + 1][dy + 1] = neighbor;
+            }
+        }
+
+        if(!neighborsParsed)
+        {
+            continue;
+        }
+
+        initializing_.insert(pair.first);
+        pin(*job, 1);
+        newJobs.push_back(move(job));
+    }
+
+    if(newJobs.empty())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        for(unique_ptr<Job>& job : newJobs)
+        {
+            pendingJobs_.push_back(move(job));
+        }
+
+        // nearest landblocks first
+        stable_sort(pendingJobs_.begin(), pendingJobs_.end(), CompareByDistance(center_));
+    }
+
+    jobCondition_.notify_all();
+}
+
+void LandcellManager::scheduleParse(LandcellId around, vector<unique_ptr<Job>>& newJobs)
+{
+    int parseRadius = radius_ + kParseMargin;
+
+    for(int x = max(around.x() - parseRadius, 0); x <= min(around.x() + parseRadius, 0xFF); x++)
+    {
+        for(int y = max(around.y() - parseRadius, 0); y <= min(around.y() + parseRadius, 0xFF); y++)
+        {
+            LandcellId landId(x, y);
+
+            if(around.calcSquareDistance(landId) > parseRadius * parseRadius)
+            {
+                continue;
+            }
+
+            if(findLand(landId) != nullptr || parsing_.count(landId) != 0 || missing_.count(landId) != 0)
+            {
+                continue;
+            }
+
+            if(restore(landId))
+            {
+                continue;
+            }
+
+            auto terrainIt = terrain_.find(landId);
+
+            if(terrainIt != terrain_.end())
+            {
+                // already parsed for distant terrain
+                staging_[landId] = move(terrainIt->second);
+                terrain_.erase(terrainIt);
+                continue;
+            }
+
+            queueParse(landId, newJobs);
+        }
+    }
+}
+
+void LandcellManager::scheduleTerrain(vector<unique_ptr<Job>>& newJobs)
+{
+    for(int x = max(center_.x() - terrainRadius_, 0); x <= min(center_.x() + terrainRadius_, 0xFF); x++)
+    {
+        for(int y = max(center_.y() - terrainRadius_, 0); y <= min(center_.y() + terrainRadius_, 0xFF); y++)
+        {
+            LandcellId landId(x, y);
+
+            if(center_.calcSquareDistance(landId) > terrainRadius_ * terrainRadius_)
+            {
+                continue;
+            }
+
+            if(findTerrain(landId) != nullptr || parsing_.count(landId) != 0 || missing_.count(landId) != 0)
+            {
+                continue;
             }
+
+            queueParse(landId, newJobs);
+        }
+    }
+}
+
+void LandcellManager::queueParse(LandcellId id, vector<unique_ptr<Job>>& newJobs)
+{
+    unique_ptr<Job> job(new Job());
+    job->type = JobType::kParse;
+    job->id = id;
+    job->land = nullptr;
+    parsing_.insert(id);
+    newJobs.push_back(move(job));
+}
+
+void LandcellManager::evict()
+{
+    int parseRadius = radius_ + kParseMargin;
+
+    for(Slot& slot : slots_)
+    {
+        if(slot.land && !isWithin(slot.id, unloadRadius_))
+        {
+            unload(slot);
         }
     }
 
-    for(auto it = data_.begin(); it != data_.end(); /**/)
+    for(auto it = staging_.begin(); it != staging_.end(); /**/)
     {
-        if(center_.calcSquareDistance(it->first) > radius_ * radius_)
+        if(!isWithin(it->first, parseRadius) && pins_.count(it->first) == 0)
         {
-            it = data_.erase(it);
+            if(center_.calcSquareDistance(it->first) <= terrainRadius_ * terrainRadius_)
+            {
+                terrain_[it->first] = move(it->second);
+            }
+
+            it = staging_.erase(it);
         }
         else
         {
             ++it;
         }
     }
+
+    for(auto it = terrain_.begin(); it != terrain_.end(); /**/)
+    {
+        if(center_.calcSquareDistance(it->first) > terrainRadius_ * terrainRadius_)
+        {
+            it = terrain_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for(auto it = missing_.begin(); it != missing_.end(); /**/)
+    {
+        if(!isWithin(*it, parseRadius) && center_.calcSquareDistance(*it) > terrainRadius_ * terrainRadius_)
+        {
+            it = missing_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void LandcellManager::unload(Slot& slot)
+{
+    if(prefetched_.erase(slot.id) != 0)
+    {
+        numPrefetchWasted_++;
+    }
+
+    CacheEntry entry;
+    entry.id = slot.id;
+    entry.land = move(slot.land);
+    entry.structures = move(slot.structures);
+    slot.structures.clear();
+    orderDirty_ = true;
+
+    if(pins_.count(entry.id) != 0)
+    {
+        // a job is still using it as a neighbor, can't let the cache destroy it
+        staging_[entry.id] = move(entry.land);
+        return;
+    }
+
+    cache(move(entry));
+}
+
+void LandcellManager::commit(unique_ptr<Job> job)
+{
+    if(job->error)
+    {
+        rethrow_exception(job->error);
+    }
+
+    if(job->type == JobType::kParse)
+    {
+        parsing_.erase(job->id);
+
+        bool needed = isWithin(job->id, radius_ + kParseMargin);
+        bool terrainNeeded = center_.calcSquareDistance(job->id) <= terrainRadius_ * terrainRadius_;
+
+        if(!needed && !terrainNeeded)
+        {
+            return;
+        }
+
+        if(!job->parsedLand)
+        {
+            missing_.insert(job->id);
+        }
+        else if(needed)
+        {
+            staging_[job->id] = move(job->parsedLand);
+        }
+        else
+        {
+            terrain_[job->id] = move(job->parsedLand);
+        }
+    }
+    else if(job->type == JobType::kInit)
+    {
+        initializing_.erase(job->id);
+        pin(*job, -1);
+
+        if(!isWithin(job->id, unloadRadius_))
+        {
+            return;
+        }
+
+        auto it = staging_.find(job->id);
+        assert(it != staging_.end() && it->second.get() == job->land);
+
+        Slot& slot = slotAt(job->id);
+
+        if(slot.land)
+        {
+            unload(slot);
+        }
+
+        slot.id = job->id;
+        slot.land = move(it->second);
+        slot.structures = move(job->structures);
+        staging_.erase(it);
+        orderDirty_ = true;
+
+        if(center_.calcSquareDistance(job->id) > radius_ * radius_)
+        {
+            // only wanted because of where we're headed
+            prefetched_.insert(job->id);
+        }
+    }
+}
+
+void LandcellManager::pin(const Job& job, int delta)
+{
+    for(int dx = 0; dx < 3; dx++)
+    {
+        for(int dy = 0; dy < 3; dy++)
+        {
+            const Land* land = job.neighbors[dx][dy];
+
+            if(land == nullptr)
+            {
+                continue;
+            }
+
+            int& count = pins_[land->id()];
+            count += delta;
+
+            if(count == 0)
+            {
+                pins_.erase(land->id());
+            }
+        }
+    }
+}
+
+void LandcellManager::cache(CacheEntry entry)
+{
+    entry.size = entry.land->calcSize();
+
+    for(unique_ptr<Structure>& structure : entry.structures)
+    {
+        entry.size += structure->calcSize();
+    }
+
+    cacheSize_ += entry.size;
+    cache_.push_front(move(entry));
+    cacheIndex_[cache_.front().id] = cache_.begin();
+
+    // drop the least recently evicted landblocks until we're within budget
+    while(cacheSize_ > cacheBudget_)
+    {
+        cacheSize_ -= cache_.back().size;
+        cacheIndex_.erase(cache_.back().id);
+        cache_.pop_back();
+    }
+}
+
+bool LandcellManager::restore(LandcellId id)
+{
+    auto indexIt = cacheIndex_.find(id);
+
+    if(indexIt == cacheIndex_.end())
+    {
+        return false;
+    }
+
+    CacheEntry& entry = *indexIt->second;
+
+    Slot& slot = slotAt(id);
+
+    if(slot.land)
+    {
+        unload(slot);
+    }
+
+    slot.id = id;
+    slot.land = move(entry.land);
+    slot.structures = move(entry.structures);
+    orderDirty_ = true;
+
+    cacheSize_ -= entry.size;
+    cache_.erase(indexIt->second);
+    cacheIndex_.erase(indexIt);
+    numCacheHits_++;
+
+    return true;
+}
+
+Land* LandcellManager::findLand(LandcellId id)
+{
+    Slot* slot = findSlot(id);
+
+    if(slot != nullptr)
+    {
+        return slot->land.get();
+    }
+
+    auto stagingIt = staging_.find(id);
+
+    if(stagingIt != staging_.end())
+    {
+        return stagingIt->second.get();
+    }
+
+    return nullptr;
+}
+
+LandcellManager::Slot& LandcellManager::slotAt(LandcellId id)
+{
+    int sx = id.x() % slotsWidth_;
+    int sy = id.y() % slotsWidth_;
+
+    return slots_[sx * slotsWidth_ + sy];
+}
+
+void LandcellManager::sortSlots()
+{
+    if(!orderDirty_)
+    {
+        return;
+    }
+
+    order_.clear();
+
+    for(Slot& slot : slots_)
+    {
+        if(slot.land)
+        {
+            order_.push_back(&slot);
+        }
+    }
+
+    sort(order_.begin(), order_.end(), CompareSlotsByDistance(center_));
+    orderDirty_ = false;
+}
+
+bool LandcellManager::isWithin(LandcellId id, int radius) const
+{
+    return center_.calcSquareDistance(id) <= radius * radius ||
+        predictedCenter_.calcSquareDistance(id) <= radius * radius;
+}
+
+void LandcellManager::predict(fp_t dt)
+{
+    // camera position relative to the south-west corner of the world
+    const glm::vec3& position = Core::get().camera().position();
+    glm::vec2 worldPosition{
+        center_.x() * Land::kBlockSize + position.x,
+        center_.y() * Land::kBlockSize + position.y};
+
+    if(hasLastPosition_ && dt > fp_t(0.0))
+    {
+        glm::vec2 velocity = (worldPosition - lastPosition_) / dt;
+
+        if(glm::length(velocity) > kMaxSpeed)
+        {
+            velocity_ = glm::vec2{};
+        }
+        else
+        {
+            velocity_ = velocity_ + (velocity - velocity_) * kVelocitySmoothing;
+        }
+    }
+
+    lastPosition_ = worldPosition;
+    hasLastPosition_ = true;
+
+    // look further ahead the faster we go, but never past our own radius
+    glm::vec2 lookahead = velocity_ * prefetchTime_;
+    fp_t maxLookahead = static_cast<fp_t>(radius_) * Land::kBlockSize;
+    fp_t lookaheadLength = glm::length(lookahead);
+
+    if(lookaheadLength > maxLookahead)
+    {
+        lookahead = lookahead * (maxLookahead / lookaheadLength);
+    }
+
+    glm::vec2 predictedPosition = worldPosition + lookahead;
+
+    int px = static_cast<int>(glm::floor(predictedPosition.x / Land::kBlockSize));
+    int py = static_cast<int>(glm::floor(predictedPosition.y / Land::kBlockSize));
+
+    LandcellId predictedCenter(max(0, min(px, 0xFF)), max(0, min(py, 0xFF)));
+
+    if(predictedCenter != predictedCenter_)
+    {
+        predictedCenter_ = predictedCenter;
+        load();
+    }
+}
+
+void LandcellManager::updateStats(LandcellId oldCenter)
+{
+    for(int x = max(center_.x() - radius_, 0); x <= min(center_.x() + radius_, 0xFF); x++)
+    {
+        for(int y = max(center_.y() - radius_, 0); y <= min(center_.y() + radius_, 0xFF); y++)
+        {
+            LandcellId landId(x, y);
+
+            if(center_.calcSquareDistance(landId) > radius_ * radius_ ||
+               oldCenter.calcSquareDistance(landId) <= radius_ * radius_)
+            {
+                continue;
+            }
+
+            if(findSlot(landId) != nullptr)
+            {
+                numEdgeReady_++;
+            }
+            else if(missing_.count(landId) == 0)
+            {
+                numEdgeMissing_++;
+            }
+
+            if(prefetched_.erase(landId) != 0)
+            {
+                numPrefetchHits_++;
+            }
+        }
+    }
+}
+
+void LandcellManager::run()
+{
+    for(;;)
+    {
+        unique_ptr<Job> job;
+
+        {
+            unique_lock<mutex> lock(mutex_);
+
+            while(!done_ && pendingJobs_.empty())
+            {
+                jobCondition_.wait(lock);
+            }
+
+            if(done_)
+            {
+                return;
+            }
+
+            job = move(pendingJobs_.front());
+            pendingJobs_.pop_front();
+        }
+
+        ResourceCache& resourceCache = Core::get().resourceCache();
+        resourceCache.hold(&job->resources);
+
+        try
+        {
+            execute(*job);
+        }
+        catch(...)
+        {
+            // rethrown on the main thread by commit
+            job->error = current_exception();
+        }
+
+        resourceCache.hold(nullptr);
+
+        lock_guard<mutex> lock(mutex_);
+        finishedJobs_.push_back(move(job));
+    }
+}
+
+void LandcellManager::execute(Job& job) const
+{
+    WorldFile::Block block;
+    bool baked = worldFile_ && worldFile_->find(job.id, block);
+
+    if(job.type == JobType::kParse)
+    {
+        if(baked)
+        {
+            job.parsedLand.reset(new Land(block.land, block.landSize));
+            return;
+        }
+
+        vector<uint8_t> data = Core::get().cellDat().read(job.id.value());
+
+        if(!data.empty())
+        {
+            job.parsedLand.reset(new Land(data.data(), data.size()));
+        }
+    }
+    else if(job.type == JobType::kInit)
+    {
+        if(baked)
+        {
+            job.land->initBaked(block.baked, block.bakedSize);
+        }
+        else
+        {
+            job.land->init(job.neighbors);
+        }
+
+        for(uint32_t i = 0; i < job.land->numStructures(); i++)
+        {
+            LandcellId structId(job.id.x(), job.id.y(), static_cast<uint16_t>(0x0100 + i));
+
+            vector<uint8_t> data = Core::get().cellDat().read(structId.value());
+
+            if(data.empty())
+            {
+                throw runtime_error("Structure not found");
+            }
+
+            unique_ptr<Structure> structure(new Structure(data.data(), data.size()));
+            job.structures.push_back(move(structure));
+        }
+    }
 }
@@ -24,3 +24,16 @@ double prng(uint32_t cell_x, uint32_t cell_y, uint32_t seed)
 
     return static_cast<double>(ival) / static_cast<double>(UINT32_MAX);
 }
+
+void prngSeries(uint32_t cell_x, uint32_t cell_y, uint32_t seed, size_t count, double* result)
+{
+    // prng is linear in the seed, so hoist everything else out of the loop
+    uint32_t base = 0x6C1AC587 * cell_y - 0x421BE3BD * cell_x;
+    uint32_t step = 0x5111BFEF * cell_y * cell_x + 0x70892FB7;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uint32_t ival = base - (seed + static_cast<uint32_t>(i)) * step;
+        result[i] = static_cast<double>(ival) / static_cast<double>(UINT32_MAX);
+    }
+}
@@ -17,6 +17,7 @@
  */
 #include "ResourceCache.h"
 #include "resource/Animation.h"
+#include "resource/DegradeInfo.h"
 #include "resource/EnumMapper.h"
 #include "resource/Environment.h"
 #include "resource/ImgColor.h"
@@ -74,6 +75,8 @@ static const Resource* loadResource(uint32_t resourceId)
             return new Sound{resourceId, data.data(), data.size()};
         case ResourceType::kEnvironment:
             return new Environment{resourceId, data.data(), data.size()};
+        case ResourceType::kDegradeInfo:
+            return new DegradeInfo{resourceId, data.data(), data.size()};
         case ResourceType::kScene:
             return new Scene{resourceId, data.data(), data.size()};
         case ResourceType::kRegion:
@@ -95,15 +98,69 @@ static const Resource* loadResource(uint32_t resourceId)
 
 ResourcePtr ResourceCache::get(uint32_t resourceId)
 {
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        ResourcePtr sharedPtr = data_[resourceId].lock();
+
+        if(sharedPtr)
+        {
+            addHeld(sharedPtr);
+            return sharedPtr;
+        }
+    }
+
+    // Load without holding the lock, resources get their dependencies
+    // through us and landblocks are loaded on worker threads
+    ResourcePtr loadedPtr{loadResource(resourceId)};
+
+    lock_guard<mutex> lock(mutex_);
+
     weak_ptr<const Resource>& weakPtr = data_[resourceId];
 
     ResourcePtr sharedPtr = weakPtr.lock();
 
     if(!sharedPtr)
     {
-        sharedPtr.reset(loadResource(resourceId));
+        // we won the race (or there was none)
+        sharedPtr = loadedPtr;
         weakPtr = sharedPtr;
     }
+    else
+    {
+        // we lost, our copy and what it got from us go with whatever we're holding
+        addHeld(loadedPtr);
+    }
 
+    addHeld(sharedPtr);
     return sharedPtr;
 }
+
+void ResourceCache::hold(vector<ResourcePtr>* held)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    if(held != nullptr)
+    {
+        held_[this_thread::get_id()] = held;
+    }
+    else
+    {
+        held_.erase(this_thread::get_id());
+    }
+}
+
+void ResourceCache::addHeld(const ResourcePtr& resource)
+{
+    if(held_.empty())
+    {
+        return;
+    }
+
+    auto it = held_.find(this_thread::get_id());
+
+    if(it != held_.end())
+    {
+        it->second->push_back(resource);
+    }
+}
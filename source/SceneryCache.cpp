@@ -0,0 +1,208 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "SceneryCache.h"
+#include "BinReader.h"
+#include "BinWriter.h"
+#include "Config.h"
+#include "Core.h"
+#include "DatFile.h"
+#include <iterator>
+
+static const uint32_t kMagic = 0x594E4353; // SCNY
+static const uint32_t kFormatVersion = 1;
+static const size_t kHeaderSize = sizeof(uint32_t) * 4;
+static const size_t kRecordHeaderSize = sizeof(uint32_t) * 2;
+
+SceneryCache::SceneryCache() : enabled_(Core::get().config().getBool("SceneryCache.enabled", false))
+{
+    if(!enabled_)
+    {
+        return;
+    }
+
+    char* prefPath = SDL_GetPrefPath("boardwalk", "Bael'Zharon's Revenge");
+    string path = string(prefPath) + "scenery.bin";
+    SDL_free(prefPath);
+
+    if(!read(path))
+    {
+        // stale or damaged, start over with whatever could be salvaged
+        write(path);
+    }
+
+    fs_.open(path.c_str(), ios_base::out|ios_base::binary|ios_base::app);
+
+    if(!fs_.good())
+    {
+        throw runtime_error("Could not open scenery cache");
+    }
+}
+
+bool SceneryCache::load(LandcellId id, vector<StaticObject>& staticObjects) const
+{
+    if(!enabled_)
+    {
+        return false;
+    }
+
+    vector<uint8_t> objects;
+
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        auto it = objects_.find(id);
+
+        if(it == objects_.end())
+        {
+            return false;
+        }
+
+        objects = it->second;
+    }
+
+    BinReader reader(objects.data(), objects.size());
+    size_t count = objects.size() / kBakedStaticObjectSize;
+
+    staticObjects.reserve(staticObjects.size() + count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        StaticObject staticObject;
+        readBaked(reader, staticObject);
+        staticObjects.push_back(staticObject);
+    }
+
+    return true;
+}
+
+void SceneryCache::save(LandcellId id, const StaticObject* staticObjects, size_t count)
+{
+    if(!enabled_)
+    {
+        return;
+    }
+
+    vector<uint8_t> objects(count * kBakedStaticObjectSize);
+    BinWriter writer(objects.data(), objects.size());
+
+    for(size_t i = 0; i < count; i++)
+    {
+        writeBaked(writer, staticObjects[i]);
+    }
+
+    lock_guard<mutex> lock(mutex_);
+
+    if(objects_.find(id) != objects_.end())
+    {
+        return;
+    }
+
+    writeRecord(fs_, id, objects);
+    fs_.flush();
+
+    objects_[id] = move(objects);
+}
+
+bool SceneryCache::read(const string& path)
+{
+    ifstream fs(path.c_str(), ios_base::in|ios_base::binary);
+
+    if(!fs.good())
+    {
+        return false;
+    }
+
+    vector<uint8_t> data((istreambuf_iterator<char>(fs)), istreambuf_iterator<char>());
+    BinReader reader(data.data(), data.size());
+
+    if(reader.remaining() < kHeaderSize)
+    {
+        return false;
+    }
+
+    uint32_t magic = reader.readInt();
+    uint32_t formatVersion = reader.readInt();
+    uint32_t portalVersion = reader.readInt();
+    uint32_t cellVersion = reader.readInt();
+
+    if(magic != kMagic ||
+        formatVersion != kFormatVersion ||
+        portalVersion != Core::get().portalDat().version() ||
+        cellVersion != Core::get().cellDat().version())
+    {
+        return false;
+    }
+
+    while(reader.remaining() > 0)
+    {
+        if(reader.remaining() < kRecordHeaderSize)
+        {
+            return false;
+        }
+
+        LandcellId id(reader.readInt());
+        uint32_t count = reader.readInt();
+
+        if(reader.remaining() / kBakedStaticObjectSize < count)
+        {
+            // the last record was cut short
+            return false;
+        }
+
+        size_t size = count * kBakedStaticObjectSize;
+        const uint8_t* objects = reader.readRaw(size);
+        objects_[id].assign(objects, objects + size);
+    }
+
+    return true;
+}
+
+void SceneryCache::write(const string& path)
+{
+    ofstream fs(path.c_str(), ios_base::out|ios_base::binary|ios_base::trunc);
+
+    uint8_t header[kHeaderSize];
+    BinWriter writer(header, sizeof(header));
+    writer.writeInt(kMagic);
+    writer.writeInt(kFormatVersion);
+    writer.writeInt(Core::get().portalDat().version());
+    writer.writeInt(Core::get().cellDat().version());
+
+    fs.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    for(const auto& pair : objects_)
+    {
+        writeRecord(fs, pair.first, pair.second);
+    }
+
+    if(!fs.good())
+    {
+        throw runtime_error("Could not write scenery cache");
+    }
+}
+
+void SceneryCache::writeRecord(ostream& os, LandcellId id, const vector<uint8_t>& objects)
+{
+    uint8_t header[kRecordHeaderSize];
+    BinWriter writer(header, sizeof(header));
+    writer.writeInt(id.value());
+    writer.writeInt(static_cast<uint32_t>(objects.size() / kBakedStaticObjectSize));
+
+    os.write(reinterpret_cast<const char*>(header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(objects.data()), objects.size());
+}
@@ -17,6 +17,7 @@
  */
 #include "StaticObject.h"
 #include "BinReader.h"
+#include "BinWriter.h"
 #include "Core.h"
 #include "ResourceCache.h"
 #include "util.h"
@@ -38,3 +39,31 @@ void read(BinReader& reader, StaticObject& staticObject)
 
     staticObject.transform = translateMat * rotateMat;
 }
+
+void readBaked(BinReader& reader, StaticObject& staticObject)
+{
+    uint32_t modelId = reader.readInt();
+    staticObject.resource = Core::get().resourceCache().get(modelId);
+    staticObject.transform = glm::mat4{};
+
+    for(int c = 0; c < 4; c++)
+    {
+        for(int r = 0; r < 3; r++)
+        {
+            staticObject.transform[c][r] = reader.readFloat();
+        }
+    }
+}
+
+void writeBaked(BinWriter& writer, const StaticObject& staticObject)
+{
+    writer.writeInt(staticObject.resource->resourceId());
+
+    for(int c = 0; c < 4; c++)
+    {
+        for(int r = 0; r < 3; r++)
+        {
+            writer.writeFloat(static_cast<float>(staticObject.transform[c][r]));
+        }
+    }
+}
\ No newline at end of file
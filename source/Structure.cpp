@@ -20,6 +20,7 @@
 #include "BinReader.h"
 #include "Core.h"
 #include "ResourceCache.h"
+#include <algorithm>
 
 enum EnvCellFlags
 {
@@ -38,6 +39,7 @@ Structure::Structure(const void* data, size_t size)
 
     uint32_t flags = reader.readInt();
     assert(flags <= 0xF);
+    seenOutside_ = (flags & kSeenOutside) != 0;
 
     uint32_t resourceId2 = reader.readInt();
     assert(resourceId2 == resourceId);
@@ -60,20 +62,25 @@ Structure::Structure(const void* data, size_t size)
     partNum_ = reader.readShort();
     read(reader, location_);
 
-    // AC: CCellPortal
-    for(uint8_t i = 0; i < numConnected; i++)
+    portals_.resize(numConnected);
+
+    for(Portal& portal : portals_)
     {
-        /*portalSide*/ reader.readShort();
-        /*portalId*/ reader.readShort();
-        /*cellId*/ reader.readShort();
-        /*exactMatch*/ reader.readShort();
+        portal.portalSide = reader.readShort();
+        portal.portalId = reader.readShort();
+        portal.cellId = reader.readShort();
+        portal.exactMatch = reader.readShort();
     }
 
-    for(uint16_t i = 0; i < numVisible; i++)
+    visibleCells_.resize(numVisible);
+
+    for(uint16_t& cellId : visibleCells_)
     {
-        /*cellId*/ reader.readShort();
+        cellId = reader.readShort();
     }
 
+    sort(visibleCells_.begin(), visibleCells_.end());
+
     if(flags & kHasStaticObjects)
     {
         uint32_t numStaticObjects = reader.readInt();
@@ -98,6 +105,15 @@ LandcellId Structure::id() const
     return id_;
 }
 
+size_t Structure::calcSize() const
+{
+    return sizeof(*this) +
+        surfaces_.capacity() * sizeof(ResourcePtr) +
+        portals_.capacity() * sizeof(Portal) +
+        visibleCells_.capacity() * sizeof(uint16_t) +
+        Landcell::calcSize();
+}
+
 const Location& Structure::location() const
 {
     return location_;
@@ -117,3 +133,18 @@ uint16_t Structure::partNum() const
 {
     return partNum_;
 }
+
+const vector<Structure::Portal>& Structure::portals() const
+{
+    return portals_;
+}
+
+bool Structure::canSee(uint16_t cellId) const
+{
+    return binary_search(visibleCells_.begin(), visibleCells_.end(), cellId);
+}
+
+bool Structure::isSeenOutside() const
+{
+    return seenOutside_;
+}
\ No newline at end of file
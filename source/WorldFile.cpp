@@ -0,0 +1,228 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "WorldFile.h"
+#include "Core.h"
+#include "DatFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// blocks start on this boundary so their contents can be read in place
+static const uint64_t kBlockAlignment = 8;
+
+static const uint64_t kBlocksOffset = sizeof(WorldFile::Header) + sizeof(WorldFile::IndexEntry) * WorldFile::kNumBlocks;
+
+WorldFile::WorldFile(const string& path) : data_(nullptr), size_(0)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Could not open world file");
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if(!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        throw runtime_error("Could not get world file size");
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if(mapping == nullptr)
+    {
+        throw runtime_error("Could not map world file");
+    }
+
+    // the view keeps the mapping alive
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if(view == nullptr)
+    {
+        throw runtime_error("Could not map world file");
+    }
+
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if(fd < 0)
+    {
+        throw runtime_error("Could not open world file");
+    }
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw runtime_error("Could not get world file size");
+    }
+
+    // the mapping keeps the file open
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(view == MAP_FAILED)
+    {
+        throw runtime_error("Could not map world file");
+    }
+
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    if(size_ < kBlocksOffset)
+    {
+        unmap();
+        throw runtime_error("World file is truncated");
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(data_);
+
+    if(header->magic != kMagic || header->formatVersion != kFormatVersion)
+    {
+        unmap();
+        throw runtime_error("World file has bad magic number");
+    }
+
+    if(header->portalVersion != Core::get().portalDat().version() ||
+        header->cellVersion != Core::get().cellDat().version())
+    {
+        unmap();
+        throw runtime_error("World file is out of date, run bakeworld again");
+    }
+}
+
+WorldFile::~WorldFile()
+{
+    unmap();
+}
+
+bool WorldFile::find(LandcellId id, Block& block) const
+{
+    const IndexEntry* index = reinterpret_cast<const IndexEntry*>(data_ + sizeof(Header));
+    const IndexEntry& entry = index[id.x() * 256 + id.y()];
+
+    if(entry.offset == 0)
+    {
+        return false;
+    }
+
+    if(entry.offset > size_ || size_ - entry.offset < uint64_t(entry.landSize) + entry.bakedSize)
+    {
+        throw runtime_error("World file has bad index entry");
+    }
+
+    block.land = data_ + entry.offset;
+    block.landSize = entry.landSize;
+    block.baked = block.land + entry.landSize;
+    block.bakedSize = entry.bakedSize;
+
+    return true;
+}
+
+void WorldFile::unmap()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+#else
+    munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+WorldFileWriter::WorldFileWriter(const string& path) :
+    fs_(path.c_str(), ios_base::out|ios_base::binary|ios_base::trunc),
+    index_(WorldFile::kNumBlocks),
+    position_(kBlocksOffset)
+{
+    WorldFile::Header header;
+    header.magic = WorldFile::kMagic;
+    header.formatVersion = WorldFile::kFormatVersion;
+    header.portalVersion = Core::get().portalDat().version();
+    header.cellVersion = Core::get().cellDat().version();
+
+    memset(index_.data(), 0, index_.size() * sizeof(WorldFile::IndexEntry));
+
+    // the index is written again by finish
+    fs_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fs_.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(WorldFile::IndexEntry));
+
+    if(!fs_.good())
+    {
+        throw runtime_error("Could not write world file");
+    }
+}
+
+void WorldFileWriter::add(LandcellId id, const vector<uint8_t>& land, const vector<uint8_t>& baked)
+{
+    static const char padding[kBlockAlignment] = {};
+
+    lock_guard<mutex> lock(mutex_);
+
+    size_t padSize = static_cast<size_t>((kBlockAlignment - position_ % kBlockAlignment) % kBlockAlignment);
+    fs_.write(padding, padSize);
+    position_ += padSize;
+
+    WorldFile::IndexEntry& entry = index_[id.x() * 256 + id.y()];
+    entry.offset = position_;
+    entry.landSize = static_cast<uint32_t>(land.size());
+    entry.bakedSize = static_cast<uint32_t>(baked.size());
+
+    fs_.write(reinterpret_cast<const char*>(land.data()), land.size());
+    fs_.write(reinterpret_cast<const char*>(baked.data()), baked.size());
+    position_ += land.size() + baked.size();
+
+    if(!fs_.good())
+    {
+        throw runtime_error("Could not write world file");
+    }
+}
+
+void WorldFileWriter::finish()
+{
+    lock_guard<mutex> lock(mutex_);
+
+    fs_.seekp(sizeof(WorldFile::Header));
+    fs_.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(WorldFile::IndexEntry));
+    fs_.close();
+
+    if(fs_.fail())
+    {
+        throw runtime_error("Could not write world file");
+    }
+}
+
+uint64_t WorldFileWriter::size() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return position_;
+}
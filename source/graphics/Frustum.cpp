@@ -0,0 +1,198 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/Frustum.h"
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BZR_FRUSTUM_SSE
+#endif
+
+void CullBatch::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+    radius.clear();
+}
+
+void CullBatch::addSphere(const glm::vec3& center, fp_t r)
+{
+    x.push_back(static_cast<float>(center.x));
+    y.push_back(static_cast<float>(center.y));
+    z.push_back(static_cast<float>(center.z));
+    extentX.push_back(0.0f);
+    extentY.push_back(0.0f);
+    extentZ.push_back(0.0f);
+    radius.push_back(static_cast<float>(r));
+}
+
+void CullBatch::addBox(const glm::vec3& center, const glm::vec3& extents)
+{
+    x.push_back(static_cast<float>(center.x));
+    y.push_back(static_cast<float>(center.y));
+    z.push_back(static_cast<float>(center.z));
+    extentX.push_back(static_cast<float>(extents.x));
+    extentY.push_back(static_cast<float>(extents.y));
+    extentZ.push_back(static_cast<float>(extents.z));
+    radius.push_back(0.0f);
+}
+
+size_t CullBatch::size() const
+{
+    return x.size();
+}
+
+const fp_t Frustum::kWorldRadius = fp_t(10000.0);
+
+// how far the shaders lower a point this far from the camera horizontally,
+// R * (1 - cos(atan(d / R))) without the trig
+static float curveDrop(float distance)
+{
+    float radius = static_cast<float>(Frustum::kWorldRadius);
+    float t = distance / radius;
+    return radius - radius / sqrt(1.0f + t * t);
+}
+
+Frustum::Frustum(const glm::mat4& m, const glm::vec3& cameraPosition) :
+    cameraX_(static_cast<float>(cameraPosition.x)),
+    cameraY_(static_cast<float>(cameraPosition.y))
+{
+    // Gribb and Hartmann, rows of the matrix added to and subtracted from the last row
+    for(int i = 0; i < kNumPlanes; i++)
+    {
+        int row = i / 2;
+        fp_t sign = (i % 2 == 0) ? fp_t(1.0) : fp_t(-1.0);
+
+        glm::vec4 plane{
+            m[0][3] + sign * m[0][row],
+            m[1][3] + sign * m[1][row],
+            m[2][3] + sign * m[2][row],
+            m[3][3] + sign * m[3][row]};
+
+        fp_t length = glm::length(glm::vec3{plane.x, plane.y, plane.z});
+
+        a_[i] = static_cast<float>(plane.x / length);
+        b_[i] = static_cast<float>(plane.y / length);
+        c_[i] = static_cast<float>(plane.z / length);
+        d_[i] = static_cast<float>(plane.w / length);
+    }
+}
+
+size_t Frustum::cull(const CullBatch& batch, vector<uint8_t>& visible) const
+{
+    size_t count = batch.size();
+    visible.resize(count);
+
+    size_t numVisible = 0;
+    size_t i = 0;
+
+    // A volume's points are lowered by between the drops at its nearest and farthest horizontal
+    // distances, so its center is lowered by their mean and its z extent grown by half their difference
+
+#ifdef BZR_FRUSTUM_SSE
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 worldRadius = _mm_set1_ps(static_cast<float>(kWorldRadius));
+    const __m128 cameraX = _mm_set1_ps(cameraX_);
+    const __m128 cameraY = _mm_set1_ps(cameraY_);
+
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&batch.x[i]);
+        __m128 y = _mm_loadu_ps(&batch.y[i]);
+        __m128 z = _mm_loadu_ps(&batch.z[i]);
+        __m128 ex = _mm_loadu_ps(&batch.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&batch.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&batch.extentZ[i]);
+        __m128 r = _mm_loadu_ps(&batch.radius[i]);
+
+        __m128 hx = _mm_sub_ps(x, cameraX);
+        __m128 hy = _mm_sub_ps(y, cameraY);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(hx, hx), _mm_mul_ps(hy, hy)));
+        __m128 spread = _mm_add_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey))), r);
+
+        __m128 tNear = _mm_div_ps(_mm_max_ps(_mm_sub_ps(distance, spread), zero), worldRadius);
+        __m128 tFar = _mm_div_ps(_mm_add_ps(distance, spread), worldRadius);
+        __m128 dropNear = _mm_sub_ps(worldRadius, _mm_div_ps(worldRadius, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(tNear, tNear)))));
+        __m128 dropFar = _mm_sub_ps(worldRadius, _mm_div_ps(worldRadius, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(tFar, tFar)))));
+
+        z = _mm_sub_ps(z, _mm_mul_ps(_mm_add_ps(dropFar, dropNear), half));
+        ez = _mm_add_ps(ez, _mm_mul_ps(_mm_sub_ps(dropFar, dropNear), half));
+
+        __m128 outside = _mm_setzero_ps();
+
+        for(int p = 0; p < kNumPlanes; p++)
+        {
+            __m128 a = _mm_set1_ps(a_[p]);
+            __m128 b = _mm_set1_ps(b_[p]);
+            __m128 c = _mm_set1_ps(c_[p]);
+
+            // signed distance of the center
+            __m128 dist = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)),
+                _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(d_[p])));
+
+            // how far the volume reaches towards the plane
+            __m128 reach = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex), _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+                _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, c), ez), r));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, reach), _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+
+        for(int j = 0; j < 4; j++)
+        {
+            visible[i + j] = static_cast<uint8_t>(((mask >> j) & 1) ^ 1);
+            numVisible += visible[i + j];
+        }
+    }
+#endif
+
+    for(; i < count; i++)
+    {
+        float hx = batch.x[i] - cameraX_;
+        float hy = batch.y[i] - cameraY_;
+        float distance = sqrt(hx * hx + hy * hy);
+        float spread = sqrt(batch.extentX[i] * batch.extentX[i] + batch.extentY[i] * batch.extentY[i]) + batch.radius[i];
+        float dropNear = curveDrop(max(distance - spread, 0.0f));
+        float dropFar = curveDrop(distance + spread);
+
+        float z = batch.z[i] - (dropFar + dropNear) * 0.5f;
+        float ez = batch.extentZ[i] + (dropFar - dropNear) * 0.5f;
+
+        bool outside = false;
+
+        for(int p = 0; p < kNumPlanes; p++)
+        {
+            float dist = a_[p] * batch.x[i] + b_[p] * batch.y[i] + c_[p] * z + d_[p];
+            float reach = fabs(a_[p]) * batch.extentX[i] + fabs(b_[p]) * batch.extentY[i] + fabs(c_[p]) * ez + batch.radius[i];
+            outside = outside || dist + reach < 0.0f;
+        }
+
+        visible[i] = outside ? 0 : 1;
+        numVisible += visible[i];
+    }
+
+    return numVisible;
+}
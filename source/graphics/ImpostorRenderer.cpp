@@ -0,0 +1,322 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/ImpostorRenderer.h"
+#include "graphics/MeshRenderData.h"
+#include "graphics/Renderer.h"
+#include "resource/Model.h"
+#include "Core.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "graphics/shaders/ImpostorVertexShader.h"
+#include "graphics/shaders/ImpostorFragmentShader.h"
+
+// so a frame that meets a lot of new scenery doesn't stall
+static const int kBakesPerFrame = 8;
+
+// pictures are only ever seen small, a few mip levels do
+static const int kMaxMipLevel = 3;
+
+ImpostorRenderer::ImpostorRenderer(int atlasSize, int cellSize) :
+    cellSize_(cellSize),
+    cellsPerRow_(atlasSize / cellSize),
+    queue_(Core::get().renderer().uniformRing()),
+    frame_(0),
+    bakesThisFrame_(0),
+    mipmapsStale_(false)
+{
+    int numSlots = cellsPerRow_ * cellsPerRow_ / kViews;
+
+    for(int slot = numSlots - 1; slot >= 0; slot--)
+    {
+        freeSlots_.push_back(slot);
+    }
+
+    program_.create();
+    program_.attach(GL_VERTEX_SHADER, ImpostorVertexShader);
+    program_.attach(GL_FRAGMENT_SHADER, ImpostorFragmentShader);
+    program_.link();
+
+    program_.use();
+    glUniform1i(program_.getUniform("atlasTex"), 0);
+    glUniform1i(program_.getUniform("cellsPerRow"), cellsPerRow_);
+
+    initGeometry();
+
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, kMaxMipLevel);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glGenRenderbuffers(1, &depthBuffer_);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+
+    GLint previousFramebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer_);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        throw runtime_error("Impostor framebuffer incomplete");
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+ImpostorRenderer::~ImpostorRenderer()
+{
+    program_.destroy();
+    glDeleteVertexArrays(1, &vertexArray_);
+    glDeleteBuffers(1, &vertexBuffer_);
+    glDeleteBuffers(1, &instanceBuffer_);
+    glDeleteFramebuffers(1, &framebuffer_);
+    glDeleteRenderbuffers(1, &depthBuffer_);
+    glDeleteTextures(1, &texture_);
+}
+
+int ImpostorRenderer::find(const ResourcePtr& resource, Sphere& bounds)
+{
+    auto it = impostors_.find(resource.get());
+
+    if(it != impostors_.end())
+    {
+        it->second.lastUsed = frame_;
+
+        if(!it->second.baked)
+        {
+            return -1;
+        }
+
+        bounds = it->second.bounds;
+        return it->second.slot;
+    }
+
+    int slot = allocateSlot();
+
+    if(slot < 0)
+    {
+        return -1;
+    }
+
+    Impostor& impostor = impostors_[resource.get()];
+    impostor.resource = resource;
+    impostor.slot = slot;
+    impostor.baked = false;
+    impostor.lastUsed = frame_;
+
+    pending_.push_back(resource);
+
+    return -1;
+}
+
+bool ImpostorRenderer::nextBake(ResourcePtr& resource)
+{
+    if(pending_.empty() || bakesThisFrame_ == kBakesPerFrame)
+    {
+        if(mipmapsStale_)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture_);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            mipmapsStale_ = false;
+        }
+
+        return false;
+    }
+
+    resource = pending_.back();
+    pending_.pop_back();
+    bakesThisFrame_++;
+
+    return true;
+}
+
+void ImpostorRenderer::bake(const ResourcePtr& resource, const vector<Part>& parts)
+{
+    Impostor& impostor = impostors_[resource.get()];
+
+    // a sphere around the bounds of the parts
+    glm::vec3 minPosition{0.0, 0.0, 0.0};
+    glm::vec3 maxPosition{0.0, 0.0, 0.0};
+
+    for(size_t i = 0; i < parts.size(); i++)
+    {
+        const Part& part = parts[i];
+
+        fp_t scale = max(max(glm::length(glm::vec3{part.transform[0]}), glm::length(glm::vec3{part.transform[1]})), glm::length(glm::vec3{part.transform[2]}));
+        glm::vec4 center = part.transform * glm::vec4{part.model->bounds.center, 1.0};
+        glm::vec3 radius{part.model->bounds.radius * scale};
+
+        minPosition = i == 0 ? glm::vec3{center} - radius : glm::min(minPosition, glm::vec3{center} - radius);
+        maxPosition = i == 0 ? glm::vec3{center} + radius : glm::max(maxPosition, glm::vec3{center} + radius);
+    }
+
+    impostor.bounds.center = (minPosition + maxPosition) * fp_t(0.5);
+    impostor.bounds.radius = max(glm::length(maxPosition - minPosition) * fp_t(0.5), fp_t(0.01));
+
+    const glm::vec3& center = impostor.bounds.center;
+    fp_t radius = impostor.bounds.radius;
+
+    Renderer& renderer = Core::get().renderer();
+
+    for(const Part& part : parts)
+    {
+        RenderQueue::Draw draw;
+        draw.program = &renderer.meshProgram();
+        draw.worldMat = part.transform;
+
+        RenderQueue::Pass pass = part.model->needsDepthSort ? RenderQueue::Pass::kTransparent : RenderQueue::Pass::kOpaque;
+
+        part.mesh->enqueue(queue_, pass, 0.0f, 0.0f, draw);
+    }
+
+    queue_.sort();
+
+    GLint previousFramebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glEnable(GL_SCISSOR_TEST);
+
+    for(int view = 0; view < kViews; view++)
+    {
+        int cell = impostor.slot * kViews + view;
+        GLint x = (cell % cellsPerRow_) * cellSize_;
+        GLint y = (cell / cellsPerRow_) * cellSize_;
+
+        glViewport(x, y, cellSize_, cellSize_);
+        glScissor(x, y, cellSize_, cellSize_);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // looking in from the side, level with the center
+        fp_t angle = fp_t(2.0) * pi() * view / kViews;
+        glm::vec3 dir{cos(angle), sin(angle), 0.0};
+
+        glm::mat4 viewMat = glm::lookAt(center + dir * radius * fp_t(2.0), center, glm::vec3{0.0, 0.0, 1.0});
+        glm::mat4 projectionMat = glm::ortho(-radius, radius, -radius, radius, radius, radius * fp_t(3.0));
+
+        // the world curves away from the camera, keep it under the model
+        renderer.bindFrameConstants(projectionMat, viewMat, center);
+
+        queue_.submit(RenderQueue::Pass::kOpaque);
+        queue_.submit(RenderQueue::Pass::kTransparent);
+    }
+
+    queue_.clear();
+
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    impostor.baked = true;
+    mipmapsStale_ = true;
+}
+
+void ImpostorRenderer::render(const vector<Instance>& instances)
+{
+    frame_++;
+    bakesThisFrame_ = 0;
+
+    if(instances.empty())
+    {
+        return;
+    }
+
+    program_.use();
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+
+    glBindVertexArray(vertexArray_);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(instances.size()));
+}
+
+int ImpostorRenderer::allocateSlot()
+{
+    if(!freeSlots_.empty())
+    {
+        int slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        return slot;
+    }
+
+    // take the slot of the least recently used, if it wasn't wanted last frame
+    auto lru = impostors_.end();
+
+    for(auto it = impostors_.begin(); it != impostors_.end(); ++it)
+    {
+        if(it->second.baked && (lru == impostors_.end() || it->second.lastUsed < lru->second.lastUsed))
+        {
+            lru = it;
+        }
+    }
+
+    if(lru == impostors_.end() || lru->second.lastUsed + 1 >= frame_)
+    {
+        return -1;
+    }
+
+    int slot = lru->second.slot;
+    impostors_.erase(lru);
+    return slot;
+}
+
+void ImpostorRenderer::initGeometry()
+{
+    static const float kCorners[] =
+    {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f
+    };
+
+    glGenVertexArrays(1, &vertexArray_);
+    glBindVertexArray(vertexArray_);
+
+    glGenBuffers(1, &vertexBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(kCorners), kCorners, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, nullptr);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &instanceBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), nullptr);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<GLvoid*>(sizeof(glm::vec4)));
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+}
@@ -0,0 +1,314 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/LandArray.h"
+#include "graphics/LandRenderData.h"
+#include "Land.h"
+#include <algorithm>
+
+static const int kCellsPerBlock = Land::kGridSize - 1;
+
+// texels per cell in the cell texture, see LandInstancedVertexShader.glsl
+static const int kTexelsPerCell = 3;
+
+static void pushGridVertex(vector<GLubyte>& gridData, int cellX, int cellY, int code)
+{
+    gridData.push_back(static_cast<GLubyte>(cellX));
+    gridData.push_back(static_cast<GLubyte>(cellY));
+    gridData.push_back(static_cast<GLubyte>(code));
+    gridData.push_back(0);
+}
+
+// a quad hanging down from the edge between two corners of a cell
+// corners are numbered counter-clockwise from the south-west
+static void pushGridSkirt(vector<GLubyte>& gridData, int cellX, int cellY, int corner1, int corner2)
+{
+    pushGridVertex(gridData, cellX, cellY, 6 + corner1 * 2);
+    pushGridVertex(gridData, cellX, cellY, 6 + corner2 * 2);
+    pushGridVertex(gridData, cellX, cellY, 6 + corner2 * 2 + 1);
+
+    pushGridVertex(gridData, cellX, cellY, 6 + corner2 * 2 + 1);
+    pushGridVertex(gridData, cellX, cellY, 6 + corner1 * 2 + 1);
+    pushGridVertex(gridData, cellX, cellY, 6 + corner1 * 2);
+}
+
+LandArray::LandArray(int capacity) :
+    capacity_(capacity),
+    frame_(1),
+    nextSerial_(1),
+    layerSerials_(capacity, 0),
+    layerFrames_(capacity, 0)
+{
+    initGrid();
+    initTextures();
+}
+
+LandArray::~LandArray()
+{
+    glDeleteVertexArrays(1, &vertexArray_);
+    glDeleteBuffers(1, &gridBuffer_);
+    glDeleteBuffers(1, &instanceBuffer_);
+    glDeleteTextures(1, &heightTexture_);
+    glDeleteTextures(1, &cellTexture_);
+    glDeleteTextures(1, &normalTexture_);
+}
+
+void LandArray::add(const Land& land, const glm::vec2& position, bool skirts)
+{
+    Tag* tag = static_cast<Tag*>(land.renderData().get());
+
+    if(tag == nullptr)
+    {
+        tag = new Tag();
+        land.renderData().reset(tag);
+        tag->layer = 0;
+        tag->serial = 0;
+    }
+
+    if(tag->serial == 0 || layerSerials_[tag->layer] != tag->serial)
+    {
+        tag->layer = allocLayer();
+        tag->serial = nextSerial_++;
+        layerSerials_[tag->layer] = tag->serial;
+
+        upload(land, tag->layer);
+
+        // deep enough to cover the difference to coarser distant terrain, like LandRenderData
+        fp_t minHeight = land.getHeight(0, 0);
+        fp_t maxHeight = minHeight;
+
+        for(int y = 0; y < Land::kGridSize; y++)
+        {
+            for(int x = 0; x < Land::kGridSize; x++)
+            {
+                minHeight = min(minHeight, land.getHeight(x, y));
+                maxHeight = max(maxHeight, land.getHeight(x, y));
+            }
+        }
+
+        tag->skirtDepth = static_cast<GLfloat>(maxHeight - minHeight + Land::kCellSize);
+    }
+
+    layerFrames_[tag->layer] = frame_;
+
+    Instance instance
+    {
+        static_cast<GLfloat>(position.x),
+        static_cast<GLfloat>(position.y),
+        static_cast<GLfloat>(tag->layer),
+        tag->skirtDepth
+    };
+
+    if(skirts)
+    {
+        instances_.push_back(instance);
+    }
+    else
+    {
+        instancesWithoutSkirts_.push_back(instance);
+    }
+}
+
+void LandArray::render()
+{
+    GLsizei numSkirted = static_cast<GLsizei>(instances_.size());
+    instances_.insert(instances_.end(), instancesWithoutSkirts_.begin(), instancesWithoutSkirts_.end());
+
+    if(!instances_.empty())
+    {
+        glBindVertexArray(vertexArray_);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+        glBufferData(GL_ARRAY_BUFFER, instances_.size() * sizeof(Instance), instances_.data(), GL_STREAM_DRAW);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, normalTexture_);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture_);
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cellTexture_);
+
+        glDrawArraysInstanced(GL_TRIANGLES, 0, surfaceVertexCount_, static_cast<GLsizei>(instances_.size()));
+
+        // the skirts of the lands that need them, those come first
+        if(numSkirted != 0)
+        {
+            glDrawArraysInstanced(GL_TRIANGLES, surfaceVertexCount_, skirtVertexCount_, numSkirted);
+        }
+    }
+
+    instances_.clear();
+    instancesWithoutSkirts_.clear();
+    frame_++;
+}
+
+size_t LandArray::calcLayerSize()
+{
+    return Land::kGridSize * Land::kGridSize * sizeof(GLfloat) +
+        kCellsPerBlock * kTexelsPerCell * kCellsPerBlock * 4 +
+        Land::kOffsetMapSize * Land::kOffsetMapSize * 2;
+}
+
+int LandArray::allocLayer()
+{
+    // recycle the layer that hasn't been drawn for the longest
+    int layer = -1;
+
+    for(int i = 0; i < capacity_; i++)
+    {
+        if(layerFrames_[i] != frame_ && (layer < 0 || layerFrames_[i] < layerFrames_[layer]))
+        {
+            layer = i;
+        }
+    }
+
+    if(layer < 0)
+    {
+        throw runtime_error("Land array is full");
+    }
+
+    return layer;
+}
+
+void LandArray::upload(const Land& land, int layer)
+{
+    vector<GLfloat> heights(Land::kGridSize * Land::kGridSize);
+
+    for(int y = 0; y < Land::kGridSize; y++)
+    {
+        for(int x = 0; x < Land::kGridSize; x++)
+        {
+            heights[x + y * Land::kGridSize] = static_cast<GLfloat>(land.getHeight(x, y));
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture_);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, Land::kGridSize, Land::kGridSize, 1, GL_RED, GL_FLOAT, heights.data());
+
+    // per cell: terrain textures, blend textures, then road texture, road blend texture, rotations, road rotation/scale/split
+    static const int cellTextureWidth = kCellsPerBlock * kTexelsPerCell;
+
+    vector<GLubyte> cells(cellTextureWidth * kCellsPerBlock * 4);
+
+    for(int y = 0; y < kCellsPerBlock; y++)
+    {
+        for(int x = 0; x < kCellsPerBlock; x++)
+        {
+            LandCellTextures cell = calcLandCellTextures(land, x, y);
+
+            GLubyte* texel = cells.data() + (x * kTexelsPerCell + y * cellTextureWidth) * 4;
+
+            for(int i = 0; i < 4; i++)
+            {
+                texel[i] = cell.textures[i];
+                texel[4 + i] = cell.blendTextures[i];
+            }
+
+            texel[8] = cell.textures[4];
+            texel[9] = cell.blendTextures[4];
+            texel[10] = static_cast<GLubyte>(cell.rotations[0] | (cell.rotations[1] << 2) | (cell.rotations[2] << 4) | (cell.rotations[3] << 6));
+            texel[11] = static_cast<GLubyte>(cell.rotations[4] | (cell.roadScale << 2) | (land.isSplitNESW(x, y) ? 0x10 : 0x00));
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cellTexture_);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, cellTextureWidth, kCellsPerBlock, 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, cells.data());
+
+    // terrain normals always point up, so z is left out and recomputed in the shader
+    static const int numNormals = Land::kOffsetMapSize * Land::kOffsetMapSize;
+
+    vector<GLubyte> normals(numNormals * 2);
+
+    for(int i = 0; i < numNormals; i++)
+    {
+        normals[i * 2] = land.normalMap()[i * 3];
+        normals[i * 2 + 1] = land.normalMap()[i * 3 + 1];
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, normalTexture_);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, Land::kOffsetMapSize, Land::kOffsetMapSize, 1, GL_RG, GL_UNSIGNED_BYTE, normals.data());
+}
+
+void LandArray::initGrid()
+{
+    vector<GLubyte> gridData;
+
+    // two triangles per cell, the shader picks their corners from the cell's split direction
+    for(int y = 0; y < kCellsPerBlock; y++)
+    {
+        for(int x = 0; x < kCellsPerBlock; x++)
+        {
+            for(int code = 0; code < 6; code++)
+            {
+                pushGridVertex(gridData, x, y, code);
+            }
+        }
+    }
+
+    surfaceVertexCount_ = static_cast<GLsizei>(gridData.size() / 4);
+
+    static const int last = kCellsPerBlock - 1;
+
+    for(int i = 0; i < kCellsPerBlock; i++)
+    {
+        pushGridSkirt(gridData, i, 0, 0, 1);
+        pushGridSkirt(gridData, i, last, 3, 2);
+        pushGridSkirt(gridData, 0, i, 0, 3);
+        pushGridSkirt(gridData, last, i, 1, 2);
+    }
+
+    skirtVertexCount_ = static_cast<GLsizei>(gridData.size() / 4) - surfaceVertexCount_;
+
+    glGenVertexArrays(1, &vertexArray_);
+    glBindVertexArray(vertexArray_);
+
+    glGenBuffers(1, &gridBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, gridBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, gridData.size(), gridData.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_BYTE, GL_FALSE, 4, nullptr);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &instanceBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), nullptr);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+}
+
+void LandArray::initTextures()
+{
+    glGenTextures(1, &heightTexture_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, Land::kGridSize, Land::kGridSize, capacity_, 0, GL_RED, GL_FLOAT, nullptr);
+
+    glGenTextures(1, &cellTexture_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cellTexture_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8UI, kCellsPerBlock * kTexelsPerCell, kCellsPerBlock, capacity_, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+    glGenTextures(1, &normalTexture_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, normalTexture_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // default is GL_NEAREST_MIPMAP_LINEAR
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG8, Land::kOffsetMapSize, Land::kOffsetMapSize, capacity_, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+}
@@ -0,0 +1,258 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/LandLodRenderData.h"
+#include "graphics/Renderer.h"
+#include "graphics/UploadScheduler.h"
+#include "Core.h"
+#include "Land.h"
+#include <algorithm>
+#include <limits>
+
+static const int kComponentsPerVertex = 9;
+
+static const int kCellsPerBlock = Land::kGridSize - 1;
+static const int kCellsPerChunk = LandLodRenderData::kChunkSize * kCellsPerBlock;
+
+// Height of a grid point in the chunk, gx and gy are relative to landblock bx, by
+// and may reach into neighboring landblocks of the chunk
+static fp_t getChunkHeight(const LandLodRenderData::Lands& lands, int bx, int by, int gx, int gy)
+{
+    int cx = max(0, min(bx * kCellsPerBlock + gx, kCellsPerChunk));
+    int cy = max(0, min(by * kCellsPerBlock + gy, kCellsPerChunk));
+
+    int nbx = min(cx / kCellsPerBlock, LandLodRenderData::kChunkSize - 1);
+    int nby = min(cy / kCellsPerBlock, LandLodRenderData::kChunkSize - 1);
+
+    if(lands[nbx][nby] == nullptr)
+    {
+        gx = max(0, min(gx, kCellsPerBlock));
+        gy = max(0, min(gy, kCellsPerBlock));
+        return lands[bx][by]->getHeight(gx, gy);
+    }
+
+    return lands[nbx][nby]->getHeight(cx - nbx * kCellsPerBlock, cy - nby * kCellsPerBlock);
+}
+
+static void pushVertex(vector<GLfloat>& vertexData,
+    const LandLodRenderData::Lands& lands,
+    const vector<glm::vec3>& terrainColors,
+    int bx, int by, int gx, int gy, int step, fp_t depth)
+{
+    const Land& land = *lands[bx][by];
+
+    fp_t x = bx * Land::kBlockSize + gx * Land::kCellSize;
+    fp_t y = by * Land::kBlockSize + gy * Land::kCellSize;
+    fp_t z = land.getHeight(gx, gy) - depth;
+
+    // central differences over the spacing of this level
+    fp_t dzdx = (getChunkHeight(lands, bx, by, gx + step, gy) - getChunkHeight(lands, bx, by, gx - step, gy)) / (fp_t(2.0) * step * Land::kCellSize);
+    fp_t dzdy = (getChunkHeight(lands, bx, by, gx, gy + step) - getChunkHeight(lands, bx, by, gx, gy - step)) / (fp_t(2.0) * step * Land::kCellSize);
+    glm::vec3 normal = glm::normalize(glm::vec3{-dzdx, -dzdy, 1.0});
+
+    // same texture choice as LandRenderData, but one per vertex without blending
+    static const uint8_t kCommonRoad = 0x20;
+    static const uint8_t kRareRoad = 0x1F;
+
+    uint8_t road = land.getRoad(gx, gy);
+    size_t texture = road ? (road == 1 ? kCommonRoad : kRareRoad) : land.getTerrain(gx, gy);
+    glm::vec3 color = texture < terrainColors.size() ? terrainColors[texture] : glm::vec3{0.5, 0.5, 0.5};
+
+    vertexData.push_back(static_cast<GLfloat>(x));
+    vertexData.push_back(static_cast<GLfloat>(y));
+    vertexData.push_back(static_cast<GLfloat>(z));
+    vertexData.push_back(static_cast<GLfloat>(normal.x));
+    vertexData.push_back(static_cast<GLfloat>(normal.y));
+    vertexData.push_back(static_cast<GLfloat>(normal.z));
+    vertexData.push_back(static_cast<GLfloat>(color.x));
+    vertexData.push_back(static_cast<GLfloat>(color.y));
+    vertexData.push_back(static_cast<GLfloat>(color.z));
+}
+
+LandLodRenderData::LandLodRenderData(const Lands& lands, int level, const vector<glm::vec3>& terrainColors)
+{
+    assert(level >= 0 && level <= kMaxLevel);
+
+    int step = 1 << level;
+    int quads = kCellsPerBlock / step;
+
+    vector<GLfloat> vertexData;
+    vector<GLushort> indexData;
+
+    for(int bx = 0; bx < kChunkSize; bx++)
+    {
+        for(int by = 0; by < kChunkSize; by++)
+        {
+            const Land* land = lands[bx][by];
+
+            if(land == nullptr)
+            {
+                continue;
+            }
+
+            GLushort base = static_cast<GLushort>(vertexData.size() / kComponentsPerVertex);
+
+#define I(qx, qy) static_cast<GLushort>(base + (qx) + (qy) * (quads + 1))
+
+            for(int qy = 0; qy <= quads; qy++)
+            {
+                for(int qx = 0; qx <= quads; qx++)
+                {
+                    pushVertex(vertexData, lands, terrainColors, bx, by, qx * step, qy * step, step, fp_t(0.0));
+                }
+            }
+
+            for(int qy = 0; qy < quads; qy++)
+            {
+                for(int qx = 0; qx < quads; qx++)
+                {
+                    GLushort quad[]
+                    {
+                        I(qx, qy), I(qx + 1, qy), I(qx + 1, qy + 1),
+                        I(qx + 1, qy + 1), I(qx, qy + 1), I(qx, qy),
+                    };
+
+                    // same diagonals as the full detail land where they line up
+                    GLushort quadNWSE[]
+                    {
+                        I(qx, qy), I(qx + 1, qy), I(qx, qy + 1),
+                        I(qx + 1, qy), I(qx + 1, qy + 1), I(qx, qy + 1)
+                    };
+
+                    if(land->isSplitNESW(qx * step, qy * step))
+                    {
+                        indexData.insert(indexData.end(), quad, quad + 6);
+                    }
+                    else
+                    {
+                        indexData.insert(indexData.end(), quadNWSE, quadNWSE + 6);
+                    }
+                }
+            }
+
+            // skirts along edges that don't continue into this chunk
+            fp_t minHeight = land->getHeight(0, 0);
+            fp_t maxHeight = minHeight;
+
+            for(int gy = 0; gy < Land::kGridSize; gy++)
+            {
+                for(int gx = 0; gx < Land::kGridSize; gx++)
+                {
+                    minHeight = min(minHeight, land->getHeight(gx, gy));
+                    maxHeight = max(maxHeight, land->getHeight(gx, gy));
+                }
+            }
+
+            fp_t depth = maxHeight - minHeight + Land::kCellSize;
+
+            static const int kEdges[4][2] = { { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 } };
+
+            for(int e = 0; e < 4; e++)
+            {
+                int nbx = bx + kEdges[e][0];
+                int nby = by + kEdges[e][1];
+
+                if(nbx >= 0 && nbx < kChunkSize && nby >= 0 && nby < kChunkSize && lands[nbx][nby] != nullptr)
+                {
+                    continue;
+                }
+
+                for(int i = 0; i < quads; i++)
+                {
+                    // edge from (qx1, qy1) to (qx2, qy2)
+                    int qx1 = kEdges[e][0] == 0 ? i : (kEdges[e][0] < 0 ? 0 : quads);
+                    int qy1 = kEdges[e][1] == 0 ? i : (kEdges[e][1] < 0 ? 0 : quads);
+                    int qx2 = kEdges[e][0] == 0 ? i + 1 : qx1;
+                    int qy2 = kEdges[e][1] == 0 ? i + 1 : qy1;
+
+                    GLushort bottom = static_cast<GLushort>(vertexData.size() / kComponentsPerVertex);
+
+                    pushVertex(vertexData, lands, terrainColors, bx, by, qx1 * step, qy1 * step, step, depth);
+                    pushVertex(vertexData, lands, terrainColors, bx, by, qx2 * step, qy2 * step, step, depth);
+
+                    GLushort skirt[]
+                    {
+                        I(qx1, qy1), I(qx2, qy2), static_cast<GLushort>(bottom + 1),
+                        static_cast<GLushort>(bottom + 1), bottom, I(qx1, qy1)
+                    };
+
+                    indexData.insert(indexData.end(), skirt, skirt + 6);
+                }
+            }
+#undef I
+        }
+    }
+
+    vertexCount_ = static_cast<GLsizei>(vertexData.size() / kComponentsPerVertex);
+    indexCount_ = static_cast<GLsizei>(indexData.size());
+
+    minHeight_ = numeric_limits<fp_t>::max();
+    maxHeight_ = -numeric_limits<fp_t>::max();
+
+    for(size_t i = 0; i < vertexData.size(); i += kComponentsPerVertex)
+    {
+        minHeight_ = min(minHeight_, static_cast<fp_t>(vertexData[i + 2]));
+        maxHeight_ = max(maxHeight_, static_cast<fp_t>(vertexData[i + 2]));
+    }
+
+    glGenVertexArrays(1, &vertexArray_);
+    glBindVertexArray(vertexArray_);
+
+    glGenBuffers(1, &vertexBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    Core::get().renderer().uploadScheduler().bufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(GLfloat), vertexData.data());
+
+    glGenBuffers(1, &indexBuffer_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_);
+    Core::get().renderer().uploadScheduler().bufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(GLushort), indexData.data());
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), nullptr);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 6));
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+}
+
+LandLodRenderData::~LandLodRenderData()
+{
+    glDeleteVertexArrays(1, &vertexArray_);
+    glDeleteBuffers(1, &vertexBuffer_);
+    glDeleteBuffers(1, &indexBuffer_);
+}
+
+void LandLodRenderData::render()
+{
+    glBindVertexArray(vertexArray_);
+    glDrawElements(GL_TRIANGLES, indexCount_, GL_UNSIGNED_SHORT, nullptr);
+}
+
+size_t LandLodRenderData::calcSize() const
+{
+    return vertexCount_ * kComponentsPerVertex * sizeof(GLfloat) + indexCount_ * sizeof(GLushort);
+}
+
+fp_t LandLodRenderData::minHeight() const
+{
+    return minHeight_;
+}
+
+fp_t LandLodRenderData::maxHeight() const
+{
+    return maxHeight_;
+}
@@ -17,7 +17,25 @@
  */
 #include "graphics/LandRenderData.h"
 #include "graphics/Program.h"
+#include "graphics/Renderer.h"
+#include "graphics/UploadScheduler.h"
+#include "Core.h"
 #include "Land.h"
+#include <cstddef>
+#include <cstring>
+
+// 20 bytes per vertex, decoded in LandVertexShader.glsl
+// The cell bytes are laid out the same as the cell texels in LandArray::upload
+struct PackedLandVertex
+{
+    GLfloat height;
+    GLubyte grid[4]; // grid x, grid y, corner dx | dy << 1, unused
+    GLubyte textures[4];
+    GLubyte blendTextures[4];
+    GLubyte road[4]; // road texture, road blend texture, rotations, road rotation/scale
+};
+
+static_assert(sizeof(PackedLandVertex) == 20, "PackedLandVertex has padding");
 
 LandRenderData::LandRenderData(const Land& land)
 {
@@ -32,205 +50,223 @@ LandRenderData::~LandRenderData()
     glDeleteTextures(1, &normalTexture_);
 }
 
-void LandRenderData::render()
+void LandRenderData::render(bool skirts)
 {
     glBindVertexArray(vertexArray_);
 
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, normalTexture_);
 
-    glDrawArrays(GL_TRIANGLES, 0, vertexCount_);
+    // the skirts come right after the surface
+    glDrawArrays(GL_TRIANGLES, 0, skirts ? vertexCount_ + skirtVertexCount_ : vertexCount_);
 }
 
-static void pushRotatedCoord(vector<GLfloat>& vertexData, fp_t s, fp_t t, int rotations, int scale)
+size_t LandRenderData::calcSize() const
 {
-    fp_t cosine = glm::cos(pi() / fp_t(180.0) * fp_t(90.0) * rotations);
-    fp_t sine = glm::sin(pi() / fp_t(180.0) * fp_t(90.0) * rotations);
-
-    fp_t ns = (s - fp_t(0.5)) * cosine - (t - fp_t(0.5)) * sine + fp_t(0.5);
-    fp_t nt = (s - fp_t(0.5)) * sine + (t - fp_t(0.5)) * cosine + fp_t(0.5);
+    return (vertexCount_ + skirtVertexCount_) * sizeof(PackedLandVertex) +
+        Land::kOffsetMapSize * Land::kOffsetMapSize * 3;
+}
 
-    vertexData.push_back(ns * scale);
-    vertexData.push_back(nt * scale);
+static void pushSkirtVertex(vector<PackedLandVertex>& vertexData, size_t vertex, GLfloat depth)
+{
+    PackedLandVertex skirtVertex = vertexData[vertex];
+    skirtVertex.height -= depth;
+    vertexData.push_back(skirtVertex);
 }
 
-void LandRenderData::initGeometry(const Land& land)
+// a quad hanging down from the edge between two surface vertices
+static void pushSkirt(vector<PackedLandVertex>& vertexData, size_t vertex1, size_t vertex2, GLfloat depth)
 {
-    vector<GLfloat> vertexData;
+    pushSkirtVertex(vertexData, vertex1, 0.0f);
+    pushSkirtVertex(vertexData, vertex2, 0.0f);
+    pushSkirtVertex(vertexData, vertex2, depth);
 
-    for(uint8_t y = 0; y < Land::kGridSize - 1; y++)
-    {
-        for(uint8_t x = 0; x < Land::kGridSize - 1; x++)
-        {
+    pushSkirtVertex(vertexData, vertex2, depth);
+    pushSkirtVertex(vertexData, vertex1, depth);
+    pushSkirtVertex(vertexData, vertex1, 0.0f);
+}
+
+LandCellTextures calcLandCellTextures(const Land& land, int x, int y)
+{
 #define T(dx, dy) land.getTerrain(x + (dx), y + (dy))
-            uint8_t terrain[]
-            {
-                T(0, 0), T(1, 0), T(1, 1), T(0, 1)
-            };
+    uint8_t terrain[]
+    {
+        T(0, 0), T(1, 0), T(1, 1), T(0, 1)
+    };
 #undef T
 
 #define R(dx, dy) land.getRoad(x + (dx), y + (dy))
-            uint8_t road[]
-            {
-                R(0, 0), R(1, 0), R(1, 1), R(0, 1)
-            };
+    uint8_t road[]
+    {
+        R(0, 0), R(1, 0), R(1, 1), R(0, 1)
+    };
 #undef R
 
-            uint32_t terrainDone = 0;
+    uint32_t terrainDone = 0;
 
-            vector<uint8_t> textures;
-            vector<uint8_t> blendTextures;
-            vector<uint8_t> rotations;
+    LandCellTextures cell;
+    int numTextures = 0;
 
-            for(int i = 0; i < 4; i++)
+    for(int i = 0; i < 4; i++)
+    {
+        if(terrainDone & (1 << terrain[i]))
+        {
+            continue;
+        }
+
+        terrainDone |= (1 << terrain[i]);
+
+        uint8_t bitfield = 0;
+
+        for(int j = 0; j < 4; j++)
+        {
+            if(terrain[j] == terrain[i])
             {
-                if(terrainDone & (1 << terrain[i]))
-                {
-                    continue;
-                }
-
-                terrainDone |= (1 << terrain[i]);
-
-                uint8_t bitfield = 0;
-
-                for(int j = 0; j < 4; j++)
-                {
-                    if(terrain[j] == terrain[i])
-                    {
-                        bitfield |= (1 << j);
-                    }
-                }
-
-                // number of 90 degree ccw rotations
-                uint8_t rotationCount = 0;
-                uint8_t blendTex = 0xFF;
-
-                for(;;)
-                {
-                    switch(bitfield)
-                    {
-                        case 0x1: // 0001
-                            blendTex = 8;
-                            break;
-                        case 0x9: // 1001
-                            blendTex = 2;
-                            break;
-                        case 0x5: // 0101
-                            blendTex = 0; // TODO
-                            break;
-                        case 0xE: // 1110
-                            blendTex = 0x80 + 0x8;
-                            break;
-                        case 0xF: // 1111
-                            blendTex = 1;
-                            break;
-                    }
-
-                    if(blendTex != 0xFF)
-                    {
-                        break;
-                    }
-
-                    bitfield = ((bitfield << 1) | (bitfield >> 3)) & 0xF;
-                    rotationCount++;
-                }
-
-                textures.push_back(terrain[i]);
-                blendTextures.push_back(blendTex);
-                rotations.push_back(rotationCount);
+                bitfield |= (1 << j);
             }
+        }
+
+        // number of 90 degree ccw rotations
+        uint8_t rotationCount = 0;
+        uint8_t blendTex = 0xFF;
+
+        for(;;)
+        {
+            switch(bitfield)
+            {
+                case 0x1: // 0001
+                    blendTex = 8;
+                    break;
+                case 0x9: // 1001
+                    blendTex = 2;
+                    break;
+                case 0x5: // 0101
+                    blendTex = 0; // TODO
+                    break;
+                case 0xE: // 1110
+                    blendTex = 0x80 + 0x8;
+                    break;
+                case 0xF: // 1111
+                    blendTex = 1;
+                    break;
+            }
+
+            if(blendTex != 0xFF)
+            {
+                break;
+            }
+
+            bitfield = ((bitfield << 1) | (bitfield >> 3)) & 0xF;
+            rotationCount++;
+        }
+
+        cell.textures[numTextures] = terrain[i];
+        cell.blendTextures[numTextures] = blendTex;
+        cell.rotations[numTextures] = rotationCount;
+        numTextures++;
+    }
+
+    while(numTextures < 4)
+    {
+        cell.textures[numTextures] = 0;
+        cell.blendTextures[numTextures] = 0;
+        cell.rotations[numTextures] = 0;
+        numTextures++;
+    }
+
+    cell.roadScale = 3;
+
+    {
+        uint8_t bitfield = 0;
+        uint8_t roadType = 0;
 
-            while(textures.size() < 4)
+        for(int j = 0; j < 4; j++)
+        {
+            if(road[j])
             {
-                textures.push_back(0);
-                blendTextures.push_back(0);
-                rotations.push_back(0);
+                bitfield |= (1 << j);
+                roadType = road[j];
             }
+        }
+
+        uint8_t rotationCount = 0;
+        uint8_t blendTex = 0xFF;
 
-            uint8_t roadScale = 3;
+        for(;;)
+        {
+            switch(bitfield)
+            {
+                case 0x0: // 0000
+                    blendTex = 0;
+                    break;
+                case 0x1: // 0001
+                    blendTex = 5;
+                    break;
+                case 0x9: // 1001
+                    blendTex = 2;
+                    break;
+                case 0x5: // 0101
+                    blendTex =  0xA;
+                    cell.roadScale = 1;
+                    break;
+                case 0xE: // 1110
+                    blendTex = 0x80 + 5;
+                    break;
+                case 0xF: // 1111
+                    blendTex = 1;
+                    break;
+            }
 
+            if(blendTex != 0xFF)
             {
-                uint8_t bitfield = 0;
-                uint8_t roadType = 0;
-
-                for(int j = 0; j < 4; j++)
-                {
-                    if(road[j])
-                    {
-                        bitfield |= (1 << j);
-                        roadType = road[j];
-                    }
-                }
-
-                uint8_t rotationCount = 0;
-                uint8_t blendTex = 0xFF;
-
-                for(;;)
-                {
-                    switch(bitfield)
-                    {
-                        case 0x0: // 0000
-                            blendTex = 0;
-                            break;
-                        case 0x1: // 0001
-                            blendTex = 5;
-                            break;
-                        case 0x9: // 1001
-                            blendTex = 2;
-                            break;
-                        case 0x5: // 0101
-                            blendTex =  0xA;
-                            roadScale = 1;
-                            break;
-                        case 0xE: // 1110
-                            blendTex = 0x80 + 5;
-                            break;
-                        case 0xF: // 1111
-                            blendTex = 1;
-                            break;
-                    }
-
-                    if(blendTex != 0xFF)
-                    {
-                        break;
-                    }
-
-                    bitfield = ((bitfield << 1) | (bitfield >> 3)) & 0xF;
-                    rotationCount++;
-                }
-
-                static const uint8_t kCommonRoad = 0x20;
-                static const uint8_t kRareRoad = 0x1F;
-
-                textures.push_back((roadType == 1) ? kCommonRoad : kRareRoad);
-                blendTextures.push_back(blendTex);
-                rotations.push_back(rotationCount);
+                break;
             }
 
-            // See LandVertexShader.glsl to see what these are
-            // Terrain textures are tiled twice per quad (this is specified in region)
-            // Hence the dx * 2 and dy *2
+            bitfield = ((bitfield << 1) | (bitfield >> 3)) & 0xF;
+            rotationCount++;
+        }
+
+        static const uint8_t kCommonRoad = 0x20;
+        static const uint8_t kRareRoad = 0x1F;
+
+        cell.textures[4] = (roadType == 1) ? kCommonRoad : kRareRoad;
+        cell.blendTextures[4] = blendTex;
+        cell.rotations[4] = rotationCount;
+    }
+
+    return cell;
+}
+
+void LandRenderData::initGeometry(const Land& land)
+{
+    vector<PackedLandVertex> vertexData;
+
+    // index of a vertex at each grid point, to copy for the skirts
+    size_t gridVertex[Land::kGridSize][Land::kGridSize];
+
+    for(uint8_t y = 0; y < Land::kGridSize - 1; y++)
+    {
+        for(uint8_t x = 0; x < Land::kGridSize - 1; x++)
+        {
+            LandCellTextures cell = calcLandCellTextures(land, x, y);
+
+            PackedLandVertex vertex;
+            memcpy(vertex.textures, cell.textures, 4);
+            memcpy(vertex.blendTextures, cell.blendTextures, 4);
+            vertex.road[0] = cell.textures[4];
+            vertex.road[1] = cell.blendTextures[4];
+            vertex.road[2] = static_cast<GLubyte>(cell.rotations[0] | (cell.rotations[1] << 2) | (cell.rotations[2] << 4) | (cell.rotations[3] << 6));
+            vertex.road[3] = static_cast<GLubyte>(cell.rotations[4] | (cell.roadScale << 2));
+
+            // See LandVertexShader.glsl for how the texture coordinates are rebuilt from the corner
 #define V(dx, dy) \
-    vertexData.push_back(static_cast<float>((x + (dx)) * 24)); \
-    vertexData.push_back(static_cast<float>((y + (dy)) * 24)); \
-    vertexData.push_back(land.getHeight(x + (dx), y + (dy))); \
-    vertexData.push_back(static_cast<float>((dx) * 2)); \
-    vertexData.push_back(static_cast<float>((dy) * 2)); \
-    pushRotatedCoord(vertexData, dx, dy, rotations[0], 1); \
-    vertexData.push_back(blendTextures[0]); \
-    vertexData.push_back(textures[0]); \
-    pushRotatedCoord(vertexData, dx, dy, rotations[1], 1); \
-    vertexData.push_back(blendTextures[1]); \
-    vertexData.push_back(textures[1]); \
-    pushRotatedCoord(vertexData, dx, dy, rotations[2], 1); \
-    vertexData.push_back(blendTextures[2]); \
-    vertexData.push_back(textures[2]); \
-    pushRotatedCoord(vertexData, dx, dy, rotations[3], 1); \
-    vertexData.push_back(blendTextures[3]); \
-    vertexData.push_back(textures[3]); \
-    pushRotatedCoord(vertexData, dx, dy, rotations[4], roadScale); \
-    vertexData.push_back(blendTextures[4]); \
-    vertexData.push_back(textures[4]);
+    gridVertex[x + (dx)][y + (dy)] = vertexData.size(); \
+    vertex.height = static_cast<GLfloat>(land.getHeight(x + (dx), y + (dy))); \
+    vertex.grid[0] = static_cast<GLubyte>(x + (dx)); \
+    vertex.grid[1] = static_cast<GLubyte>(y + (dy)); \
+    vertex.grid[2] = static_cast<GLubyte>((dx) | ((dy) << 1)); \
+    vertex.grid[3] = 0; \
+    vertexData.push_back(vertex);
 
             if(land.isSplitNESW(x, y))
             {
@@ -252,39 +288,61 @@ void LandRenderData::initGeometry(const Land& land)
         }
     }
 
-    static const int kComponentsPerVertex = 25;
+    vertexCount_ = static_cast<GLsizei>(vertexData.size());
+
+    // skirts hang down from the edges to hide cracks next to coarser distant terrain
+    fp_t minHeight = land.getHeight(0, 0);
+    fp_t maxHeight = minHeight;
+
+    for(int y = 0; y < Land::kGridSize; y++)
+    {
+        for(int x = 0; x < Land::kGridSize; x++)
+        {
+            minHeight = min(minHeight, land.getHeight(x, y));
+            maxHeight = max(maxHeight, land.getHeight(x, y));
+        }
+    }
+
+    GLfloat skirtDepth = static_cast<GLfloat>(maxHeight - minHeight + Land::kCellSize);
+
+    static const int last = Land::kGridSize - 1;
+
+    for(int i = 0; i < last; i++)
+    {
+        pushSkirt(vertexData, gridVertex[i][0], gridVertex[i + 1][0], skirtDepth);
+        pushSkirt(vertexData, gridVertex[i][last], gridVertex[i + 1][last], skirtDepth);
+        pushSkirt(vertexData, gridVertex[0][i], gridVertex[0][i + 1], skirtDepth);
+        pushSkirt(vertexData, gridVertex[last][i], gridVertex[last][i + 1], skirtDepth);
+    }
 
-    vertexCount_ = static_cast<GLsizei>(vertexData.size()) / kComponentsPerVertex;
+    skirtVertexCount_ = static_cast<GLsizei>(vertexData.size()) - vertexCount_;
 
     glGenVertexArrays(1, &vertexArray_);
     glBindVertexArray(vertexArray_);
 
     glGenBuffers(1, &vertexBuffer_);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
-    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(GLfloat), vertexData.data(), GL_STATIC_DRAW);
+    Core::get().renderer().uploadScheduler().bufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(PackedLandVertex), vertexData.data());
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), nullptr);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 3));
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 5));
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 9));
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 13));
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 17));
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, kComponentsPerVertex * sizeof(GLfloat), reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 21));
+    glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(PackedLandVertex), reinterpret_cast<GLvoid*>(offsetof(PackedLandVertex, height)));
+    glVertexAttribIPointer(1, 4, GL_UNSIGNED_BYTE, sizeof(PackedLandVertex), reinterpret_cast<GLvoid*>(offsetof(PackedLandVertex, grid)));
+    glVertexAttribIPointer(2, 4, GL_UNSIGNED_BYTE, sizeof(PackedLandVertex), reinterpret_cast<GLvoid*>(offsetof(PackedLandVertex, textures)));
+    glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(PackedLandVertex), reinterpret_cast<GLvoid*>(offsetof(PackedLandVertex, blendTextures)));
+    glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(PackedLandVertex), reinterpret_cast<GLvoid*>(offsetof(PackedLandVertex, road)));
 
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
     glEnableVertexAttribArray(3);
     glEnableVertexAttribArray(4);
-    glEnableVertexAttribArray(5);
-    glEnableVertexAttribArray(6);
 }
 
 void LandRenderData::initNormalTexture(const Land& land)
 {
     glGenTextures(1, &normalTexture_);
     glBindTexture(GL_TEXTURE_2D, normalTexture_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, Land::kOffsetMapSize, Land::kOffsetMapSize, 0, GL_RGB, GL_UNSIGNED_BYTE, land.normalMap());
+    Core::get().renderer().uploadScheduler().texImage2D(GL_RGB8, Land::kOffsetMapSize, Land::kOffsetMapSize, GL_RGB, GL_UNSIGNED_BYTE,
+        land.normalMap(), Land::kOffsetMapSize * Land::kOffsetMapSize * 3);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // default is GL_NEAREST_MIPMAP_LINEAR
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -16,23 +16,30 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "graphics/LandRenderer.h"
+#include "graphics/LandArray.h"
+#include "graphics/LandLodRenderData.h"
 #include "graphics/LandRenderData.h"
 #include "graphics/Renderer.h"
-#include "graphics/util.h"
+#include "graphics/UniformRing.h"
 #include "resource/ImgColor.h"
 #include "resource/ImgTex.h"
 #include "resource/Region.h"
 #include "Camera.h"
+#include "Config.h"
 #include "Core.h"
 #include "Land.h"
 #include "LandcellManager.h"
 #include "ResourceCache.h"
-#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
+#include <cstring>
 
 #include "graphics/shaders/LandVertexShader.h"
 #include "graphics/shaders/LandFragmentShader.h"
+#include "graphics/shaders/LandInstancedVertexShader.h"
+#include "graphics/shaders/LandInstancedFragmentShader.h"
+#include "graphics/shaders/LandLodVertexShader.h"
+#include "graphics/shaders/LandLodFragmentShader.h"
 
 static const int kTerrainArraySize = 512;
 
@@ -54,9 +61,49 @@ static const uint32_t kBlendTextures[] =
 static const int kBlendArraySize = 512;
 static const int kBlendArrayDepth = sizeof(kBlendTextures) / sizeof(kBlendTextures[0]);
 
-LandRenderer::LandRenderer()
+// only sample every nth pixel in each direction when averaging terrain textures
+static const int kTerrainColorStride = 4;
+
+// lands within the radius are drawn at full detail, the rest of the terrain radius at lower detail
+static bool isFullDetail(LandcellManager& landcellManager, int x, int y)
+{
+    if(x < 0x00 || x > 0xFF || y < 0x00 || y > 0xFF)
+    {
+        return false;
+    }
+
+    LandcellId id(x, y);
+    int radius = landcellManager.radius();
+
+    return landcellManager.center().calcSquareDistance(id) <= radius * radius &&
+        landcellManager.findSlot(id) != nullptr;
+}
+
+// lands are only translated, so the normal matrix in FrameConstants does for all of them
+static void bindWorldMatrix(const glm::vec3& position)
+{
+    DrawConstants constants;
+    constants.worldMatrix = glm::translate(glm::mat4{}, position);
+    constants.fade = 1.0f;
+
+    UniformRing& uniformRing = Core::get().renderer().uniformRing();
+    size_t offset = uniformRing.write(&constants, sizeof(constants));
+    uniformRing.bind(kDrawConstantsBinding, offset, sizeof(constants));
+}
+
+LandRenderer::LandRenderer() : lodChunkUploader_(lodChunks_, terrainColors_), lodFrame_(0)
 {
     initProgram();
+    initLodProgram();
+
+    if(Core::get().config().getBool("LandRenderer.instanced", false))
+    {
+        // enough layers for every land drawn at full detail
+        int radius = Core::get().landcellManager().radius();
+        landArray_.reset(new LandArray((radius * 2 + 1) * (radius * 2 + 1)));
+        initInstancedProgram();
+    }
+
     initTerrainTexture();
     initBlendTexture();
 }
@@ -64,13 +111,17 @@ LandRenderer::LandRenderer()
 LandRenderer::~LandRenderer()
 {
     program_.destroy();
+    instancedProgram_.destroy();
+    lodProgram_.destroy();
     glDeleteTextures(1, &terrainTexture_);
     glDeleteTextures(1, &blendTexture_);
 }
 
 void LandRenderer::render(const glm::mat4& projectionMat, const glm::mat4& viewMat)
 {
-    program_.use();
+    Program& program = landArray_ ? instancedProgram_ : program_;
+
+    program.use();
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D_ARRAY, terrainTexture_);
@@ -80,62 +131,274 @@ void LandRenderer::render(const glm::mat4& projectionMat, const glm::mat4& viewM
 
     LandcellManager& landcellManager = Core::get().landcellManager();
 
-    glm::vec3 cameraPosition = Core::get().camera().position();
-    glUniform4f(program_.getUniform("cameraPosition"),
-        static_cast<GLfloat>(cameraPosition.x),
-        static_cast<GLfloat>(cameraPosition.y),
-        static_cast<GLfloat>(cameraPosition.z), 1.0f);
-
-    glm::vec4 viewLightPosition = viewMat * glm::vec4{lightPosition_.x, lightPosition_.y, lightPosition_.z, 1.0};
-    glUniform3f(program_.getUniform("lightPosition"),
-        static_cast<GLfloat>(viewLightPosition.x),
-        static_cast<GLfloat>(viewLightPosition.y),
-        static_cast<GLfloat>(viewLightPosition.z));
-
-    for(auto& pair : landcellManager)
+    visibleLands_.clear();
+    cullBatch_.clear();
+
+    for(const LandcellManager::Slot* slot : landcellManager)
     {
-        if(pair.first.isStructure())
+        int x = slot->id.x();
+        int y = slot->id.y();
+
+        if(!isFullDetail(landcellManager, x, y))
         {
             continue;
         }
 
-        int dx = pair.first.x() - landcellManager.center().x();
-        int dy = pair.first.y() - landcellManager.center().y();
+        int dx = x - landcellManager.center().x();
+        int dy = y - landcellManager.center().y();
 
         glm::vec3 blockPosition{dx * 192.0, dy * 192.0, 0.0};
 
-        const Land& land = static_cast<const Land&>(*pair.second);
+        // skirts are only needed next to distant terrain
+        bool skirts = !isFullDetail(landcellManager, x - 1, y) ||
+            !isFullDetail(landcellManager, x + 1, y) ||
+            !isFullDetail(landcellManager, x, y - 1) ||
+            !isFullDetail(landcellManager, x, y + 1);
+
+        visibleLands_.push_back({slot->land.get(), blockPosition, skirts});
+
+        // skirts hang down as far as LandArray and LandRenderData make them
+        fp_t minHeight = slot->land->minHeight();
+        fp_t maxHeight = slot->land->maxHeight();
+
+        if(skirts)
+        {
+            minHeight -= maxHeight - minHeight + Land::kCellSize;
+        }
+
+        cullBatch_.addBox(
+            glm::vec3{blockPosition.x + Land::kBlockSize * 0.5, blockPosition.y + Land::kBlockSize * 0.5, (minHeight + maxHeight) * 0.5},
+            glm::vec3{Land::kBlockSize * 0.5, Land::kBlockSize * 0.5, (maxHeight - minHeight) * 0.5});
+    }
+
+    Frustum frustum(projectionMat * viewMat, Core::get().camera().position());
+    cullStats_.drawn = static_cast<int>(frustum.cull(cullBatch_, visible_));
+    cullStats_.culled = static_cast<int>(visibleLands_.size()) - cullStats_.drawn;
+
+    for(size_t i = 0; i < visibleLands_.size(); i++)
+    {
+        if(!visible_[i])
+        {
+            continue;
+        }
 
-        renderLand(land, projectionMat, viewMat, blockPosition);
+        const VisibleLand& visibleLand = visibleLands_[i];
+
+        if(landArray_)
+        {
+            landArray_->add(*visibleLand.land, glm::vec2{visibleLand.position.x, visibleLand.position.y}, visibleLand.skirts);
+        }
+        else
+        {
+            renderLand(*visibleLand.land, visibleLand.position, visibleLand.skirts);
+        }
     }
+
+    if(landArray_)
+    {
+        landArray_->render();
+    }
+
+    renderLod(frustum);
 }
 
-void LandRenderer::setLightPosition(const glm::vec3& lightPosition)
+size_t LandRenderer::upload(const void* item)
 {
-    lightPosition_ = lightPosition;
+    const Land& land = *static_cast<const Land*>(item);
+
+    if(land.renderData())
+    {
+        return 0;
+    }
+
+    land.renderData().reset(new LandRenderData(land));
+    return land.renderData()->calcSize();
 }
 
-void LandRenderer::renderLand(
-    const Land& land,
-    const glm::mat4& projectionMat,
-    const glm::mat4& viewMat,
-    const glm::vec3& position)
+const CullStats& LandRenderer::cullStats() const
 {
-    glm::mat4 worldMat = glm::translate(glm::mat4{}, position);
-
-    loadMat3ToUniform(glm::inverseTranspose(glm::mat3(viewMat * worldMat)), program_.getUniform("normalMatrix"));
-    loadMat4ToUniform(worldMat, program_.getUniform("worldMatrix"));
-    loadMat4ToUniform(viewMat, program_.getUniform("viewMatrix"));
-    loadMat4ToUniform(projectionMat, program_.getUniform("projectionMatrix"));
+    return cullStats_;
+}
 
+void LandRenderer::renderLand(const Land& land, const glm::vec3& position, bool skirts)
+{
     if(!land.renderData())
     {
-        land.renderData().reset(new LandRenderData(land));
+        // as big as it is on screen
+        glm::vec3 center = position + glm::vec3{Land::kBlockSize * 0.5, Land::kBlockSize * 0.5, 0.0};
+        float distance = static_cast<float>(glm::length(center - Core::get().camera().position()));
+        float radius = static_cast<float>(Land::kBlockSize * 0.5 * sqrt(2.0));
+        Core::get().renderer().uploadScheduler().request(*this, &land, radius / max(distance, 1.0f));
+        return;
     }
 
+    bindWorldMatrix(position);
+
     LandRenderData& landRenderData = static_cast<LandRenderData&>(*land.renderData());
 
-    landRenderData.render();
+    landRenderData.render(skirts);
+}
+
+void LandRenderer::renderLod(const Frustum& frustum)
+{
+    static const int kChunkSize = LandLodRenderData::kChunkSize;
+
+    lodProgram_.use();
+
+    LandcellManager& landcellManager = Core::get().landcellManager();
+    LandcellId center = landcellManager.center();
+    int radius = landcellManager.radius();
+    int terrainRadius = landcellManager.terrainRadius();
+    glm::vec3 cameraPosition = Core::get().camera().position();
+
+    lodFrame_++;
+    lodVisible_.clear();
+    lodCullBatch_.clear();
+
+    int minChunkX = max(center.x() - terrainRadius, 0) / kChunkSize;
+    int maxChunkX = min(center.x() + terrainRadius, 0xFF) / kChunkSize;
+    int minChunkY = max(center.y() - terrainRadius, 0) / kChunkSize;
+    int maxChunkY = min(center.y() + terrainRadius, 0xFF) / kChunkSize;
+
+    for(int cx = minChunkX; cx <= maxChunkX; cx++)
+    {
+        for(int cy = minChunkY; cy <= maxChunkY; cy++)
+        {
+            LandLodRenderData::Lands lands;
+            uint64_t mask = 0;
+
+            for(int bx = 0; bx < kChunkSize; bx++)
+            {
+                for(int by = 0; by < kChunkSize; by++)
+                {
+                    int x = cx * kChunkSize + bx;
+                    int y = cy * kChunkSize + by;
+
+                    lands[bx][by] = nullptr;
+
+                    if(center.calcSquareDistance(LandcellId(x, y)) > terrainRadius * terrainRadius ||
+                       isFullDetail(landcellManager, x, y))
+                    {
+                        continue;
+                    }
+
+                    lands[bx][by] = landcellManager.findTerrain(LandcellId(x, y));
+
+                    if(lands[bx][by] != nullptr)
+                    {
+                        mask |= uint64_t(1) << (bx * kChunkSize + by);
+                    }
+                }
+            }
+
+            if(mask == 0)
+            {
+                continue;
+            }
+
+            // distance in landblocks from the center to the nearest landblock in the chunk
+            int dx = max(max(cx * kChunkSize - center.x(), center.x() - (cx * kChunkSize + kChunkSize - 1)), 0);
+            int dy = max(max(cy * kChunkSize - center.y(), center.y() - (cy * kChunkSize + kChunkSize - 1)), 0);
+            int squareDistance = dx * dx + dy * dy;
+
+            // halve the detail every time the distance doubles
+            int level = 1;
+
+            while(level < LandLodRenderData::kMaxLevel && squareDistance > (radius << level) * (radius << level))
+            {
+                level++;
+            }
+
+            auto chunkIt = lodChunks_.insert(make_pair(LandcellId(cx * kChunkSize, cy * kChunkSize), LodChunk())).first;
+            LodChunk& chunk = chunkIt->second;
+            chunk.wantedLevel = level;
+            chunk.wantedMask = mask;
+            memcpy(chunk.lands, lands, sizeof(lands));
+            chunk.lastFrame = lodFrame_;
+
+            chunk.position = glm::vec3{
+                (cx * kChunkSize - center.x()) * Land::kBlockSize,
+                (cy * kChunkSize - center.y()) * Land::kBlockSize,
+                0.0};
+
+            fp_t halfSize = kChunkSize * Land::kBlockSize * fp_t(0.5);
+            glm::vec3 chunkCenter{chunk.position.x + halfSize, chunk.position.y + halfSize, 0.0};
+
+            if(!chunk.renderData || chunk.level != level || chunk.mask != mask)
+            {
+                // as big as it is on screen
+                float distance = static_cast<float>(glm::length(chunkCenter - cameraPosition));
+                float chunkRadius = static_cast<float>(halfSize * sqrt(2.0));
+                Core::get().renderer().uploadScheduler().request(lodChunkUploader_, &chunkIt->first, chunkRadius / max(distance, 1.0f));
+            }
+
+            // bounded by what was built, the lands may not be ready, so only their heights are used
+            if(chunk.renderData)
+            {
+                fp_t minHeight = chunk.renderData->minHeight();
+                fp_t maxHeight = chunk.renderData->maxHeight();
+                chunkCenter.z = (minHeight + maxHeight) * fp_t(0.5);
+
+                lodVisible_.push_back(&chunk);
+                lodCullBatch_.addBox(chunkCenter, glm::vec3{halfSize, halfSize, (maxHeight - minHeight) * fp_t(0.5)});
+            }
+        }
+    }
+
+    // chunks out of range are dropped, the rest are kept whether they're drawn or not
+    for(auto it = lodChunks_.begin(); it != lodChunks_.end(); /**/)
+    {
+        if(it->second.lastFrame != lodFrame_)
+        {
+            it = lodChunks_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    frustum.cull(lodCullBatch_, visible_);
+
+    for(size_t i = 0; i < lodVisible_.size(); i++)
+    {
+        if(!visible_[i])
+        {
+            continue;
+        }
+
+        bindWorldMatrix(lodVisible_[i]->position);
+
+        lodVisible_[i]->renderData->render();
+    }
+}
+
+LandRenderer::LodChunkUploader::LodChunkUploader(unordered_map<LandcellId, LodChunk>& chunks, const vector<glm::vec3>& terrainColors) :
+    chunks_(chunks), terrainColors_(terrainColors)
+{}
+
+size_t LandRenderer::LodChunkUploader::upload(const void* item)
+{
+    auto it = chunks_.find(*static_cast<const LandcellId*>(item));
+
+    if(it == chunks_.end())
+    {
+        return 0;
+    }
+
+    LodChunk& chunk = it->second;
+
+    if(chunk.renderData && chunk.level == chunk.wantedLevel && chunk.mask == chunk.wantedMask)
+    {
+        return 0;
+    }
+
+    // the lands were found this frame, and are still around until the next
+    chunk.renderData.reset(new LandLodRenderData(chunk.lands, chunk.wantedLevel, terrainColors_));
+    chunk.level = chunk.wantedLevel;
+    chunk.mask = chunk.wantedMask;
+
+    return chunk.renderData->calcSize();
 }
 
 void LandRenderer::initProgram()
@@ -165,6 +428,47 @@ void LandRenderer::initProgram()
     glUniform1f(program_.getUniform("shininess"), 1.0);
 }
 
+void LandRenderer::initInstancedProgram()
+{
+    instancedProgram_.create();
+    instancedProgram_.attach(GL_VERTEX_SHADER, LandInstancedVertexShader);
+    instancedProgram_.attach(GL_FRAGMENT_SHADER, LandInstancedFragmentShader);
+    instancedProgram_.link();
+
+    instancedProgram_.use();
+
+    // samplers, see LandArray::render
+    glUniform1i(instancedProgram_.getUniform("terrainTex"), 0);
+    glUniform1i(instancedProgram_.getUniform("blendTex"), 1);
+    glUniform1i(instancedProgram_.getUniform("normalArrayTex"), 2);
+    glUniform1i(instancedProgram_.getUniform("heightTex"), 3);
+    glUniform1i(instancedProgram_.getUniform("cellTex"), 4);
+
+    // lighting parameters, same as the per-land program
+    glUniform3f(instancedProgram_.getUniform("lightIntensity"), 1.0f, 1.0f, 1.0f);
+    glUniform3f(instancedProgram_.getUniform("Kd"), 0.7f, 0.7f, 0.7f);
+    glUniform3f(instancedProgram_.getUniform("Ka"), 0.5f, 0.5f, 0.5f);
+    glUniform3f(instancedProgram_.getUniform("Ks"), 0.0f, 0.0f, 0.0f);
+    glUniform1f(instancedProgram_.getUniform("shininess"), 1.0);
+}
+
+void LandRenderer::initLodProgram()
+{
+    lodProgram_.create();
+    lodProgram_.attach(GL_VERTEX_SHADER, LandLodVertexShader);
+    lodProgram_.attach(GL_FRAGMENT_SHADER, LandLodFragmentShader);
+    lodProgram_.link();
+
+    lodProgram_.use();
+
+    // lighting parameters, same as the full detail program
+    glUniform3f(lodProgram_.getUniform("lightIntensity"), 1.0f, 1.0f, 1.0f);
+    glUniform3f(lodProgram_.getUniform("Kd"), 0.7f, 0.7f, 0.7f);
+    glUniform3f(lodProgram_.getUniform("Ka"), 0.5f, 0.5f, 0.5f);
+    glUniform3f(lodProgram_.getUniform("Ks"), 0.0f, 0.0f, 0.0f);
+    glUniform1f(lodProgram_.getUniform("shininess"), 1.0);
+}
+
 void LandRenderer::initTerrainTexture()
 {
     const Region& region = Core::get().region();
@@ -195,6 +499,28 @@ void LandRenderer::initTerrainTexture()
         }
 
         glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, kTerrainArraySize, kTerrainArraySize, 1, GL_BGRA, GL_UNSIGNED_BYTE, image.data());
+
+        // average linear color for distant terrain
+        const uint8_t* pixels = image.data();
+        glm::vec3 sum{0.0, 0.0, 0.0};
+        int count = 0;
+
+        for(int y = 0; y < kTerrainArraySize; y += kTerrainColorStride)
+        {
+            for(int x = 0; x < kTerrainArraySize; x += kTerrainColorStride)
+            {
+                const uint8_t* pixel = pixels + (x + y * kTerrainArraySize) * 4;
+
+                // BGRA
+                sum = sum + glm::vec3{
+                    glm::pow(pixel[2] / fp_t(255.0), fp_t(2.2)),
+                    glm::pow(pixel[1] / fp_t(255.0), fp_t(2.2)),
+                    glm::pow(pixel[0] / fp_t(255.0), fp_t(2.2))};
+                count++;
+            }
+        }
+
+        terrainColors_.push_back(sum / static_cast<fp_t>(count));
     }
 
     glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
@@ -0,0 +1,265 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/MeshBuffer.h"
+#include "graphics/Renderer.h"
+#include "graphics/UploadScheduler.h"
+#include "Core.h"
+#include <algorithm>
+
+// Capacities the buffers start with, in vertices and indices
+static const size_t kInitialVertices = 64 * 1024;
+static const size_t kInitialIndices = 256 * 1024;
+
+float MeshBuffer::Stats::utilization() const
+{
+    size_t capacity = vertexCapacity + indexCapacity;
+    return capacity == 0 ? 0.0f : static_cast<float>(vertexUsed + indexUsed) / static_cast<float>(capacity);
+}
+
+float MeshBuffer::Stats::fragmentation() const
+{
+    return freeBytes == 0 ? 0.0f : 1.0f - static_cast<float>(largestFreeBytes) / static_cast<float>(freeBytes);
+}
+
+bool MeshBuffer::FreeList::allocate(size_t count, size_t& offset)
+{
+    for(auto it = ranges.begin(); it != ranges.end(); ++it)
+    {
+        if(it->second < count)
+        {
+            continue;
+        }
+
+        offset = it->first;
+        size_t remaining = it->second - count;
+        ranges.erase(it);
+
+        if(remaining != 0)
+        {
+            ranges[offset + count] = remaining;
+        }
+
+        used += count;
+        return true;
+    }
+
+    return false;
+}
+
+void MeshBuffer::FreeList::free(size_t offset, size_t count)
+{
+    used -= count;
+
+    auto next = ranges.lower_bound(offset);
+
+    // merge with the range after
+    if(next != ranges.end() && offset + count == next->first)
+    {
+        count += next->second;
+        next = ranges.erase(next);
+    }
+
+    // and the range before
+    if(next != ranges.begin())
+    {
+        auto prev = next;
+        --prev;
+
+        if(prev->first + prev->second == offset)
+        {
+            prev->second += count;
+            return;
+        }
+    }
+
+    ranges[offset] = count;
+}
+
+void MeshBuffer::FreeList::grow(size_t newCapacity)
+{
+    size_t oldCapacity = capacity;
+    capacity = newCapacity;
+
+    // counted as used by free
+    used += newCapacity - oldCapacity;
+    free(oldCapacity, newCapacity - oldCapacity);
+}
+
+MeshBuffer::MeshBuffer(size_t vertexSize, const vector<VertexAttribute>& attributes) :
+    vertexSize_(vertexSize),
+    attributes_(attributes),
+    allocations_(0)
+{
+    glGenVertexArrays(1, &vertexArray_);
+    glBindVertexArray(vertexArray_);
+
+    glGenBuffers(1, &vertexBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, kInitialVertices * vertexSize_, nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &indexBuffer_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, kInitialIndices * sizeof(uint16_t), nullptr, GL_STATIC_DRAW);
+
+    setAttributes();
+
+    for(const VertexAttribute& attribute : attributes_)
+    {
+        glEnableVertexAttribArray(attribute.index);
+    }
+
+    vertices_.grow(kInitialVertices);
+    indices_.grow(kInitialIndices);
+}
+
+MeshBuffer::~MeshBuffer()
+{
+    glDeleteVertexArrays(1, &vertexArray_);
+    glDeleteBuffers(1, &vertexBuffer_);
+    glDeleteBuffers(1, &indexBuffer_);
+}
+
+MeshBuffer::Allocation MeshBuffer::allocate(const void* vertexData, size_t vertexCount, const uint16_t* indexData, size_t indexCount)
+{
+    Allocation allocation;
+    allocation.vertexCount = vertexCount;
+    allocation.indexCount = indexCount;
+
+    if(vertexCount != 0)
+    {
+        allocation.vertexOffset = allocateVertices(vertexCount);
+    }
+
+    if(indexCount != 0)
+    {
+        allocation.indexOffset = allocateIndices(indexCount);
+    }
+
+    UploadScheduler& uploadScheduler = Core::get().renderer().uploadScheduler();
+
+    // the index buffer is bound by the vertex array
+    glBindVertexArray(vertexArray_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+
+    uploadScheduler.bufferSubData(GL_ARRAY_BUFFER, allocation.vertexOffset * vertexSize_, vertexCount * vertexSize_, vertexData);
+    uploadScheduler.bufferSubData(GL_ELEMENT_ARRAY_BUFFER, allocation.indexOffset * sizeof(uint16_t), indexCount * sizeof(uint16_t), indexData);
+
+    allocations_++;
+    return allocation;
+}
+
+void MeshBuffer::free(const Allocation& allocation)
+{
+    if(allocation.vertexCount != 0)
+    {
+        vertices_.free(allocation.vertexOffset, allocation.vertexCount);
+    }
+
+    if(allocation.indexCount != 0)
+    {
+        indices_.free(allocation.indexOffset, allocation.indexCount);
+    }
+
+    allocations_--;
+}
+
+GLuint MeshBuffer::vertexArray() const
+{
+    return vertexArray_;
+}
+
+MeshBuffer::Stats MeshBuffer::stats() const
+{
+    Stats stats;
+    stats.allocations = allocations_;
+    stats.vertexCapacity = vertices_.capacity * vertexSize_;
+    stats.vertexUsed = vertices_.used * vertexSize_;
+    stats.indexCapacity = indices_.capacity * sizeof(uint16_t);
+    stats.indexUsed = indices_.used * sizeof(uint16_t);
+
+    for(const pair<const size_t, size_t>& range : vertices_.ranges)
+    {
+        stats.freeRanges++;
+        stats.freeBytes += range.second * vertexSize_;
+        stats.largestFreeBytes = max(stats.largestFreeBytes, range.second * vertexSize_);
+    }
+
+    for(const pair<const size_t, size_t>& range : indices_.ranges)
+    {
+        stats.freeRanges++;
+        stats.freeBytes += range.second * sizeof(uint16_t);
+        stats.largestFreeBytes = max(stats.largestFreeBytes, range.second * sizeof(uint16_t));
+    }
+
+    return stats;
+}
+
+void MeshBuffer::growBuffer(GLenum target, GLuint& buffer, size_t oldSize, size_t newSize)
+{
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+
+    glDeleteBuffers(1, &buffer);
+    buffer = newBuffer;
+    glBindBuffer(target, buffer);
+}
+
+size_t MeshBuffer::allocateVertices(size_t count)
+{
+    size_t offset;
+
+    while(!vertices_.allocate(count, offset))
+    {
+        glBindVertexArray(vertexArray_);
+        growBuffer(GL_ARRAY_BUFFER, vertexBuffer_, vertices_.capacity * vertexSize_, vertices_.capacity * 2 * vertexSize_);
+        setAttributes();
+        vertices_.grow(vertices_.capacity * 2);
+    }
+
+    return offset;
+}
+
+size_t MeshBuffer::allocateIndices(size_t count)
+{
+    size_t offset;
+
+    while(!indices_.allocate(count, offset))
+    {
+        // binds the new buffer to the vertex array
+        glBindVertexArray(vertexArray_);
+        growBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_, indices_.capacity * sizeof(uint16_t), indices_.capacity * 2 * sizeof(uint16_t));
+        indices_.grow(indices_.capacity * 2);
+    }
+
+    return offset;
+}
+
+// with the vertex array and vertex buffer bound
+void MeshBuffer::setAttributes()
+{
+    for(const VertexAttribute& attribute : attributes_)
+    {
+        glVertexAttribPointer(attribute.index, attribute.size, attribute.type, attribute.normalized,
+            static_cast<GLsizei>(vertexSize_), reinterpret_cast<GLvoid*>(attribute.offset));
+    }
+}
@@ -0,0 +1,540 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/MeshBuilder.h"
+#include "Vertex.h"
+#include <algorithm>
+
+// Forsyth's tuning, for an LRU cache of kCacheSize
+static const int kCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f;
+
+// Indices are 16 bit and 0xFFFF is the primitive restart index
+static const size_t kMaxVertices = 0xFFFF;
+
+struct SortByTexSurface
+{
+    bool operator()(const TriangleFan* a, const TriangleFan* b) const
+    {
+        return a->surfaceIndex < b->surfaceIndex;
+    }
+};
+
+// a run of triangles and how much it faces away from the middle of its batch
+struct Cluster
+{
+    size_t first;
+    size_t count;
+    float facing;
+};
+
+struct SortByFacing
+{
+    bool operator()(const Cluster& a, const Cluster& b) const
+    {
+        return a.facing > b.facing;
+    }
+};
+
+static float calcVertexScore(int cachePosition, int remainingTriangles)
+{
+    if(remainingTriangles == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+
+    if(cachePosition >= 0)
+    {
+        if(cachePosition < 3)
+        {
+            // the last triangle's vertices are scored the same, so its winding doesn't matter
+            score = kLastTriangleScore;
+        }
+        else
+        {
+            score = pow(1.0f - static_cast<float>(cachePosition - 3) / (kCacheSize - 3), kCacheDecayPower);
+        }
+    }
+
+    // vertices with few triangles left are cleared out first, so they don't linger
+    score += kValenceBoostScale * pow(static_cast<float>(remainingTriangles), -kValenceBoostPower);
+
+    return score;
+}
+
+MeshBuilder::MeshBuilder(bool overdrawOrder) : overdrawOrder_(overdrawOrder)
+{}
+
+void MeshBuilder::build(
+    const vector<ResourcePtr>& surfaces,
+    const vector<Vertex>& vertices,
+    const vector<TriangleFan>& triangleFans,
+    const vector<TriangleFan>& hitTriangleFans,
+    const ResourcePtr& hitSurface)
+{
+    // Sort triangle fans by texture
+    vector<const TriangleFan*> sortedTriangleFans;
+
+    for(const TriangleFan& triangleFan : triangleFans)
+    {
+        sortedTriangleFans.push_back(&triangleFan);
+    }
+
+    sort(sortedTriangleFans.begin(), sortedTriangleFans.end(), SortByTexSurface());
+
+    for(const TriangleFan* triangleFan : sortedTriangleFans)
+    {
+        // Skip portal/lighting polygons
+        if(triangleFan->stipplingType == 0x04)
+        {
+            continue;
+        }
+
+        if(batches_.empty() || surfaces[triangleFan->surfaceIndex].get() != batches_.back().surface.get())
+        {
+            batches_.push_back({surfaces[triangleFan->surfaceIndex], 0});
+        }
+
+        addFan(vertices, *triangleFan, false);
+    }
+
+    if(hitSurface)
+    {
+        batches_.push_back({hitSurface, 0});
+
+        for(const TriangleFan& triangleFan : hitTriangleFans)
+        {
+            addFan(vertices, triangleFan, true);
+        }
+    }
+
+    stats_.vertices = static_cast<int>(vertexData_.size() / kComponentsPerVertex);
+    stats_.listCacheMisses = countCacheMisses(indexData_.data(), indexData_.size(), kReportCacheSize);
+
+    size_t first = 0;
+
+    for(const Batch& batch : batches_)
+    {
+        optimizeBatch(first, batch.indexCount);
+
+        if(overdrawOrder_)
+        {
+            orderForOverdraw(first, batch.indexCount);
+        }
+
+        first += batch.indexCount;
+    }
+
+    stats_.cacheMisses = countCacheMisses(indexData_.data(), indexData_.size(), kReportCacheSize);
+}
+
+const vector<float>& MeshBuilder::vertexData() const
+{
+    return vertexData_;
+}
+
+const vector<uint16_t>& MeshBuilder::indexData() const
+{
+    return indexData_;
+}
+
+const vector<MeshBuilder::Batch>& MeshBuilder::batches() const
+{
+    return batches_;
+}
+
+const MeshBuilder::Stats& MeshBuilder::stats() const
+{
+    return stats_;
+}
+
+int MeshBuilder::countCacheMisses(const uint16_t* indices, size_t count, int cacheSize)
+{
+    vector<int> cache(cacheSize, -1);
+    size_t next = 0;
+    int misses = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(find(cache.begin(), cache.end(), indices[i]) != cache.end())
+        {
+            continue;
+        }
+
+        cache[next] = indices[i];
+        next = (next + 1) % cache.size();
+        misses++;
+    }
+
+    return misses;
+}
+
+void MeshBuilder::addFan(const vector<Vertex>& vertices, const TriangleFan& triangleFan, bool hit)
+{
+    stats_.fanVertices += static_cast<int>(triangleFan.indices.size());
+
+    if(triangleFan.indices.size() < 3)
+    {
+        return;
+    }
+
+    uint16_t center = addVertex(vertices[triangleFan.indices[0].vertexIndex], triangleFan.indices[0], hit);
+    uint16_t last = addVertex(vertices[triangleFan.indices[1].vertexIndex], triangleFan.indices[1], hit);
+
+    for(size_t i = 2; i < triangleFan.indices.size(); i++)
+    {
+        uint16_t next = addVertex(vertices[triangleFan.indices[i].vertexIndex], triangleFan.indices[i], hit);
+
+        indexData_.push_back(center);
+        indexData_.push_back(last);
+        indexData_.push_back(next);
+        batches_.back().indexCount += 3;
+        stats_.triangles++;
+
+        last = next;
+    }
+}
+
+uint16_t MeshBuilder::addVertex(const Vertex& vertex, const TriangleFan::Index& index, bool hit)
+{
+    // hit geometry has no texture coordinates, so it doesn't share with the rest
+    bool textured = !hit && !vertex.texCoords.empty();
+    uint64_t key = (hit ? uint64_t(1) << 63 : 0) |
+        static_cast<uint64_t>(static_cast<uint32_t>(index.vertexIndex)) << 32 |
+        (textured ? static_cast<uint32_t>(index.texCoordIndex) : 0);
+
+    auto it = sharedVertices_.find(key);
+
+    if(it != sharedVertices_.end())
+    {
+        return it->second;
+    }
+
+    size_t shared = vertexData_.size() / kComponentsPerVertex;
+
+    if(shared >= kMaxVertices)
+    {
+        throw runtime_error("Too many vertices in mesh");
+    }
+
+    vertexData_.push_back(static_cast<float>(vertex.position.x));
+    vertexData_.push_back(static_cast<float>(vertex.position.y));
+    vertexData_.push_back(static_cast<float>(vertex.position.z));
+
+    vertexData_.push_back(static_cast<float>(vertex.normal.x));
+    vertexData_.push_back(static_cast<float>(vertex.normal.y));
+    vertexData_.push_back(static_cast<float>(vertex.normal.z));
+
+    if(textured)
+    {
+        vertexData_.push_back(static_cast<float>(vertex.texCoords[index.texCoordIndex].x));
+        vertexData_.push_back(static_cast<float>(vertex.texCoords[index.texCoordIndex].y));
+    }
+    else
+    {
+        vertexData_.push_back(0.0f);
+        vertexData_.push_back(0.0f);
+    }
+
+    sharedVertices_[key] = static_cast<uint16_t>(shared);
+    return static_cast<uint16_t>(shared);
+}
+
+// Forsyth's greedy ordering, the best scoring triangle next, looking only at the triangles of
+// vertices in the cache unless none are left
+void MeshBuilder::optimizeBatch(size_t first, size_t count)
+{
+    size_t numTriangles = count / 3;
+
+    if(numTriangles < 2)
+    {
+        return;
+    }
+
+    // batch local vertex numbers
+    unordered_map<uint16_t, int> localVertices;
+    vector<int> triangleVertices(count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        auto it = localVertices.find(indexData_[first + i]);
+
+        if(it == localVertices.end())
+        {
+            it = localVertices.insert(make_pair(indexData_[first + i], static_cast<int>(localVertices.size()))).first;
+        }
+
+        triangleVertices[i] = it->second;
+    }
+
+    size_t numVertices = localVertices.size();
+
+    // the triangles of each vertex, those not added yet first
+    vector<int> remaining(numVertices, 0);
+
+    for(int v : triangleVertices)
+    {
+        remaining[v]++;
+    }
+
+    vector<int> adjacencyStart(numVertices + 1, 0);
+
+    for(size_t v = 0; v < numVertices; v++)
+    {
+        adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+    }
+
+    vector<int> adjacency(count);
+    vector<int> adjacencyFill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        adjacency[adjacencyFill[triangleVertices[i]]++] = static_cast<int>(i / 3);
+    }
+
+    vector<int> cachePosition(numVertices, -1);
+    vector<float> vertexScore(numVertices);
+
+    for(size_t v = 0; v < numVertices; v++)
+    {
+        vertexScore[v] = calcVertexScore(-1, remaining[v]);
+    }
+
+    vector<float> triangleScore(numTriangles);
+    vector<uint8_t> added(numTriangles, 0);
+
+    for(size_t t = 0; t < numTriangles; t++)
+    {
+        triangleScore[t] = vertexScore[triangleVertices[t * 3]] +
+            vertexScore[triangleVertices[t * 3 + 1]] +
+            vertexScore[triangleVertices[t * 3 + 2]];
+    }
+
+    vector<int> cache;
+    vector<int> newCache;
+    vector<int> order;
+    order.reserve(numTriangles);
+
+    int best = static_cast<int>(max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+    while(order.size() < numTriangles)
+    {
+        if(best < 0)
+        {
+            // nothing in the cache has triangles left, start somewhere new
+            float bestScore = -1.0f;
+
+            for(size_t t = 0; t < numTriangles; t++)
+            {
+                if(!added[t] && triangleScore[t] > bestScore)
+                {
+                    best = static_cast<int>(t);
+                    bestScore = triangleScore[t];
+                }
+            }
+        }
+
+        order.push_back(best);
+        added[best] = 1;
+
+        newCache.clear();
+
+        for(int k = 0; k < 3; k++)
+        {
+            int v = triangleVertices[best * 3 + k];
+
+            // move the triangle past the ones not added yet
+            int begin = adjacencyStart[v];
+            int end = begin + remaining[v];
+
+            for(int j = begin; j < end; j++)
+            {
+                if(adjacency[j] == best)
+                {
+                    swap(adjacency[j], adjacency[end - 1]);
+                    break;
+                }
+            }
+
+            remaining[v]--;
+
+            if(find(newCache.begin(), newCache.end(), v) == newCache.end())
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        for(int v : cache)
+        {
+            if(find(newCache.begin(), newCache.end(), v) == newCache.end())
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        // rescore what's in the cache and what just fell out of it
+        for(size_t i = 0; i < newCache.size(); i++)
+        {
+            int v = newCache[i];
+            cachePosition[v] = i < static_cast<size_t>(kCacheSize) ? static_cast<int>(i) : -1;
+            vertexScore[v] = calcVertexScore(cachePosition[v], remaining[v]);
+        }
+
+        best = -1;
+        float bestScore = -1.0f;
+
+        for(int v : newCache)
+        {
+            for(int j = adjacencyStart[v]; j < adjacencyStart[v] + remaining[v]; j++)
+            {
+                int t = adjacency[j];
+
+                triangleScore[t] = vertexScore[triangleVertices[t * 3]] +
+                    vertexScore[triangleVertices[t * 3 + 1]] +
+                    vertexScore[triangleVertices[t * 3 + 2]];
+
+                if(triangleScore[t] > bestScore)
+                {
+                    best = t;
+                    bestScore = triangleScore[t];
+                }
+            }
+        }
+
+        if(newCache.size() > static_cast<size_t>(kCacheSize))
+        {
+            newCache.resize(kCacheSize);
+        }
+
+        cache.swap(newCache);
+    }
+
+    vector<uint16_t> reordered(count);
+
+    for(size_t i = 0; i < numTriangles; i++)
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            reordered[i * 3 + k] = indexData_[first + order[i] * 3 + k];
+        }
+    }
+
+    copy(reordered.begin(), reordered.end(), indexData_.begin() + first);
+}
+
+// after Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+void MeshBuilder::orderForOverdraw(size_t first, size_t count)
+{
+    size_t numTriangles = count / 3;
+
+    if(numTriangles < 2)
+    {
+        return;
+    }
+
+    // a cluster starts wherever a triangle misses the cache with every vertex, so
+    // moving clusters around costs little more than the misses already there
+    vector<Cluster> clusters;
+    vector<int> cache(kReportCacheSize, -1);
+    size_t next = 0;
+
+    for(size_t t = 0; t < numTriangles; t++)
+    {
+        int misses = 0;
+
+        for(int k = 0; k < 3; k++)
+        {
+            uint16_t index = indexData_[first + t * 3 + k];
+
+            if(find(cache.begin(), cache.end(), index) == cache.end())
+            {
+                cache[next] = index;
+                next = (next + 1) % cache.size();
+                misses++;
+            }
+        }
+
+        if(t == 0 || misses == 3)
+        {
+            clusters.push_back({t, 0, 0.0f});
+        }
+
+        clusters.back().count++;
+    }
+
+    if(clusters.size() < 2)
+    {
+        return;
+    }
+
+    glm::vec3 batchCenter;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        batchCenter += position(indexData_[first + i]);
+    }
+
+    batchCenter /= static_cast<fp_t>(count);
+
+    for(Cluster& cluster : clusters)
+    {
+        glm::vec3 center;
+        glm::vec3 normal;
+
+        for(size_t t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            glm::vec3 a = position(indexData_[first + t * 3]);
+            glm::vec3 b = position(indexData_[first + t * 3 + 1]);
+            glm::vec3 c = position(indexData_[first + t * 3 + 2]);
+
+            center += a + b + c;
+            normal += glm::cross(b - a, c - a); // area weighted
+        }
+
+        center /= static_cast<fp_t>(cluster.count * 3);
+
+        if(glm::length(normal) > fp_t(0.0))
+        {
+            cluster.facing = static_cast<float>(glm::dot(center - batchCenter, glm::normalize(normal)));
+        }
+    }
+
+    stable_sort(clusters.begin(), clusters.end(), SortByFacing());
+
+    vector<uint16_t> reordered;
+    reordered.reserve(count);
+
+    for(const Cluster& cluster : clusters)
+    {
+        reordered.insert(reordered.end(),
+            indexData_.begin() + first + cluster.first * 3,
+            indexData_.begin() + first + (cluster.first + cluster.count) * 3);
+    }
+
+    copy(reordered.begin(), reordered.end(), indexData_.begin() + first);
+}
+
+glm::vec3 MeshBuilder::position(uint16_t index) const
+{
+    const float* vertex = &vertexData_[index * kComponentsPerVertex];
+    return glm::vec3{vertex[0], vertex[1], vertex[2]};
+}
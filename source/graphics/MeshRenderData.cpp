@@ -16,8 +16,10 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "graphics/MeshRenderData.h"
+#include "graphics/MeshBuilder.h"
 #include "graphics/Renderer.h"
 #include "graphics/TextureRenderData.h"
+#include "graphics/UploadScheduler.h"
 #include "resource/Environment.h"
 #include "resource/ImgColor.h"
 #include "resource/ImgTex.h"
@@ -27,20 +29,60 @@
 #include "Core.h"
 #include "ResourceCache.h"
 #include "Structure.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+// Positions are 16 bit unsigned normalized over the bounds of the mesh, normals are signed
+// normalized 10:10:10:2 and texture coordinates are half floats, in half the 32 bytes of floats
+struct PackedVertex
+{
+    uint16_t position[4]; // the last is padding
+    uint32_t normal;
+    uint32_t texCoord;
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex has padding");
+
+static uint32_t packNormal(const glm::vec3& normal)
+{
+    uint32_t packed = 0;
+
+    for(int i = 0; i < 3; i++)
+    {
+        int value = static_cast<int>(round(glm::clamp(normal[i], fp_t(-1.0), fp_t(1.0)) * fp_t(511.0)));
+        packed |= (static_cast<uint32_t>(value) & 0x3FF) << (i * 10);
+    }
+
+    return packed;
+}
 
 // FIXME Not the neatest thing in the world
 // Ought to find an existing 0x08 file with a nice transparent surface
 static weak_ptr<const Resource> g_hitSurface;
 
-struct SortByTexSurface
+// textures are created when the upload scheduler gets to them
+struct TextureUploader : public UploadScheduler::Uploader
 {
-    bool operator()(const TriangleFan* a, const TriangleFan* b)
+    size_t upload(const void* item) override
     {
-        return a->surfaceIndex < b->surfaceIndex;
+        const ImgColor& imgColor = *static_cast<const ImgColor*>(item);
+
+        if(imgColor.renderData)
+        {
+            return 0;
+        }
+
+        imgColor.renderData.reset(new TextureRenderData{imgColor});
+        return imgColor.image.size();
     }
 };
 
+static TextureUploader g_textureUploader;
+
 MeshRenderData::MeshRenderData(const Model& model)
 {
     init(model.surfaces,
@@ -62,170 +104,163 @@ MeshRenderData::MeshRenderData(const Structure& structure)
 
 MeshRenderData::~MeshRenderData()
 {
-    glDeleteVertexArrays(1, &vertexArray_);
-    glDeleteBuffers(1, &vertexBuffer_);
-    glDeleteBuffers(1, &indexBuffer_);
+    shared_ptr<MeshBuffer> meshBuffer = meshBuffer_.lock();
+
+    if(meshBuffer)
+    {
+        meshBuffer->free(allocation_);
+    }
 }
 
-void MeshRenderData::render()
+size_t MeshRenderData::vertexSize()
 {
-    glBindVertexArray(vertexArray_);
-
-    int indexBase = 0;
+    return sizeof(PackedVertex);
+}
 
-    for(Batch& batch : batches_)
-    {
-        const ImgColor& imgColor = batch
-            .surface->cast<Surface>()
-            .imgTex->cast<ImgTex>()
-            .imgColor->cast<ImgColor>();
+vector<VertexAttribute> MeshRenderData::vertexAttributes()
+{
+    vector<VertexAttribute> attributes;
+    attributes.push_back({0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position)});
+    attributes.push_back({1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, normal)});
+    attributes.push_back({2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord)});
+    return attributes;
+}
 
-        if(!imgColor.renderData)
-        {
-            imgColor.renderData.reset(new TextureRenderData{imgColor});
-        }
+void MeshRenderData::enqueue(RenderQueue& queue, RenderQueue::Pass pass, float distance, float textureDistance, RenderQueue::Draw draw)
+{
+    draw.vertexArray = vertexArray_;
+    draw.mode = GL_TRIANGLES;
+    draw.worldMat = draw.worldMat * positionMat_;
+    draw.baseVertex = static_cast<GLint>(allocation_.vertexOffset);
 
-        TextureRenderData& renderData = static_cast<TextureRenderData&>(*imgColor.renderData);
+    size_t indexBase = allocation_.indexOffset;
 
-        glActiveTexture(GL_TEXTURE0);
-        renderData.bind();
+    for(const Batch& batch : batches_)
+    {
+        draw.texture = getTexture(batch, textureDistance);
+        draw.indexCount = batch.indexCount;
+        draw.indexOffset = indexBase * sizeof(uint16_t);
 
-        glDrawElements(GL_TRIANGLE_FAN, batch.indexCount, GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid*>(indexBase * sizeof(uint16_t)));
+        queue.add(pass, distance, draw);
 
         indexBase += batch.indexCount;
     }
 }
 
-void MeshRenderData::init(
-    const vector<ResourcePtr>& surfaces,
-    const vector<Vertex>& vertices,
-    const vector<TriangleFan>& triangleFans,
-    const vector<TriangleFan>& hitTriangleFans)
+void MeshRenderData::uploadTextures()
 {
-    // vx, vy, vz, nx, ny, nz, s, t
-    static const int kComponentsPerVertex = 8;
+    for(const Batch& batch : batches_)
+    {
+        g_textureUploader.upload(&getImgColor(batch));
+    }
+}
 
-    // Sort triangle fans by texture
-    vector<const TriangleFan*> sortedTriangleFans;
+const ImgColor& MeshRenderData::getImgColor(const Batch& batch)
+{
+    return batch
+        .surface->cast<Surface>()
+        .imgTex->cast<ImgTex>()
+        .imgColor->cast<ImgColor>();
+}
 
-    for(const TriangleFan& triangleFan : triangleFans)
+GLuint MeshRenderData::getTexture(const Batch& batch, float distance)
+{
+    const ImgColor& imgColor = getImgColor(batch);
+
+    if(!imgColor.renderData)
     {
-        sortedTriangleFans.push_back(&triangleFan);
+        // textures only know how far away they are
+        UploadScheduler& uploadScheduler = Core::get().renderer().uploadScheduler();
+        uploadScheduler.request(g_textureUploader, &imgColor, 1.0f / max(distance, 1.0f));
+        return uploadScheduler.placeholderTexture();
     }
 
-    sort(sortedTriangleFans.begin(), sortedTriangleFans.end(), SortByTexSurface());
+    TextureRenderData& texture = static_cast<TextureRenderData&>(*imgColor.renderData);
+    texture.touch(distance);
+    return texture.handle();
+}
 
-    // Build batches
-    vector<float> vertexData;
-    vector<uint16_t> indexData;
+const glm::mat4& MeshRenderData::positionMatrix() const
+{
+    return positionMat_;
+}
 
-    for(const TriangleFan* triangleFan : sortedTriangleFans)
-    {
-        // Skip portal/lighting polygons
-        if(triangleFan->stipplingType == 0x04)
-        {
-            continue;
-        }
+int MeshRenderData::triangleCount() const
+{
+    return triangleCount_;
+}
 
-        if(batches_.empty() || surfaces[triangleFan->surfaceIndex].get() != batches_.back().surface.get())
-        {
-            // Start a new batch
-            batches_.push_back({surfaces[triangleFan->surfaceIndex], 0});
-        }
-        else if(batches_.back().indexCount != 0)
-        {
-            // Starting a new triangle fan in existing batch
-            indexData.push_back(0xFFFF);
-            batches_.back().indexCount++;
-        }
+size_t MeshRenderData::calcSize() const
+{
+    return size_;
+}
 
-        for(const TriangleFan::Index& index : triangleFan->indices)
-        {
-            indexData.push_back(static_cast<uint16_t>(vertexData.size() / kComponentsPerVertex));
-            batches_.back().indexCount++;
-
-            const Vertex& vertex = vertices[index.vertexIndex];
-
-            vertexData.push_back(static_cast<float>(vertex.position.x));
-            vertexData.push_back(static_cast<float>(vertex.position.y));
-            vertexData.push_back(static_cast<float>(vertex.position.z));
-
-            vertexData.push_back(static_cast<float>(vertex.normal.x));
-            vertexData.push_back(static_cast<float>(vertex.normal.y));
-            vertexData.push_back(static_cast<float>(vertex.normal.z));
-
-            if(vertex.texCoords.empty())
-            {
-                vertexData.push_back(0.0f);
-                vertexData.push_back(0.0f);
-            }
-            else
-            {
-                vertexData.push_back(static_cast<float>(vertex.texCoords[index.texCoordIndex].x));
-                vertexData.push_back(static_cast<float>(vertex.texCoords[index.texCoordIndex].y));
-            }
-        }
-    }
+void MeshRenderData::init(
+    const vector<ResourcePtr>& surfaces,
+    const vector<Vertex>& vertices,
+    const vector<TriangleFan>& triangleFans,
+    const vector<TriangleFan>& hitTriangleFans)
+{
+    ResourcePtr hitSurface;
 
     if(Core::get().renderer().renderHitGeometry())
     {
-        ResourcePtr surface = g_hitSurface.lock();
+        hitSurface = g_hitSurface.lock();
 
-        if(!surface)
+        if(!hitSurface)
         {
             ResourcePtr imgColor{new ImgColor{0x800000FF}};
             ResourcePtr imgTex{new ImgTex{imgColor}};
-            surface.reset(new Surface{imgTex});
-            g_hitSurface = surface;
+            hitSurface.reset(new Surface{imgTex});
+            g_hitSurface = hitSurface;
         }
+    }
 
-        batches_.push_back({surface, 0});
+    MeshBuilder builder{Core::get().renderer().overdrawOrder()};
+    builder.build(surfaces, vertices, triangleFans, hitTriangleFans, hitSurface);
 
-        for(const TriangleFan& triangleFan : hitTriangleFans)
-        {
-            if(batches_.back().indexCount != 0)
-            {
-                indexData.push_back(0xFFFF);
-                batches_.back().indexCount++;
-            }
-
-            for(const TriangleFan::Index& index : triangleFan.indices)
-            {
-                indexData.push_back(static_cast<uint16_t>(vertexData.size() / kComponentsPerVertex));
-                batches_.back().indexCount++;
-
-                const Vertex& vertex = vertices[index.vertexIndex];
-
-                vertexData.push_back(static_cast<float>(vertex.position.x));
-                vertexData.push_back(static_cast<float>(vertex.position.y));
-                vertexData.push_back(static_cast<float>(vertex.position.z));
-
-                vertexData.push_back(static_cast<float>(vertex.normal.x));
-                vertexData.push_back(static_cast<float>(vertex.normal.y));
-                vertexData.push_back(static_cast<float>(vertex.normal.z));
-
-                vertexData.push_back(0.0f);
-                vertexData.push_back(0.0f);
-            }
-        }
+    const vector<float>& vertexData = builder.vertexData();
+    const vector<uint16_t>& indexData = builder.indexData();
+    size_t vertexCount = vertexData.size() / MeshBuilder::kComponentsPerVertex;
+
+    glm::vec3 boundsMin{numeric_limits<fp_t>::max()};
+    glm::vec3 boundsMax{-numeric_limits<fp_t>::max()};
+
+    for(size_t i = 0; i < vertexCount; i++)
+    {
+        const float* vertex = &vertexData[i * MeshBuilder::kComponentsPerVertex];
+        glm::vec3 position{vertex[0], vertex[1], vertex[2]};
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
     }
 
-    glGenVertexArrays(1, &vertexArray_);
-    glBindVertexArray(vertexArray_);
+    glm::vec3 extent = vertexCount == 0 ? glm::vec3{} : boundsMax - boundsMin;
+    positionMat_ = glm::scale(glm::translate(glm::mat4{}, vertexCount == 0 ? glm::vec3{} : boundsMin), extent);
 
-    glGenBuffers(1, &vertexBuffer_);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
-    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
+    vector<PackedVertex> packedData(vertexCount);
+
+    for(size_t i = 0; i < vertexCount; i++)
+    {
+        const float* vertex = &vertexData[i * MeshBuilder::kComponentsPerVertex];
+        PackedVertex& packed = packedData[i];
 
-    glGenBuffers(1, &indexBuffer_);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(uint16_t), indexData.data(), GL_STATIC_DRAW);
+        for(int j = 0; j < 3; j++)
+        {
+            fp_t normalized = extent[j] > fp_t(0.0) ? (vertex[j] - boundsMin[j]) / extent[j] : fp_t(0.0);
+            packed.position[j] = static_cast<uint16_t>(round(glm::clamp(normalized, fp_t(0.0), fp_t(1.0)) * fp_t(65535.0)));
+        }
+
+        packed.position[3] = 0;
+        packed.normal = packNormal(glm::vec3{vertex[3], vertex[4], vertex[5]});
+        packed.texCoord = glm::packHalf2x16(glm::vec2{vertex[6], vertex[7]});
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * kComponentsPerVertex, nullptr);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * kComponentsPerVertex, reinterpret_cast<GLvoid*>(sizeof(float) * 3));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * kComponentsPerVertex, reinterpret_cast<GLvoid*>(sizeof(float) * 6));
+    batches_ = builder.batches();
+    triangleCount_ = builder.stats().triangles;
+    size_ = packedData.size() * sizeof(PackedVertex) + indexData.size() * sizeof(uint16_t);
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+    shared_ptr<MeshBuffer> meshBuffer = Core::get().renderer().meshBuffer();
+    allocation_ = meshBuffer->allocate(packedData.data(), packedData.size(), indexData.data(), indexData.size());
+    meshBuffer_ = meshBuffer;
+    vertexArray_ = meshBuffer->vertexArray();
 }
@@ -17,71 +17,135 @@
  */
 #include "graphics/ModelRenderer.h"
 #include "graphics/MeshRenderData.h"
+#include "graphics/OcclusionCuller.h"
 #include "graphics/Renderer.h"
-#include "graphics/util.h"
+#include "graphics/UploadScheduler.h"
 #include "resource/AnimationFrame.h"
+#include "resource/DegradeInfo.h"
 #include "resource/Model.h"
 #include "resource/Setup.h"
 #include "Camera.h"
+#include "Config.h"
 #include "Core.h"
 #include "Land.h"
 #include "LandcellManager.h"
 #include "ObjectManager.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
+#include <functional>
 
-#include "graphics/shaders/ModelVertexShader.h"
-#include "graphics/shaders/ModelFragmentShader.h"
-
-struct CompareByDepth
+// the model at a level of a model's degrade info, null if it isn't loaded
+static const Model* getDegrade(const Model& model, size_t level)
 {
-    CompareByDepth()
+    if(model.degrades[level])
     {
-        cameraPos_ = Core::get().camera().position();
+        return &model.degrades[level]->cast<Model>();
     }
 
-    bool operator()(const ModelRenderer::DepthSortedModel& a, const ModelRenderer::DepthSortedModel& b) const
+    if(model.degradeInfo->cast<DegradeInfo>().degrades[level].modelId == model.resourceId())
     {
-        // descending order
-        return (cameraPos_ - a.worldPos).length() > (cameraPos_ - b.worldPos).length();
+        return &model;
     }
 
-    glm::vec3 cameraPos_;
+    return nullptr;
+}
+
+struct CompareByModel
+{
+    template<class T>
+    bool operator()(const T& a, const T& b) const
+    {
+        return less<const Model*>()(a.model, b.model);
+    }
 };
 
-ModelRenderer::ModelRenderer()
+ModelRenderer::ModelRenderer() : numDynamicModels_(0)
 {
-    program_.create();
-    program_.attach(GL_VERTEX_SHADER, ModelVertexShader);
-    program_.attach(GL_FRAGMENT_SHADER, ModelFragmentShader);
-    program_.link();
+    Config& config = Core::get().config();
+
+    instanced_ = config.getBool("ModelRenderer.instanced", true);
+    degrade_ = config.getBool("ModelRenderer.degrade", true);
+
+    impostorDistance_ = config.getFloat("ModelRenderer.impostorDistance", 384.0);
+    impostorFade_ = config.getFloat("ModelRenderer.impostorFade", 48.0);
+
+    if(impostorFade_ < 0.0)
+    {
+        throw runtime_error("Bad value for ModelRenderer.impostorFade");
+    }
+
+    if(impostorDistance_ > 0.0)
+    {
+        int atlasSize = config.getInt("ModelRenderer.impostorAtlasSize", 2048);
+        int cellSize = config.getInt("ModelRenderer.impostorCellSize", 64);
 
-    program_.use();
+        if(cellSize <= 0 || atlasSize / cellSize * (atlasSize / cellSize) < ImpostorRenderer::kViews)
+        {
+            throw runtime_error("Bad value for ModelRenderer.impostorCellSize");
+        }
+
+        impostorRenderer_.reset(new ImpostorRenderer(atlasSize, cellSize));
+    }
 
-    GLuint texLocation = program_.getUniform("tex");
-    glUniform1i(texLocation, 0);
+    if(instanced_)
+    {
+        glGenBuffers(1, &instanceBuffer_);
+    }
 }
 
 ModelRenderer::~ModelRenderer()
 {
-    program_.destroy();
+    if(instanced_)
+    {
+        glDeleteBuffers(1, &instanceBuffer_);
+    }
 }
 
-void ModelRenderer::render(const glm::mat4& projectionMat, const glm::mat4& viewMat)
+void ModelRenderer::bakeImpostors()
 {
-    program_.use();
+    if(!impostorRenderer_)
+    {
+        return;
+    }
+
+    ResourcePtr resource;
 
+    while(impostorRenderer_->nextBake(resource))
+    {
+        // collect the parts as if the resource were at the origin
+        visibleModels_.clear();
+        cullBatch_.clear();
+        addOne(resource, glm::mat4{}, 1.0f);
+
+        bakeParts_.clear();
+
+        for(const VisibleModel& visibleModel : visibleModels_)
+        {
+            // baking can't wait for the upload scheduler, the impostor would keep what's missing
+            MeshRenderData& mesh = getMesh(*visibleModel.model);
+            mesh.uploadTextures();
+            bakeParts_.push_back({visibleModel.model, &mesh, visibleModel.worldMat});
+        }
+
+        if(!bakeParts_.empty())
+        {
+            impostorRenderer_->bake(resource, bakeParts_);
+        }
+    }
+}
+
+void ModelRenderer::render(const glm::mat4& projectionMat, const glm::mat4& viewMat)
+{
     LandcellManager& landcellManager = Core::get().landcellManager();
     ObjectManager& objectManager = Core::get().objectManager();
-
     glm::vec3 cameraPosition = Core::get().camera().position();
-    glUniform4f(program_.getUniform("cameraPosition"),
-        static_cast<GLfloat>(cameraPosition.x),
-        static_cast<GLfloat>(cameraPosition.y),
-        static_cast<GLfloat>(cameraPosition.z), 1.0f);
 
-    // first pass, render solid objects and collect objects that need depth sorting
-    depthSortList_.clear();
+    // collect and cull everything, then queue what's left
+    visibleModels_.clear();
+    cullBatch_.clear();
+    objects_.clear();
+    impostors_.clear();
+    impostorCullBatch_.clear();
 
     for(auto& pair : objectManager)
     {
@@ -101,61 +165,172 @@ void ModelRenderer::render(const glm::mat4& projectionMat, const glm::mat4& view
         glm::mat4 translateMat = glm::translate(glm::mat4{}, blockPosition + object.location().position);
         glm::mat4 worldMat = translateMat * rotateMat;
 
-        renderOne(object.model(), projectionMat, viewMat, worldMat);
+        addObject(OcclusionCuller::objectKey(object.id()), object.model(), worldMat, 1.0f);
     }
 
-    for(auto& pair : landcellManager)
+    numDynamicModels_ = visibleModels_.size();
+
+    for(const LandcellManager::Slot* slot : landcellManager)
     {
-        int dx = pair.first.x() - landcellManager.center().x();
-        int dy = pair.first.y() - landcellManager.center().y();
+        int dx = slot->id.x() - landcellManager.center().x();
+        int dy = slot->id.y() - landcellManager.center().y();
 
         glm::mat4 blockTransform = glm::translate(glm::mat4{}, glm::vec3{dx * Land::kBlockSize, dy * Land::kBlockSize, 0.0});
 
-        for(const StaticObject& staticObject : pair.second->staticObjects())
+        const vector<StaticObject>& staticObjects = slot->land->staticObjects();
+
+        for(size_t i = 0; i < staticObjects.size(); i++)
+        {
+            const StaticObject& staticObject = staticObjects[i];
+            glm::mat4 worldMat = blockTransform * staticObject.transform;
+            float fade = 1.0f;
+
+            if(impostorRenderer_)
+            {
+                fade = addImpostor(staticObject.resource, worldMat, cameraPosition);
+            }
+
+            if(fade > 0.0f)
+            {
+                addObject(OcclusionCuller::staticObjectKey(slot->id, i), staticObject.resource, worldMat, fade);
+            }
+        }
+
+        for(const unique_ptr<Structure>& structure : slot->structures)
+        {
+            const vector<StaticObject>& structureObjects = structure->staticObjects();
+
+            for(size_t i = 0; i < structureObjects.size(); i++)
+            {
+                addObject(OcclusionCuller::staticObjectKey(structure->id(), i), structureObjects[i].resource,
+                    blockTransform * structureObjects[i].transform, 1.0f);
+            }
+        }
+    }
+
+    Frustum frustum(projectionMat * viewMat, cameraPosition);
+    cullStats_.drawn = static_cast<int>(frustum.cull(cullBatch_, visible_));
+    cullStats_.culled = static_cast<int>(visibleModels_.size()) - cullStats_.drawn;
+
+    if(OcclusionCuller* occlusionCuller = Core::get().renderer().occlusionCuller())
+    {
+        cullOccluded(*occlusionCuller);
+    }
+
+    if(impostorRenderer_)
+    {
+        renderImpostors(frustum);
+    }
+
+    instances_.clear();
+    fill(degradeTriangles_.begin(), degradeTriangles_.end(), 0);
+
+    for(size_t i = 0; i < visibleModels_.size(); i++)
+    {
+        if(!visible_[i])
+        {
+            continue;
+        }
+
+        const VisibleModel& visibleModel = visibleModels_[i];
+
+        // from the center of the bounds
+        glm::vec3 offset{cullBatch_.x[i] - cameraPosition.x, cullBatch_.y[i] - cameraPosition.y, cullBatch_.z[i] - cameraPosition.z};
+        float distance = static_cast<float>(glm::length(offset));
+
+        // degrade distances are in the model's own units
+        size_t level;
+        const Model* selected = &selectDegrade(*visibleModel.model, distance / visibleModel.scale, level);
+
+        if(!selected->renderData)
         {
-            renderOne(staticObject.resource, projectionMat, viewMat, blockTransform * staticObject.transform);
+            // as big as it is on screen
+            float priority = cullBatch_.radius[i] / max(distance, 1.0f);
+            Core::get().renderer().uploadScheduler().request(*this, selected, priority);
+
+            // until then the nearest level that's ready is drawn, usually the one drawn last frame
+            selected = findResidentDegrade(*visibleModel.model, level);
+
+            if(!selected)
+            {
+                continue;
+            }
+        }
+
+        const Model& model = *selected;
+
+        if(level >= degradeTriangles_.size())
+        {
+            degradeTriangles_.resize(level + 1, 0);
+        }
+
+        degradeTriangles_[level] += getMesh(model).triangleCount();
+
+        // fading models are drawn on their own, instances have no fade
+        if(instanced_ && i >= numDynamicModels_ && !model.needsDepthSort && visibleModel.fade == 1.0f)
+        {
+            instances_.push_back({&model, visibleModel.worldMat, distance});
+            continue;
         }
+
+        RenderQueue::Pass pass = model.needsDepthSort ? RenderQueue::Pass::kTransparent : RenderQueue::Pass::kOpaque;
+
+        enqueueModel(model, visibleModel.worldMat, pass, distance, visibleModel.fade);
     }
 
-    // second pass, sort and render objects that need depth sorting
-    sort(depthSortList_.begin(), depthSortList_.end(), CompareByDepth{});
+    if(!instances_.empty())
+    {
+        enqueueInstanced();
+    }
+}
+
+size_t ModelRenderer::upload(const void* item)
+{
+    const Model& model = *static_cast<const Model*>(item);
 
-    for(const DepthSortedModel& depthSortedModel : depthSortList_)
+    if(model.renderData)
     {
-        renderModel(*depthSortedModel.model,
-            projectionMat,
-            viewMat,
-            depthSortedModel.worldMat,
-            /*firstPass*/ false);
+        return 0;
     }
+
+    return getMesh(model).calcSize();
+}
+
+const CullStats& ModelRenderer::cullStats() const
+{
+    return cullStats_;
 }
 
-void ModelRenderer::renderOne(const ResourcePtr& resource,
-    const glm::mat4& projectionMat,
-    const glm::mat4& viewMat,
-    const glm::mat4& worldMat)
+const vector<int>& ModelRenderer::degradeTriangles() const
+{
+    return degradeTriangles_;
+}
+
+const CullStats& ModelRenderer::impostorCullStats() const
+{
+    return impostorCullStats_;
+}
+
+void ModelRenderer::addObject(uint64_t key, const ResourcePtr& resource, const glm::mat4& worldMat, float fade)
+{
+    size_t first = visibleModels_.size();
+    addOne(resource, worldMat, fade);
+    objects_.push_back({key, first, visibleModels_.size()});
+}
+
+void ModelRenderer::addOne(const ResourcePtr& resource, const glm::mat4& worldMat, float fade)
 {
     if(resource->resourceType() == ResourceType::kSetup)
     {
-        renderSetup(resource->cast<Setup>(),
-            projectionMat,
-            viewMat,
-            worldMat);
+        addSetup(resource->cast<Setup>(), worldMat, fade);
     }
     else if(resource->resourceType() == ResourceType::kModel)
     {
-        renderModel(resource->cast<Model>(),
-            projectionMat,
-            viewMat,
-            worldMat,
-            /*firstPass*/ true);
+        addModel(resource->cast<Model>(), worldMat, fade);
     }
 }
 
-void ModelRenderer::renderSetup(const Setup& setup,
-    const glm::mat4& projectionMat,
-    const glm::mat4& viewMat,
-    const glm::mat4& worldMat)
+void ModelRenderer::addSetup(const Setup& setup, const glm::mat4& worldMat, float fade)
 {
     const AnimationFrame& frame = setup.placementFrames.back();
 
@@ -166,35 +341,251 @@ void ModelRenderer::renderSetup(const Setup& setup,
 
         glm::mat4 subWorldMat = glm::translate(glm::mat4{}, location.position) * glm::mat4_cast(location.rotation) * glm::scale(glm::mat4(), scale);
 
-        renderOne(setup.models[i],
-            projectionMat,
-            viewMat,
-            worldMat * subWorldMat);
+        addOne(setup.models[i], worldMat * subWorldMat, fade);
     }
 }
 
-void ModelRenderer::renderModel(const Model& model,
-    const glm::mat4& projectionMat,
-    const glm::mat4& viewMat,
-    const glm::mat4& worldMat,
-    bool firstPass)
+void ModelRenderer::addModel(const Model& model, const glm::mat4& worldMat, float fade)
 {
-    if(firstPass && model.needsDepthSort)
+    // scenery is scaled, take the largest scale to be safe
+    fp_t scale = max(max(glm::length(glm::vec3{worldMat[0]}), glm::length(glm::vec3{worldMat[1]})), glm::length(glm::vec3{worldMat[2]}));
+
+    visibleModels_.push_back({&model, worldMat, scale, fade});
+
+    glm::vec4 center = worldMat * glm::vec4{model.bounds.center, 1.0};
+
+    cullBatch_.addSphere(glm::vec3{center.x, center.y, center.z}, model.bounds.radius * scale);
+}
+
+// how much of the mesh is left to draw, the impostor has the rest
+float ModelRenderer::addImpostor(const ResourcePtr& resource, const glm::mat4& worldMat, const glm::vec3& cameraPosition)
+{
+    fp_t distance = glm::length(glm::vec3{worldMat[3]} - cameraPosition);
+
+    if(distance <= impostorDistance_)
     {
-        glm::vec4 worldPos = worldMat * glm::vec4{0.0, 0.0, 0.0, 1.0};
-        depthSortList_.push_back({&model, worldMat, {worldPos.x, worldPos.y, worldPos.z}});
-        return;
+        return 1.0f;
+    }
+
+    Sphere bounds;
+    int slot = impostorRenderer_->find(resource, bounds);
+
+    if(slot < 0)
+    {
+        return 1.0f;
     }
 
-    loadMat4ToUniform(worldMat, program_.getUniform("worldMatrix"));
-    loadMat4ToUniform(projectionMat * viewMat, program_.getUniform("projectionViewMatrix"));
+    float fade = 1.0f;
+
+    if(distance < impostorDistance_ + impostorFade_)
+    {
+        fade = static_cast<float>((distance - impostorDistance_) / impostorFade_);
+    }
+
+    fp_t scale = max(max(glm::length(glm::vec3{worldMat[0]}), glm::length(glm::vec3{worldMat[1]})), glm::length(glm::vec3{worldMat[2]}));
+    glm::vec4 center = worldMat * glm::vec4{bounds.center, 1.0};
+    fp_t yaw = atan2(worldMat[0][1], worldMat[0][0]);
+
+    impostorCullBatch_.addSphere(glm::vec3{center}, bounds.radius * scale);
+
+    ImpostorRenderer::Instance instance;
+    instance.bounds = glm::vec4{glm::vec3{center}, bounds.radius * scale};
+    instance.info = glm::vec4{static_cast<fp_t>(slot), yaw, fade, 0.0};
+    impostors_.push_back(instance);
+
+    return 1.0f - fade;
+}
+
+void ModelRenderer::enqueueModel(const Model& model, const glm::mat4& worldMat, RenderQueue::Pass pass, float distance, float fade)
+{
+    Renderer& renderer = Core::get().renderer();
+
+    RenderQueue::Draw draw;
+    draw.program = &renderer.meshProgram();
+    draw.worldMat = worldMat;
+    draw.fade = fade;
+
+    getMesh(model).enqueue(renderer.renderQueue(), pass, distance, distance, draw);
+}
+
+void ModelRenderer::enqueueInstanced()
+{
+    sort(instances_.begin(), instances_.end(), CompareByModel());
+
+    instanceData_.clear();
+
+    for(const Instance& instance : instances_)
+    {
+        instanceData_.push_back(instance.worldMat * getMesh(*instance.model).positionMatrix());
+    }
 
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, instanceData_.size() * sizeof(glm::mat4), instanceData_.data(), GL_STREAM_DRAW);
+
+    Renderer& renderer = Core::get().renderer();
+
+    for(size_t first = 0; first < instances_.size(); /**/)
+    {
+        const Model& model = *instances_[first].model;
+
+        size_t last = first + 1;
+        float nearestDistance = instances_[first].distance;
+
+        while(last < instances_.size() && instances_[last].model == &model)
+        {
+            nearestDistance = min(nearestDistance, instances_[last].distance);
+            last++;
+        }
+
+        RenderQueue::Draw draw;
+        draw.program = &renderer.meshInstancedProgram();
+        draw.instanceBuffer = instanceBuffer_;
+        draw.instanceOffset = first * sizeof(glm::mat4);
+        draw.instanceCount = static_cast<GLsizei>(last - first);
+
+        // a group is spread out, so it's sorted as if it were at the camera,
+        // but its textures are only as near as its nearest instance
+        getMesh(model).enqueue(renderer.renderQueue(), RenderQueue::Pass::kOpaque, 0.0f, nearestDistance, draw);
+
+        first = last;
+    }
+}
+
+// objects are tested as a whole, by a box around their models
+void ModelRenderer::cullOccluded(OcclusionCuller& occlusionCuller)
+{
+    for(const VisibleObject& object : objects_)
+    {
+        glm::vec3 minPosition;
+        glm::vec3 maxPosition;
+        bool anyVisible = false;
+
+        for(size_t i = object.first; i < object.last; i++)
+        {
+            if(!visible_[i])
+            {
+                continue;
+            }
+
+            glm::vec3 center{cullBatch_.x[i], cullBatch_.y[i], cullBatch_.z[i]};
+            glm::vec3 extents{cullBatch_.extentX[i] + cullBatch_.radius[i],
+                cullBatch_.extentY[i] + cullBatch_.radius[i],
+                cullBatch_.extentZ[i] + cullBatch_.radius[i]};
+
+            minPosition = anyVisible ? glm::min(minPosition, center - extents) : center - extents;
+            maxPosition = anyVisible ? glm::max(maxPosition, center + extents) : center + extents;
+            anyVisible = true;
+        }
+
+        if(!anyVisible)
+        {
+            continue;
+        }
+
+        glm::vec3 center = (minPosition + maxPosition) * fp_t(0.5);
+        glm::vec3 extents = (maxPosition - minPosition) * fp_t(0.5);
+
+        if(!occlusionCuller.check(object.key, center, extents))
+        {
+            fill(visible_.begin() + object.first, visible_.begin() + object.last, 0);
+        }
+    }
+}
+
+void ModelRenderer::renderImpostors(const Frustum& frustum)
+{
+    impostorCullStats_.drawn = static_cast<int>(frustum.cull(impostorCullBatch_, impostorVisible_));
+    impostorCullStats_.culled = static_cast<int>(impostors_.size()) - impostorCullStats_.drawn;
+
+    visibleImpostors_.clear();
+
+    for(size_t i = 0; i < impostors_.size(); i++)
+    {
+        if(impostorVisible_[i])
+        {
+            visibleImpostors_.push_back(impostors_[i]);
+        }
+    }
+
+    impostorRenderer_->render(visibleImpostors_);
+}
+
+const Model& ModelRenderer::selectDegrade(const Model& model, fp_t distance, size_t& level) const
+{
+    level = 0;
+
+    if(!degrade_ || !model.degradeInfo)
+    {
+        return model;
+    }
+
+    const DegradeInfo& degradeInfo = model.degradeInfo->cast<DegradeInfo>();
+    size_t degrade = degradeInfo.findDegrade(distance);
+
+    if(model.degrades[degrade])
+    {
+        level = degrade;
+        return model.degrades[degrade]->cast<Model>();
+    }
+
+    // nothing less detailed is wanted, draw ourselves
+    while(level < degradeInfo.degrades.size() && degradeInfo.degrades[level].modelId != model.resourceId())
+    {
+        level++;
+    }
+
+    if(level == degradeInfo.degrades.size())
+    {
+        level = 0;
+    }
+
+    return model;
+}
+
+const Model* ModelRenderer::findResidentDegrade(const Model& model, size_t& level) const
+{
+    if(!degrade_ || !model.degradeInfo)
+    {
+        return nullptr;
+    }
+
+    size_t count = model.degrades.size();
+
+    for(size_t offset = 1; offset < count; offset++)
+    {
+        // more detailed first, that was drawn last frame when moving away
+        if(offset <= level)
+        {
+            const Model* degrade = getDegrade(model, level - offset);
+
+            if(degrade && degrade->renderData)
+            {
+                level -= offset;
+                return degrade;
+            }
+        }
+
+        if(level + offset < count)
+        {
+            const Model* degrade = getDegrade(model, level + offset);
+
+            if(degrade && degrade->renderData)
+            {
+                level += offset;
+                return degrade;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+MeshRenderData& ModelRenderer::getMesh(const Model& model)
+{
     if(!model.renderData)
     {
         model.renderData.reset(new MeshRenderData(model));
     }
 
-    MeshRenderData& renderData = static_cast<MeshRenderData&>(*model.renderData);
-
-    renderData.render();
+    return static_cast<MeshRenderData&>(*model.renderData);
 }
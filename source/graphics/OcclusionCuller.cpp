@@ -0,0 +1,266 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/OcclusionCuller.h"
+#include "Camera.h"
+#include "Core.h"
+
+#include "graphics/shaders/OcclusionVertexShader.h"
+#include "graphics/shaders/OcclusionFragmentShader.h"
+
+// boxes are grown by this, the world curves a little between their corners
+static const fp_t kBoxMargin = 0.25;
+
+// boxes this close to the camera may be cut by the near plane, they're visible
+static const fp_t kCameraMargin = 1.0;
+
+// entries not checked for this many frames are forgotten
+static const uint32_t kMaxAge = 120;
+
+static const int kNumBoxIndices = 36;
+
+// keys are a kind in the top 8 bits, an id in the next 32 and an index in the low 24
+enum KeyKind
+{
+    kObjectKey,
+    kStructureKey,
+    kStaticObjectKey
+};
+
+static uint64_t makeKey(KeyKind kind, uint32_t id, size_t index)
+{
+    assert(index < (1u << 24));
+    return (uint64_t(kind) << 56) | (uint64_t(id) << 24) | uint64_t(index);
+}
+
+OcclusionCuller::OcclusionCuller() : frame_(0)
+{
+    program_.create();
+    program_.attach(GL_VERTEX_SHADER, OcclusionVertexShader);
+    program_.attach(GL_FRAGMENT_SHADER, OcclusionFragmentShader);
+    program_.link();
+
+    boxCenter_.init(program_, "boxCenter");
+    boxExtents_.init(program_, "boxExtents");
+
+    initGeometry();
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    for(auto& pair : entries_)
+    {
+        glDeleteQueries(1, &pair.second.query);
+    }
+
+    if(!freeQueries_.empty())
+    {
+        glDeleteQueries(static_cast<GLsizei>(freeQueries_.size()), freeQueries_.data());
+    }
+
+    program_.destroy();
+    glDeleteVertexArrays(1, &vertexArray_);
+    glDeleteBuffers(1, &vertexBuffer_);
+    glDeleteBuffers(1, &indexBuffer_);
+}
+
+void OcclusionCuller::begin()
+{
+    frame_++;
+    stats_ = Stats();
+
+    for(auto it = entries_.begin(); it != entries_.end(); /**/)
+    {
+        Entry& entry = it->second;
+
+        if(entry.pending)
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if(available)
+            {
+                GLuint anySamples = GL_FALSE;
+                glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &anySamples);
+                entry.visible = anySamples != GL_FALSE;
+                entry.pending = false;
+            }
+        }
+
+        if(frame_ - entry.lastChecked > kMaxAge)
+        {
+            freeQueries_.push_back(entry.query);
+            it = entries_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+uint64_t OcclusionCuller::objectKey(ObjectId id)
+{
+    return makeKey(kObjectKey, id.value(), 0);
+}
+
+uint64_t OcclusionCuller::structureKey(LandcellId id)
+{
+    return makeKey(kStructureKey, id.value(), 0);
+}
+
+uint64_t OcclusionCuller::staticObjectKey(LandcellId id, size_t index)
+{
+    return makeKey(kStaticObjectKey, id.value(), index);
+}
+
+bool OcclusionCuller::check(uint64_t key, const glm::vec3& center, const glm::vec3& extents)
+{
+    stats_.checked++;
+
+    glm::vec3 grownExtents = extents + glm::vec3{kBoxMargin};
+    glm::vec3 offset = glm::abs(Core::get().camera().position() - center);
+
+    if(offset.x < grownExtents.x + kCameraMargin &&
+       offset.y < grownExtents.y + kCameraMargin &&
+       offset.z < grownExtents.z + kCameraMargin)
+    {
+        return true;
+    }
+
+    auto it = entries_.find(key);
+
+    if(it == entries_.end())
+    {
+        Entry entry;
+
+        if(freeQueries_.empty())
+        {
+            glGenQueries(1, &entry.query);
+        }
+        else
+        {
+            entry.query = freeQueries_.back();
+            freeQueries_.pop_back();
+        }
+
+        entry.pending = false;
+        entry.visible = true;
+
+        it = entries_.insert({key, entry}).first;
+    }
+
+    Entry& entry = it->second;
+    entry.lastChecked = frame_;
+
+    // a query can't be reused before it's read
+    if(!entry.pending)
+    {
+        tests_.push_back({entry.query, center, grownExtents});
+        entry.pending = true;
+    }
+
+    if(!entry.visible)
+    {
+        stats_.occluded++;
+    }
+
+    return entry.visible;
+}
+
+void OcclusionCuller::end()
+{
+    if(tests_.empty())
+    {
+        return;
+    }
+
+    program_.use();
+    glBindVertexArray(vertexArray_);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+
+    for(const Test& test : tests_)
+    {
+        boxCenter_.set(test.center);
+        boxExtents_.set(test.extents);
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, test.query);
+        glDrawElements(GL_TRIANGLES, kNumBoxIndices, GL_UNSIGNED_SHORT, nullptr);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+
+    tests_.clear();
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::stats() const
+{
+    return stats_;
+}
+
+float OcclusionCuller::occludedFraction() const
+{
+    if(stats_.checked == 0)
+    {
+        return 0.0f;
+    }
+
+    return static_cast<float>(stats_.occluded) / static_cast<float>(stats_.checked);
+}
+
+void OcclusionCuller::initGeometry()
+{
+    static const float kCorners[] =
+    {
+        -1.0f, -1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f,
+        -1.0f,  1.0f, -1.0f,
+         1.0f,  1.0f, -1.0f,
+        -1.0f, -1.0f,  1.0f,
+         1.0f, -1.0f,  1.0f,
+        -1.0f,  1.0f,  1.0f,
+         1.0f,  1.0f,  1.0f
+    };
+
+    static const uint16_t kIndices[kNumBoxIndices] =
+    {
+        0, 2, 1, 1, 2, 3, // -z
+        4, 5, 6, 5, 7, 6, // +z
+        0, 1, 4, 1, 5, 4, // -y
+        2, 6, 3, 3, 6, 7, // +y
+        0, 4, 2, 2, 4, 6, // -x
+        1, 3, 5, 3, 7, 5  // +x
+    };
+
+    glGenVertexArrays(1, &vertexArray_);
+    glBindVertexArray(vertexArray_);
+
+    glGenBuffers(1, &vertexBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(kCorners), kCorners, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &indexBuffer_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(kIndices), kIndices, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, nullptr);
+    glEnableVertexAttribArray(0);
+}
@@ -16,6 +16,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "graphics/Program.h"
+#include "graphics/UniformRing.h"
+#include <glm/gtc/type_ptr.hpp>
 
 Program::Program() : handle_(0)
 {}
@@ -78,6 +80,9 @@ void Program::link()
         err.append(log.data(), logLength);
         throw runtime_error(err);
     }
+
+    bindUniformBlock("FrameConstants", kFrameConstantsBinding);
+    bindUniformBlock("DrawConstants", kDrawConstantsBinding);
 }
 
 void Program::use()
@@ -116,3 +121,54 @@ void Program::destroy()
         handle_ = 0;
     }
 }
+
+GLuint Program::handle() const
+{
+    return handle_;
+}
+
+void Program::bindUniformBlock(const GLchar* name, GLuint binding)
+{
+    GLuint index = glGetUniformBlockIndex(handle_, name);
+
+    if(index != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(handle_, index, binding);
+    }
+}
+
+template<>
+void Uniform<GLint>::set(const GLint& value) const
+{
+    glUniform1i(location_, value);
+}
+
+template<>
+void Uniform<GLfloat>::set(const GLfloat& value) const
+{
+    glUniform1f(location_, value);
+}
+
+template<>
+void Uniform<glm::vec3>::set(const glm::vec3& value) const
+{
+    glUniform3fv(location_, 1, glm::value_ptr(value));
+}
+
+template<>
+void Uniform<glm::vec4>::set(const glm::vec4& value) const
+{
+    glUniform4fv(location_, 1, glm::value_ptr(value));
+}
+
+template<>
+void Uniform<glm::mat3>::set(const glm::mat3& value) const
+{
+    glUniformMatrix3fv(location_, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+template<>
+void Uniform<glm::mat4>::set(const glm::mat4& value) const
+{
+    glUniformMatrix4fv(location_, 1, GL_FALSE, glm::value_ptr(value));
+}
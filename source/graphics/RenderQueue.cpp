@@ -0,0 +1,327 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/RenderQueue.h"
+#include "graphics/Program.h"
+#include "graphics/UniformRing.h"
+#include <algorithm>
+#include <cstring>
+
+static const int kRadixBits = 8;
+static const int kRadixSize = 1 << kRadixBits;
+static const int kRadixPasses = 64 / kRadixBits;
+
+// opaque depth is in 1/16 units, up to 4096
+static const float kOpaqueDepthScale = 16.0f;
+
+static uint32_t floatBits(float value)
+{
+    // the bits of non-negative floats sort like the floats
+    value = max(value, 0.0f);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// draw constants written to the uniform ring at once, as a fraction of its size
+static const size_t kChunkFraction = 4;
+
+RenderQueue::RenderQueue(UniformRing& uniformRing) : uniformRing_(uniformRing)
+{}
+
+void RenderQueue::add(Pass pass, float distance, const Draw& draw)
+{
+    Packet packet;
+    packet.key = calcKey(pass, distance, draw);
+    packet.index = static_cast<uint32_t>(draws_.size());
+
+    draws_.push_back(draw);
+    packets_.push_back(packet);
+}
+
+void RenderQueue::sort()
+{
+    stats_ = Stats();
+    stats_.draws = static_cast<int>(packets_.size());
+    stats_.unsortedStateChanges = countStateChanges();
+
+    sortPackets();
+}
+
+void RenderQueue::submit(Pass pass, Program* overrideProgram)
+{
+    size_t stride = uniformRing_.align(sizeof(DrawConstants));
+    size_t chunkSize = max(uniformRing_.size() / kChunkFraction / stride, size_t(1));
+
+    Program* program = nullptr;
+    GLuint texture = 0;
+    GLuint vertexArray = 0;
+    GLuint instanceBuffer = 0;
+    size_t instanceOffset = 0;
+
+    glActiveTexture(GL_TEXTURE0);
+
+    for(size_t first = 0; first < packets_.size(); /**/)
+    {
+        // a chunk's draw constants are written right before it's drawn, so if writing them orphans
+        // the uniform ring, every draw that used the old storage has already been issued
+        size_t last = writeDrawConstants(pass, first, chunkSize, stride);
+
+        for(size_t i = first; i < last; i++)
+        {
+            const Packet& packet = packets_[i];
+
+            if((packet.key >> 62) != static_cast<uint64_t>(pass))
+            {
+                continue;
+            }
+
+            const Draw& draw = draws_[packet.index];
+            Program* drawProgram = overrideProgram ? overrideProgram : draw.program;
+
+            if(drawProgram != program)
+            {
+                program = drawProgram;
+                program->use();
+                stats_.stateChanges++;
+            }
+
+            if(draw.vertexArray != vertexArray)
+            {
+                vertexArray = draw.vertexArray;
+                glBindVertexArray(vertexArray);
+                instanceBuffer = 0;
+                stats_.stateChanges++;
+            }
+
+            if(draw.texture != texture)
+            {
+                texture = draw.texture;
+                glBindTexture(GL_TEXTURE_2D, texture);
+                stats_.stateChanges++;
+            }
+
+            const GLvoid* indices = reinterpret_cast<const GLvoid*>(draw.indexOffset);
+
+            if(draw.instanceCount == 0)
+            {
+                uniformRing_.bind(kDrawConstantsBinding, drawConstantsOffsets_[i], sizeof(DrawConstants));
+                glDrawElementsBaseVertex(draw.mode, draw.indexCount, GL_UNSIGNED_SHORT, indices, draw.baseVertex);
+            }
+            else
+            {
+                if(draw.instanceBuffer != instanceBuffer || draw.instanceOffset != instanceOffset)
+                {
+                    setInstanceAttributes(draw);
+                    instanceBuffer = draw.instanceBuffer;
+                    instanceOffset = draw.instanceOffset;
+                }
+
+                glDrawElementsInstancedBaseVertex(draw.mode, draw.indexCount, GL_UNSIGNED_SHORT, indices, draw.instanceCount, draw.baseVertex);
+            }
+        }
+
+        first = last;
+    }
+}
+
+void RenderQueue::clear()
+{
+    // instance buffers are respecified every frame, don't leave anything pointing into them
+    std::sort(instancedVertexArrays_.begin(), instancedVertexArrays_.end());
+    instancedVertexArrays_.erase(unique(instancedVertexArrays_.begin(), instancedVertexArrays_.end()), instancedVertexArrays_.end());
+
+    for(GLuint instancedVertexArray : instancedVertexArrays_)
+    {
+        glBindVertexArray(instancedVertexArray);
+
+        for(GLuint i = 0; i < 4; i++)
+        {
+            glDisableVertexAttribArray(3 + i);
+        }
+    }
+
+    instancedVertexArrays_.clear();
+    draws_.clear();
+    packets_.clear();
+}
+
+const RenderQueue::Stats& RenderQueue::stats() const
+{
+    return stats_;
+}
+
+uint64_t RenderQueue::calcKey(Pass pass, float distance, const Draw& draw)
+{
+    uint64_t program = draw.program->handle();
+    uint64_t texture = draw.texture;
+    uint64_t vertexArray = draw.vertexArray;
+    uint64_t key = static_cast<uint64_t>(pass) << 62;
+
+    if(pass == Pass::kOpaque)
+    {
+        uint64_t depth = static_cast<uint64_t>(min(distance * kOpaqueDepthScale, 65535.0f));
+
+        key |= (program & 0x3F) << 56;
+        key |= (texture & 0xFFFFF) << 36;
+        key |= (vertexArray & 0xFFFFF) << 16;
+        key |= depth;
+    }
+    else
+    {
+        // furthest first
+        uint64_t depth = ~floatBits(distance) & 0xFFFFFFFF;
+
+        key |= depth << 30;
+        key |= (program & 0x3F) << 24;
+        key |= (texture & 0xFFF) << 12;
+        key |= vertexArray & 0xFFF;
+    }
+
+    return key;
+}
+
+void RenderQueue::sortPackets()
+{
+    // least significant digit first, every digit counted in one go
+    vector<uint32_t> counts(kRadixPasses * kRadixSize, 0);
+
+    for(const Packet& packet : packets_)
+    {
+        for(int pass = 0; pass < kRadixPasses; pass++)
+        {
+            counts[pass * kRadixSize + ((packet.key >> (pass * kRadixBits)) & (kRadixSize - 1))]++;
+        }
+    }
+
+    scratch_.resize(packets_.size());
+
+    for(int pass = 0; pass < kRadixPasses; pass++)
+    {
+        uint32_t* passCounts = &counts[pass * kRadixSize];
+        int shift = pass * kRadixBits;
+
+        // skip digits that are the same for every key
+        if(packets_.empty() || passCounts[(packets_.front().key >> shift) & (kRadixSize - 1)] == packets_.size())
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+
+        for(int i = 0; i < kRadixSize; i++)
+        {
+            uint32_t count = passCounts[i];
+            passCounts[i] = offset;
+            offset += count;
+        }
+
+        for(const Packet& packet : packets_)
+        {
+            scratch_[passCounts[(packet.key >> shift) & (kRadixSize - 1)]++] = packet;
+        }
+
+        packets_.swap(scratch_);
+    }
+}
+
+int RenderQueue::countStateChanges() const
+{
+    int stateChanges = 0;
+    const Draw* last = nullptr;
+
+    for(const Packet& packet : packets_)
+    {
+        const Draw& draw = draws_[packet.index];
+
+        stateChanges += (!last || draw.program != last->program) ? 1 : 0;
+        stateChanges += (!last || draw.vertexArray != last->vertexArray) ? 1 : 0;
+        stateChanges += (!last || draw.texture != last->texture) ? 1 : 0;
+
+        last = &draw;
+    }
+
+    return stateChanges;
+}
+
+void RenderQueue::setInstanceAttributes(const Draw& draw)
+{
+    // GL 4.1 has no base instance, so point the attributes at the draw's matrices
+    glBindBuffer(GL_ARRAY_BUFFER, draw.instanceBuffer);
+
+    for(GLuint i = 0; i < 4; i++)
+    {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<GLvoid*>(draw.instanceOffset + sizeof(glm::vec4) * i));
+        glVertexAttribDivisor(3 + i, 1);
+        glEnableVertexAttribArray(3 + i);
+    }
+
+    instancedVertexArrays_.push_back(draw.vertexArray);
+}
+
+size_t RenderQueue::writeDrawConstants(Pass pass, size_t first, size_t chunkSize, size_t stride)
+{
+    drawConstantsOffsets_.resize(packets_.size());
+
+    size_t i = first;
+
+    for(/**/; i < packets_.size() && chunkPackets_.size() < chunkSize; i++)
+    {
+        const Packet& packet = packets_[i];
+
+        if((packet.key >> 62) != static_cast<uint64_t>(pass) || draws_[packet.index].instanceCount != 0)
+        {
+            continue;
+        }
+
+        chunkPackets_.push_back(i);
+    }
+
+    flushDrawConstants(stride);
+
+    return i;
+}
+
+void RenderQueue::flushDrawConstants(size_t stride)
+{
+    if(chunkPackets_.empty())
+    {
+        return;
+    }
+
+    chunkData_.resize(chunkPackets_.size() * stride);
+
+    for(size_t i = 0; i < chunkPackets_.size(); i++)
+    {
+        const Draw& draw = draws_[packets_[chunkPackets_[i]].index];
+
+        DrawConstants constants;
+        constants.worldMatrix = draw.worldMat;
+        constants.fade = draw.fade;
+        memcpy(&chunkData_[i * stride], &constants, sizeof(constants));
+    }
+
+    size_t offset = uniformRing_.write(chunkData_.data(), chunkData_.size());
+
+    for(size_t i = 0; i < chunkPackets_.size(); i++)
+    {
+        drawConstantsOffsets_[chunkPackets_[i]] = offset + i * stride;
+    }
+
+    chunkPackets_.clear();
+}
@@ -16,24 +16,50 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "graphics/Renderer.h"
+#include "graphics/Frustum.h"
 #include "graphics/LandRenderer.h"
+#include "graphics/MeshBuffer.h"
+#include "graphics/MeshRenderData.h"
 #include "graphics/ModelRenderer.h"
+#include "graphics/OcclusionCuller.h"
+#include "graphics/Program.h"
+#include "graphics/RenderQueue.h"
 #include "graphics/SkyRenderer.h"
 #include "graphics/StructureRenderer.h"
+#include "graphics/TextureResidency.h"
+#include "graphics/TransparencyBuffer.h"
+#include "graphics/UniformRing.h"
+#include "graphics/UploadScheduler.h"
 #include "Camera.h"
 #include "Config.h"
 #include "Core.h"
+#include "Land.h"
+#include "LandcellManager.h"
+#include "Log.h"
 #include "util.h"
+#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 #ifdef OCULUSVR
 #include <SDL_syswm.h>
-#include <algorithm>
 #endif
 
-Renderer::Renderer() : videoInit_(false), window_(nullptr), context_(nullptr)
+#include "graphics/shaders/ModelVertexShader.h"
+#include "graphics/shaders/ModelInstancedVertexShader.h"
+#include "graphics/shaders/ModelFragmentShader.h"
+
+// far enough to see all of the distant terrain
+static fp_t calcFarPlane()
+{
+    int terrainRadius = Core::get().landcellManager().terrainRadius();
+    return max(fp_t(1000.0), (terrainRadius + 1) * Land::kBlockSize);
+}
+
+Renderer::Renderer() : framesSinceStats_(0), videoInit_(false), window_(nullptr), context_(nullptr)
 #ifdef OCULUSVR
     , hmd_(nullptr), renderTex_(0), depthTex_(0), framebuffer_(0)
 #endif
+    , frameConstantsBuffer_(0)
 {
     if(SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
     {
@@ -118,6 +144,8 @@ Renderer::Renderer() : videoInit_(false), window_(nullptr), context_(nullptr)
     }
 
     renderHitGeometry_ = config.getBool("Renderer.renderHitGeometry", false);
+    overdrawOrder_ = config.getBool("Renderer.overdrawOrder", false);
+    statsInterval_ = config.getInt("Renderer.statsInterval", 0);
 }
 
 Renderer::~Renderer()
@@ -126,6 +154,20 @@ Renderer::~Renderer()
     landRenderer_.reset();
     structureRenderer_.reset();
     skyRenderer_.reset();
+    meshProgram_.reset();
+    meshInstancedProgram_.reset();
+    transparencyBuffer_.reset();
+    occlusionCuller_.reset();
+    renderQueue_.reset();
+    textureResidency_.reset();
+    meshBuffer_.reset();
+    uploadScheduler_.reset();
+    uniformRing_.reset();
+
+    if(frameConstantsBuffer_ != 0)
+    {
+        glDeleteBuffers(1, &frameConstantsBuffer_);
+    }
 
 #ifdef OCULUSVR
     cleanupOVR();
@@ -163,12 +205,39 @@ void Renderer::init()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // MiB
+    int uniformRingSize = Core::get().config().getInt("Renderer.uniformRingSize", 4);
+
+    if(uniformRingSize <= 0)
+    {
+        throw runtime_error("Bad value for Renderer.uniformRingSize");
+    }
+
+    glGenBuffers(1, &frameConstantsBuffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameConstantsBuffer_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), nullptr, GL_STREAM_DRAW);
+
+    uniformRing_.reset(new UniformRing(static_cast<size_t>(uniformRingSize) * 1024 * 1024));
+    uploadScheduler_.reset(new UploadScheduler());
+    textureResidency_.reset(new TextureResidency());
+    meshBuffer_.reset(new MeshBuffer(MeshRenderData::vertexSize(), MeshRenderData::vertexAttributes()));
+    renderQueue_.reset(new RenderQueue(*uniformRing_));
+    initMeshPrograms();
+
+    if(Core::get().config().getBool("Renderer.orderIndependentTransparency", false))
+    {
+        transparencyBuffer_.reset(new TransparencyBuffer());
+    }
+
+    if(Core::get().config().getBool("Renderer.occlusionCulling", true))
+    {
+        occlusionCuller_.reset(new OcclusionCuller());
+    }
+
     skyRenderer_.reset(new SkyRenderer());
     landRenderer_.reset(new LandRenderer());
     structureRenderer_.reset(new StructureRenderer());
     modelRenderer_.reset(new ModelRenderer());
-
-    landRenderer_->setLightPosition(skyRenderer_->sunVector() * fp_t(1000.0));
 }
 
 void Renderer::render(fp_t interp)
@@ -186,18 +255,17 @@ void Renderer::render(fp_t interp)
     SDL_GetWindowSize(window_, &windowWidth, &windowHeight);
 
     // projection * view * model * vertex
-    glm::mat4 projectionMat = glm::perspective(fieldOfView_ / fp_t(180.0) * pi(), static_cast<fp_t>(windowWidth) / static_cast<fp_t>(windowHeight), fp_t(0.1), fp_t(1000.0));
+    glm::mat4 projectionMat = glm::perspective(fieldOfView_ / fp_t(180.0) * pi(), static_cast<fp_t>(windowWidth) / static_cast<fp_t>(windowHeight), fp_t(0.1), calcFarPlane());
 
     const glm::mat4& viewMat = Core::get().camera().viewMatrix();
 
     glClear(GL_DEPTH_BUFFER_BIT);
 
-    skyRenderer_->render();
-    landRenderer_->render(projectionMat, viewMat);
-    structureRenderer_->render(projectionMat, viewMat);
-    modelRenderer_->render(projectionMat, viewMat);
+    renderScene(projectionMat, viewMat);
 
     SDL_GL_SwapWindow(window_);
+
+    logStats();
 }
 
 GLenum Renderer::textureMinFilter() const
@@ -215,6 +283,225 @@ bool Renderer::renderHitGeometry() const
     return renderHitGeometry_;
 }
 
+bool Renderer::overdrawOrder() const
+{
+    return overdrawOrder_;
+}
+
+RenderQueue& Renderer::renderQueue()
+{
+    return *renderQueue_;
+}
+
+UniformRing& Renderer::uniformRing()
+{
+    return *uniformRing_;
+}
+
+UploadScheduler& Renderer::uploadScheduler()
+{
+    return *uploadScheduler_;
+}
+
+const shared_ptr<MeshBuffer>& Renderer::meshBuffer()
+{
+    return meshBuffer_;
+}
+
+TextureResidency& Renderer::textureResidency()
+{
+    return *textureResidency_;
+}
+
+OcclusionCuller* Renderer::occlusionCuller()
+{
+    return occlusionCuller_.get();
+}
+
+Program& Renderer::meshProgram()
+{
+    return *meshProgram_;
+}
+
+Program& Renderer::meshInstancedProgram()
+{
+    return *meshInstancedProgram_;
+}
+
+void Renderer::initMeshPrograms()
+{
+    meshProgram_.reset(new Program());
+    meshProgram_->create();
+    meshProgram_->attach(GL_VERTEX_SHADER, ModelVertexShader);
+    meshProgram_->attach(GL_FRAGMENT_SHADER, ModelFragmentShader);
+    meshProgram_->link();
+
+    meshProgram_->use();
+    glUniform1i(meshProgram_->getUniform("tex"), 0);
+
+    meshInstancedProgram_.reset(new Program());
+    meshInstancedProgram_->create();
+    meshInstancedProgram_->attach(GL_VERTEX_SHADER, ModelInstancedVertexShader);
+    meshInstancedProgram_->attach(GL_FRAGMENT_SHADER, ModelFragmentShader);
+    meshInstancedProgram_->link();
+
+    meshInstancedProgram_->use();
+    glUniform1i(meshInstancedProgram_->getUniform("tex"), 0);
+}
+
+void Renderer::bindFrameConstants(const glm::mat4& projectionMat, const glm::mat4& viewMat, const glm::vec3& cameraPosition)
+{
+    glm::vec3 lightPosition = skyRenderer_->sunVector() * fp_t(1000.0);
+
+    // lands are only translated, so the normal matrix is the same for all of them
+    glm::mat3 normalMat = glm::inverseTranspose(glm::mat3(viewMat));
+
+    FrameConstants constants;
+    constants.projectionMatrix = projectionMat;
+    constants.viewMatrix = viewMat;
+    constants.projectionViewMatrix = projectionMat * viewMat;
+
+    for(int i = 0; i < 3; i++)
+    {
+        constants.normalMatrix[i] = glm::vec4(normalMat[i], 0.0);
+    }
+
+    constants.cameraPosition = glm::vec4(cameraPosition, 1.0);
+    constants.lightPosition = glm::vec3(viewMat * glm::vec4(lightPosition, 1.0));
+    constants.worldRadius = static_cast<float>(Frustum::kWorldRadius);
+
+    // draws already issued keep what they were issued with
+    glBindBuffer(GL_UNIFORM_BUFFER, frameConstantsBuffer_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(constants), &constants, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kFrameConstantsBinding, frameConstantsBuffer_);
+}
+
+void Renderer::renderScene(const glm::mat4& projectionMat, const glm::mat4& viewMat)
+{
+    // before the frame constants are bound, baking binds its own
+    modelRenderer_->bakeImpostors();
+
+    bindFrameConstants(projectionMat, viewMat, Core::get().camera().position());
+
+    if(occlusionCuller_)
+    {
+        occlusionCuller_->begin();
+    }
+
+    skyRenderer_->render();
+    landRenderer_->render(projectionMat, viewMat);
+
+    // these queue their draws
+    structureRenderer_->render(projectionMat, viewMat);
+    modelRenderer_->render(projectionMat, viewMat);
+
+    renderQueue_->sort();
+    renderQueue_->submit(RenderQueue::Pass::kOpaque);
+
+    // against the depth of everything opaque, for next frame
+    if(occlusionCuller_)
+    {
+        occlusionCuller_->end();
+    }
+
+    if(transparencyBuffer_)
+    {
+        transparencyBuffer_->begin();
+        renderQueue_->submit(RenderQueue::Pass::kTransparent, &transparencyBuffer_->program());
+        transparencyBuffer_->end();
+    }
+    else
+    {
+        renderQueue_->submit(RenderQueue::Pass::kTransparent);
+    }
+
+    renderQueue_->clear();
+
+    // what was missing from this scene, for the next
+    uploadScheduler_->run();
+    textureResidency_->update();
+}
+
+void Renderer::logStats()
+{
+    if(statsInterval_ <= 0 || ++framesSinceStats_ < statsInterval_)
+    {
+        return;
+    }
+
+    framesSinceStats_ = 0;
+
+    const CullStats& land = landRenderer_->cullStats();
+    const CullStats& structures = structureRenderer_->cullStats();
+    const CullStats& models = modelRenderer_->cullStats();
+    const CullStats& impostors = modelRenderer_->impostorCullStats();
+    const RenderQueue::Stats& queue = renderQueue_->stats();
+
+    LOG(Misc, Info) << "drawn/culled lands=" << land.drawn << "/" << land.culled
+        << " structures=" << structures.drawn << "/" << structures.culled
+        << " models=" << models.drawn << "/" << models.culled
+        << " impostors=" << impostors.drawn << "/" << impostors.culled << "\n";
+
+    const vector<int>& degradeTriangles = modelRenderer_->degradeTriangles();
+    ostream& os = LOG(Misc, Info) << "model triangles by degrade";
+
+    for(size_t i = 0; i < degradeTriangles.size(); i++)
+    {
+        os << " " << i << "=" << degradeTriangles[i];
+    }
+
+    os << "\n";
+
+    LOG(Misc, Info) << "queued draws=" << queue.draws
+        << " state changes unsorted=" << queue.unsortedStateChanges
+        << " sorted=" << queue.stateChanges << "\n";
+
+    const UploadScheduler::Stats& uploads = uploadScheduler_->stats();
+
+    LOG(Misc, Info) << "uploads requested=" << uploads.requested
+        << " uploaded=" << uploads.uploaded
+        << " bytes=" << uploads.bytes << "\n";
+
+    MeshBuffer::Stats meshes = meshBuffer_->stats();
+
+    LOG(Misc, Info) << "mesh buffer allocations=" << meshes.allocations
+        << " vertex bytes=" << meshes.vertexUsed << "/" << meshes.vertexCapacity
+        << " index bytes=" << meshes.indexUsed << "/" << meshes.indexCapacity
+        << " utilization=" << meshes.utilization()
+        << " free ranges=" << meshes.freeRanges
+        << " fragmentation=" << meshes.fragmentation() << "\n";
+
+    // full detail lands have their own buffers, outside the mesh buffer
+    int lands = 0;
+    size_t landBytes = 0;
+
+    for(const LandcellManager::Slot* slot : Core::get().landcellManager())
+    {
+        if(slot->land->renderData())
+        {
+            lands++;
+            landBytes += slot->land->renderData()->calcSize();
+        }
+    }
+
+    LOG(Misc, Info) << "land render data lands=" << lands << " bytes=" << landBytes << "\n";
+
+    const TextureResidency::Stats& textures = textureResidency_->stats();
+
+    LOG(Misc, Info) << "textures resident=" << textures.textures
+        << " bytes=" << textures.bytes
+        << " evicted=" << textures.evicted << "\n";
+
+    if(occlusionCuller_)
+    {
+        const OcclusionCuller::Stats& occlusion = occlusionCuller_->stats();
+
+        LOG(Misc, Info) << "occlusion checked=" << occlusion.checked
+            << " occluded=" << occlusion.occluded
+            << " fraction=" << occlusionCuller_->occludedFraction() << "\n";
+    }
+}
+
 void Renderer::createWindow()
 {
     Config& config = Core::get().config();
@@ -445,7 +732,7 @@ void Renderer::renderOVR(fp_t interp)
         glViewport(eyeViewport_[eye].Pos.x, eyeViewport_[eye].Pos.y,
                    eyeViewport_[eye].Size.w, eyeViewport_[eye].Size.h);
 
-        glm::mat4 projectionMat = convertOvrMatrix4f(ovrMatrix4f_Projection(eyeRenderDesc_[eye].Fov, 0.1f, 1000.0f, /*rightHanded*/ true));
+        glm::mat4 projectionMat = convertOvrMatrix4f(ovrMatrix4f_Projection(eyeRenderDesc_[eye].Fov, 0.1f, static_cast<float>(calcFarPlane()), /*rightHanded*/ true));
 
         eyePose[eye] = ovrHmd_GetEyePose(hmd_, eye);
         Core::get().camera().setHeadPosition(convertOvrVector3f(eyePose[eye].Position));
@@ -454,10 +741,7 @@ void Renderer::renderOVR(fp_t interp)
         glm::mat4 viewMat = glm::translate(glm::mat4{}, convertOvrVector3f(eyeRenderDesc_[eye].ViewAdjust));
         viewMat = viewMat * Core::get().camera().viewMatrix();
 
-        skyRenderer_->render();
-        landRenderer_->render(projectionMat, viewMat);
-        structureRenderer_->render(projectionMat, viewMat);
-        modelRenderer_->render(projectionMat, viewMat);
+        renderScene(projectionMat, viewMat);
     }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -17,7 +17,6 @@
  */
 #include "graphics/SkyRenderer.h"
 #include "graphics/SkyModel.h"
-#include "graphics/util.h"
 #include "Camera.h"
 #include "Core.h"
 
@@ -47,9 +46,7 @@ void SkyRenderer::render()
 {
     program_.use();
 
-    glm::mat4 rotationMat = glm::mat4_cast(glm::conjugate(Core::get().camera().rotationQuat()));
-
-    loadMat4ToUniform(rotationMat, program_.getUniform("rotationMat"));
+    rotationMat_.set(glm::mat4_cast(glm::conjugate(Core::get().camera().rotationQuat())));
 
     glBindVertexArray(vertexArray_);
 
@@ -69,6 +66,8 @@ void SkyRenderer::initProgram()
     program_.attach(GL_VERTEX_SHADER, SkyVertexShader);
     program_.attach(GL_FRAGMENT_SHADER, SkyFragmentShader);
     program_.link();
+
+    rotationMat_.init(program_, "rotationMat");
 }
 
 void SkyRenderer::initGeometry()
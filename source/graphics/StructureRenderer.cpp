@@ -17,82 +17,451 @@
  */
 #include "graphics/StructureRenderer.h"
 #include "graphics/MeshRenderData.h"
+#include "graphics/OcclusionCuller.h"
 #include "graphics/Renderer.h"
-#include "graphics/util.h"
 #include "Camera.h"
+#include "Config.h"
 #include "Core.h"
 #include "Landcell.h"
 #include "LandcellManager.h"
 #include "Structure.h"
+#include "TriangleFan.h"
+#include "Vertex.h"
+#include "resource/Environment.h"
 #include <glm/gtc/matrix_transform.hpp>
 
-// We're sharing shaders with the model renderer for now
-#include "graphics/shaders/ModelVertexShader.h"
-#include "graphics/shaders/ModelFragmentShader.h"
+// Flooding further than this through portals is almost certainly a loop
+static const int kMaxPortalDepth = 16;
 
-StructureRenderer::StructureRenderer()
+// How far outside of the bounds of its part the camera can be and still be in a structure
+static const fp_t kCameraCellMargin = 0.5;
+
+// Cells are indexed from 0x100 in a landblock
+static const uint16_t kFirstStructure = 0x100;
+
+// Keep at least this many mesh cache entries before pruning expired ones
+static const size_t kMinMeshesPruneSize = 256;
+
+static bool intersect(const glm::vec2& minA, const glm::vec2& maxA, glm::vec2& minB, glm::vec2& maxB)
 {
-    program_.create();
-    program_.attach(GL_VERTEX_SHADER, ModelVertexShader);
-    program_.attach(GL_FRAGMENT_SHADER, ModelFragmentShader);
-    program_.link();
+    minB = glm::max(minA, minB);
+    maxB = glm::min(maxA, maxB);
+    return minB.x < maxB.x && minB.y < maxB.y;
+}
 
-    program_.use();
+static glm::mat4 calcWorldMat(const Structure& structure, const glm::vec3& blockPosition)
+{
+    return glm::translate(glm::mat4{}, blockPosition + structure.location().position) * glm::mat4_cast(structure.location().rotation);
+}
 
-    GLuint texLocation = program_.getUniform("tex");
-    glUniform1i(texLocation, 0);
+size_t StructureRenderer::Tag::calcSize() const
+{
+    return mesh->calcSize() / mesh.use_count();
 }
 
-StructureRenderer::~StructureRenderer()
+bool StructureRenderer::MeshKey::operator<(const MeshKey& other) const
 {
-    program_.destroy();
+    if(environmentId != other.environmentId)
+    {
+        return environmentId < other.environmentId;
+    }
+
+    if(partNum != other.partNum)
+    {
+        return partNum < other.partNum;
+    }
+
+    return surfaceIds < other.surfaceIds;
 }
 
-void StructureRenderer::render(const glm::mat4& projectionMat, const glm::mat4& viewMat)
+StructureRenderer::StructureRenderer() :
+    meshesPruneSize_(kMinMeshesPruneSize),
+    cameraSlot_(nullptr), cameraStructure_(nullptr), seesOutside_(false)
 {
-    program_.use();
+    portalCulling_ = Core::get().config().getBool("StructureRenderer.portalCulling", true);
+}
+
+StructureRenderer::~StructureRenderer()
+{}
 
+void StructureRenderer::render(const glm::mat4& projectionMat, const glm::mat4& viewMat)
+{
     LandcellManager& landcellManager = Core::get().landcellManager();
 
     glm::vec3 cameraPosition = Core::get().camera().position();
-    glUniform4f(program_.getUniform("cameraPosition"), GLfloat(cameraPosition.x), GLfloat(cameraPosition.y), GLfloat(cameraPosition.z), 1.0f);
 
-    for(auto& pair : landcellManager)
+    projectionViewMat_ = projectionMat * viewMat;
+
+    cameraSlot_ = nullptr;
+    cameraStructure_ = nullptr;
+    seesOutside_ = true;
+    visibleStructures_.clear();
+    cullBatch_.clear();
+
+    if(portalCulling_)
+    {
+        int cameraX = int(floor(cameraPosition.x / 192.0)) + landcellManager.center().x();
+        int cameraY = int(floor(cameraPosition.y / 192.0)) + landcellManager.center().y();
+
+        if(cameraX >= 0 && cameraX <= 0xFF && cameraY >= 0 && cameraY <= 0xFF)
+        {
+            cameraSlot_ = landcellManager.findSlot(LandcellId(cameraX, cameraY));
+        }
+
+        if(cameraSlot_)
+        {
+            cameraBlockPosition_ = glm::vec3{
+                (cameraX - landcellManager.center().x()) * 192.0,
+                (cameraY - landcellManager.center().y()) * 192.0,
+                0.0};
+
+            cameraStructure_ = findCameraStructure(*cameraSlot_, cameraBlockPosition_);
+        }
+    }
+
+    if(cameraStructure_)
+    {
+        reached_.assign(cameraSlot_->structures.size(), false);
+        onPath_.assign(cameraSlot_->structures.size(), false);
+        seesOutside_ = false;
+
+        PortalView view;
+        view.min = glm::vec2{-1.0, -1.0};
+        view.max = glm::vec2{1.0, 1.0};
+
+        onPath_[cameraStructure_->id().n() - kFirstStructure] = true;
+        flood(*cameraStructure_, view, 0);
+
+        for(size_t i = 0; i < reached_.size(); i++)
+        {
+            if(reached_[i])
+            {
+                addStructure(*cameraSlot_->structures[i], cameraBlockPosition_);
+            }
+        }
+    }
+
+    if(seesOutside_)
+    {
+        addSeenOutside();
+    }
+
+    Frustum frustum(projectionViewMat_, cameraPosition);
+    cullStats_.drawn = static_cast<int>(frustum.cull(cullBatch_, visible_));
+    cullStats_.culled = static_cast<int>(visibleStructures_.size()) - cullStats_.drawn;
+
+    OcclusionCuller* occlusionCuller = Core::get().renderer().occlusionCuller();
+
+    for(size_t i = 0; i < visibleStructures_.size(); i++)
     {
-        if(!pair.first.isStructure())
+        if(!visible_[i])
+        {
+            continue;
+        }
+
+        const VisibleStructure& visibleStructure = visibleStructures_[i];
+
+        if(occlusionCuller)
+        {
+            glm::vec3 center{cullBatch_.x[i], cullBatch_.y[i], cullBatch_.z[i]};
+            glm::vec3 extents{cullBatch_.extentX[i], cullBatch_.extentY[i], cullBatch_.extentZ[i]};
+
+            if(!occlusionCuller->check(OcclusionCuller::structureKey(visibleStructure.structure->id()), center, extents))
+            {
+                continue;
+            }
+        }
+
+        enqueueStructure(*visibleStructure.structure, visibleStructure.blockPosition);
+    }
+}
+
+const CullStats& StructureRenderer::cullStats() const
+{
+    return cullStats_;
+}
+
+const Structure* StructureRenderer::findCameraStructure(const LandcellManager::Slot& slot, const glm::vec3& blockPosition) const
+{
+    // The cell BSP isn't kept, so we go by the bounds of the parts and take the tightest fit
+    glm::vec3 cameraPosition = Core::get().camera().position();
+
+    const Structure* result = nullptr;
+    fp_t resultVolume = 0.0;
+
+    for(const unique_ptr<Structure>& structure : slot.structures)
+    {
+        const Location& location = structure->location();
+        glm::vec3 localPosition = glm::conjugate(location.rotation) * (cameraPosition - blockPosition - location.position);
+
+        const CellStruct& part = structure->environment().parts[structure->partNum()];
+
+        if(localPosition.x < part.boundsMin.x - kCameraCellMargin || localPosition.x > part.boundsMax.x + kCameraCellMargin ||
+           localPosition.y < part.boundsMin.y - kCameraCellMargin || localPosition.y > part.boundsMax.y + kCameraCellMargin ||
+           localPosition.z < part.boundsMin.z - kCameraCellMargin || localPosition.z > part.boundsMax.z + kCameraCellMargin)
+        {
+            continue;
+        }
+
+        glm::vec3 size = part.boundsMax - part.boundsMin;
+        fp_t volume = size.x * size.y * size.z;
+
+        if(!result || volume < resultVolume)
+        {
+            result = structure.get();
+            resultVolume = volume;
+        }
+    }
+
+    return result;
+}
+
+void StructureRenderer::flood(const Structure& structure, const PortalView& view, int depth)
+{
+    reached_[structure.id().n() - kFirstStructure] = true;
+
+    if(depth == kMaxPortalDepth)
+    {
+        return;
+    }
+
+    for(const Structure::Portal& portal : structure.portals())
+    {
+        if(portal.cellId != Structure::kOutsideCellId)
+        {
+            if(portal.cellId < kFirstStructure || portal.cellId - kFirstStructure >= int(onPath_.size()))
+            {
+                continue;
+            }
+
+            if(onPath_[portal.cellId - kFirstStructure] || !cameraStructure_->canSee(portal.cellId))
+            {
+                continue;
+            }
+        }
+        else if(seesOutside_)
+        {
+            continue;
+        }
+
+        PortalView portalView;
+
+        if(!calcPortalView(structure, portal, portalView) ||
+           !intersect(view.min, view.max, portalView.min, portalView.max))
+        {
+            continue;
+        }
+
+        if(portal.cellId == Structure::kOutsideCellId)
         {
+            seesOutside_ = true;
             continue;
         }
 
-        int dx = pair.first.x() - landcellManager.center().x();
-        int dy = pair.first.y() - landcellManager.center().y();
+        onPath_[portal.cellId - kFirstStructure] = true;
+        flood(*cameraSlot_->structures[portal.cellId - kFirstStructure], portalView, depth + 1);
+        onPath_[portal.cellId - kFirstStructure] = false;
+    }
+}
+
+bool StructureRenderer::calcPortalView(const Structure& structure, const Structure::Portal& portal, PortalView& view) const
+{
+    const CellStruct& part = structure.environment().parts[structure.partNum()];
+
+    if(portal.portalId >= part.triangleFans.size())
+    {
+        return false;
+    }
+
+    const TriangleFan& triangleFan = part.triangleFans[portal.portalId];
+    glm::mat4 transform = projectionViewMat_ * calcWorldMat(structure, cameraBlockPosition_);
+
+    view.min = glm::vec2{1.0, 1.0};
+    view.max = glm::vec2{-1.0, -1.0};
+
+    for(const TriangleFan::Index& index : triangleFan.indices)
+    {
+        glm::vec4 clip = transform * glm::vec4{part.vertices[index.vertexIndex].position, 1.0};
+
+        // The portal crosses the near plane, we could be looking through any of it
+        if(clip.w <= 0.0)
+        {
+            view.min = glm::vec2{-1.0, -1.0};
+            view.max = glm::vec2{1.0, 1.0};
+            return true;
+        }
+
+        glm::vec2 ndc{clip.x / clip.w, clip.y / clip.w};
+        view.min = glm::min(view.min, ndc);
+        view.max = glm::max(view.max, ndc);
+    }
+
+    return !triangleFan.indices.empty();
+}
+
+void StructureRenderer::addSeenOutside()
+{
+    LandcellManager& landcellManager = Core::get().landcellManager();
+
+    for(const LandcellManager::Slot* slot : landcellManager)
+    {
+        int dx = slot->id.x() - landcellManager.center().x();
+        int dy = slot->id.y() - landcellManager.center().y();
 
         glm::vec3 blockPosition{dx * 192.0, dy * 192.0, 0.0};
 
-        const Structure& structure = static_cast<const Structure&>(*pair.second);
+        for(size_t i = 0; i < slot->structures.size(); i++)
+        {
+            const Structure& structure = *slot->structures[i];
+
+            if(portalCulling_ && !structure.isSeenOutside())
+            {
+                continue;
+            }
+
+            if(cameraStructure_ && slot == cameraSlot_ && reached_[i])
+            {
+                continue;
+            }
+
+            addStructure(structure, blockPosition);
+        }
+    }
+}
+
+void StructureRenderer::addStructure(const Structure& structure, const glm::vec3& blockPosition)
+{
+    visibleStructures_.push_back({&structure, blockPosition});
+
+    // the bounds of the part, rotated into a world box
+    const CellStruct& part = structure.environment().parts[structure.partNum()];
+    glm::vec3 center = (part.boundsMin + part.boundsMax) * fp_t(0.5);
+    glm::vec3 extents = (part.boundsMax - part.boundsMin) * fp_t(0.5);
 
-        renderStructure(structure, projectionMat, viewMat, blockPosition + structure.location().position, structure.location().rotation);
+    glm::mat3 rotation = glm::mat3_cast(structure.location().rotation);
+    glm::vec3 worldExtents;
+
+    for(int i = 0; i < 3; i++)
+    {
+        worldExtents[i] = fabs(rotation[0][i]) * extents.x + fabs(rotation[1][i]) * extents.y + fabs(rotation[2][i]) * extents.z;
     }
+
+    cullBatch_.addBox(blockPosition + structure.location().position + structure.location().rotation * center, worldExtents);
 }
 
-void StructureRenderer::renderStructure(
-    const Structure& structure,
-    const glm::mat4& projectionMat,
-    const glm::mat4& viewMat,
-    const glm::vec3& position,
-    const glm::quat& rotation)
+void StructureRenderer::enqueueStructure(const Structure& structure, const glm::vec3& blockPosition)
 {
-    glm::mat4 worldMat = glm::translate(glm::mat4{}, position) * glm::mat4_cast(rotation);
+    Renderer& renderer = Core::get().renderer();
+
+    RenderQueue::Draw draw;
+    draw.program = &renderer.meshProgram();
+    draw.worldMat = calcWorldMat(structure, blockPosition);
+
+    glm::vec3 position = blockPosition + structure.location().position;
+    float distance = static_cast<float>(glm::length(position - Core::get().camera().position()));
 
-    loadMat4ToUniform(worldMat, program_.getUniform("worldMatrix"));
-    loadMat4ToUniform(projectionMat * viewMat, program_.getUniform("projectionViewMatrix"));
+    MeshRenderData* mesh = findMesh(structure);
 
-    if(!structure.renderData())
+    if(!mesh)
     {
-        structure.renderData().reset(new MeshRenderData(structure));
+        // as big as it is on screen
+        const CellStruct& part = structure.environment().parts[structure.partNum()];
+        float radius = static_cast<float>(glm::length(part.boundsMax - part.boundsMin) * fp_t(0.5));
+        renderer.uploadScheduler().request(*this, &structure, radius / max(distance, 1.0f));
+        return;
     }
 
-    MeshRenderData& renderData = static_cast<MeshRenderData&>(*structure.renderData());
+    mesh->enqueue(renderer.renderQueue(), RenderQueue::Pass::kOpaque, distance, distance, draw);
+}
+
+size_t StructureRenderer::upload(const void* item)
+{
+    const Structure& structure = *static_cast<const Structure*>(item);
+
+    if(findMesh(structure))
+    {
+        return 0;
+    }
+
+    return getMesh(structure).calcSize();
+}
+
+StructureRenderer::MeshKey StructureRenderer::makeMeshKey(const Structure& structure)
+{
+    MeshKey key;
+    key.environmentId = structure.environment().resourceId();
+    key.partNum = structure.partNum();
+
+    for(const ResourcePtr& surface : structure.surfaces())
+    {
+        key.surfaceIds.push_back(surface->resourceId());
+    }
+
+    return key;
+}
+
+MeshRenderData* StructureRenderer::findMesh(const Structure& structure)
+{
+    Tag* tag = static_cast<Tag*>(structure.renderData().get());
+
+    if(tag)
+    {
+        return tag->mesh.get();
+    }
+
+    // another structure may have made it already
+    auto it = meshes_.find(makeMeshKey(structure));
+
+    if(it == meshes_.end())
+    {
+        return nullptr;
+    }
+
+    shared_ptr<MeshRenderData> mesh = it->second.lock();
+
+    if(!mesh)
+    {
+        return nullptr;
+    }
+
+    tag = new Tag();
+    structure.renderData().reset(tag);
+    tag->mesh = mesh;
+
+    return tag->mesh.get();
+}
+
+MeshRenderData& StructureRenderer::getMesh(const Structure& structure)
+{
+    MeshRenderData* mesh = findMesh(structure);
+
+    if(mesh)
+    {
+        return *mesh;
+    }
+
+    Tag* tag = new Tag();
+    structure.renderData().reset(tag);
+
+    tag->mesh.reset(new MeshRenderData(structure));
+    meshes_[makeMeshKey(structure)] = tag->mesh;
+
+    if(meshes_.size() >= meshesPruneSize_)
+    {
+        for(auto it = meshes_.begin(); it != meshes_.end(); /**/)
+        {
+            if(it->second.expired())
+            {
+                it = meshes_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        meshesPruneSize_ = max(meshes_.size() * 2, kMinMeshesPruneSize);
+    }
 
-    renderData.render();
+    return *tag->mesh;
 }
@@ -17,12 +17,19 @@
  */
 #include "graphics/TextureRenderData.h"
 #include "graphics/Renderer.h"
+#include "graphics/TextureResidency.h"
+#include "graphics/UploadScheduler.h"
 #include "resource/ImgColor.h"
 #include "Core.h"
 
-TextureRenderData::TextureRenderData(const ImgColor& imgColor)
+TextureRenderData::TextureRenderData(const ImgColor& imgColor) :
+    imgColor_(imgColor),
+    baseLevel_(0),
+    lastUsedFrame_(0),
+    nearestDistance_(0.0f)
 {
     const Image& image = imgColor.image;
+    UploadScheduler& uploadScheduler = Core::get().renderer().uploadScheduler();
 
     glGenTextures(1, &handle_);
     glBindTexture(GL_TEXTURE_2D, handle_);
@@ -32,29 +39,44 @@ TextureRenderData::TextureRenderData(const ImgColor& imgColor)
     switch(image.format())
     {
         case PixelFormat::kA8R8G8B8:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, image.data());
+            uploadScheduler.texImage2D(GL_RGBA8, image.width(), image.height(), GL_BGRA, GL_UNSIGNED_BYTE, image.data(), image.size());
             break;
         case PixelFormat::kR8G8B8:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, image.width(), image.height(), 0, GL_BGR, GL_UNSIGNED_BYTE, image.data());
+            uploadScheduler.texImage2D(GL_RGB8, image.width(), image.height(), GL_BGR, GL_UNSIGNED_BYTE, image.data(), image.size());
             break;
         case PixelFormat::kDXT1:
-            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, image.width(), image.height(), 0, (GLsizei)image.size(), image.data());
+            uploadScheduler.compressedTexImage2D(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, image.width(), image.height(), image.data(), image.size());
             break;
         case PixelFormat::kDXT3:
-            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, image.width(), image.height(), 0, (GLsizei)image.size(), image.data());
+            uploadScheduler.compressedTexImage2D(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, image.width(), image.height(), image.data(), image.size());
             break;
         case PixelFormat::kDXT5:
-            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, image.width(), image.height(), 0, (GLsizei)image.size(), image.data());
+            uploadScheduler.compressedTexImage2D(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, image.width(), image.height(), image.data(), image.size());
             break;
         default:
             throw runtime_error("Unsupported image format");
     }
 
     glGenerateMipmap(GL_TEXTURE_2D);
+
+    maxLevel_ = 0;
+
+    while((max(image.width(), image.height()) >> maxLevel_) > 1)
+    {
+        maxLevel_++;
+    }
+
+    // each mipmap is a quarter of the one before
+    size_ = image.size() * 4 / 3;
+
+    TextureResidency& textureResidency = Core::get().renderer().textureResidency();
+    lastUsedFrame_ = textureResidency.frame();
+    textureResidency.add(*this);
 }
 
 TextureRenderData::~TextureRenderData()
 {
+    Core::get().renderer().textureResidency().remove(*this);
     glDeleteTextures(1, &handle_);
 }
 
@@ -62,3 +84,62 @@ void TextureRenderData::bind()
 {
     glBindTexture(GL_TEXTURE_2D, handle_);
 }
+
+GLuint TextureRenderData::handle() const
+{
+    return handle_;
+}
+
+void TextureRenderData::touch(float distance)
+{
+    int frame = Core::get().renderer().textureResidency().frame();
+
+    if(lastUsedFrame_ != frame)
+    {
+        lastUsedFrame_ = frame;
+        nearestDistance_ = distance;
+    }
+    else
+    {
+        nearestDistance_ = min(nearestDistance_, distance);
+    }
+}
+
+void TextureRenderData::evict()
+{
+    imgColor_.renderData.reset();
+}
+
+void TextureRenderData::setBaseLevel(int level)
+{
+    level = min(level, maxLevel_);
+
+    if(level == baseLevel_)
+    {
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, handle_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    baseLevel_ = level;
+}
+
+int TextureRenderData::lastUsedFrame() const
+{
+    return lastUsedFrame_;
+}
+
+float TextureRenderData::nearestDistance() const
+{
+    return nearestDistance_;
+}
+
+int TextureRenderData::maxLevel() const
+{
+    return maxLevel_;
+}
+
+size_t TextureRenderData::calcSize() const
+{
+    return size_;
+}
@@ -0,0 +1,152 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/TextureResidency.h"
+#include "graphics/TextureRenderData.h"
+#include "Config.h"
+#include "Core.h"
+#include <algorithm>
+
+// Frames a texture has to go unused for before it can be evicted
+static const int kMinIdleFrames = 30;
+
+struct TextureResidency::CompareByLastUsed
+{
+    bool operator()(const TextureRenderData* a, const TextureRenderData* b) const
+    {
+        return a->lastUsedFrame() < b->lastUsedFrame();
+    }
+};
+
+TextureResidency::TextureResidency() : frame_(0), bytes_(0)
+{
+    Config& config = Core::get().config();
+
+    // MiB
+    int budget = config.getInt("TextureResidency.budget", 512);
+
+    if(budget < 0)
+    {
+        throw runtime_error("Bad value for TextureResidency.budget");
+    }
+
+    mipClampDistance_ = config.getFloat("TextureResidency.mipClampDistance", 0.0);
+
+    if(mipClampDistance_ < 0.0)
+    {
+        throw runtime_error("Bad value for TextureResidency.mipClampDistance");
+    }
+
+    budget_ = static_cast<size_t>(budget) * 1024 * 1024;
+}
+
+TextureResidency::~TextureResidency()
+{
+    while(!textures_.empty())
+    {
+        (*textures_.begin())->evict();
+    }
+}
+
+void TextureResidency::add(TextureRenderData& texture)
+{
+    textures_.insert(&texture);
+    bytes_ += texture.calcSize();
+}
+
+void TextureResidency::remove(TextureRenderData& texture)
+{
+    textures_.erase(&texture);
+    bytes_ -= texture.calcSize();
+}
+
+int TextureResidency::frame() const
+{
+    return frame_;
+}
+
+void TextureResidency::update()
+{
+    stats_.evicted = 0;
+
+    if(mipClampDistance_ > 0.0)
+    {
+        clampBaseLevels();
+    }
+
+    if(budget_ != 0 && bytes_ > budget_)
+    {
+        evict();
+    }
+
+    stats_.textures = static_cast<int>(textures_.size());
+    stats_.bytes = bytes_;
+
+    frame_++;
+}
+
+const TextureResidency::Stats& TextureResidency::stats() const
+{
+    return stats_;
+}
+
+void TextureResidency::clampBaseLevels()
+{
+    for(TextureRenderData* texture : textures_)
+    {
+        if(texture->lastUsedFrame() != frame_)
+        {
+            continue;
+        }
+
+        int level = 0;
+
+        for(fp_t distance = texture->nearestDistance(); distance >= mipClampDistance_ * 2.0; distance *= 0.5)
+        {
+            level++;
+        }
+
+        texture->setBaseLevel(level);
+    }
+}
+
+void TextureResidency::evict()
+{
+    candidates_.clear();
+
+    for(TextureRenderData* texture : textures_)
+    {
+        if(frame_ - texture->lastUsedFrame() >= kMinIdleFrames)
+        {
+            candidates_.push_back(texture);
+        }
+    }
+
+    sort(candidates_.begin(), candidates_.end(), CompareByLastUsed());
+
+    // evicting removes the texture from textures_, but not from candidates_
+    for(TextureRenderData* texture : candidates_)
+    {
+        if(bytes_ <= budget_)
+        {
+            break;
+        }
+
+        texture->evict();
+        stats_.evicted++;
+    }
+}
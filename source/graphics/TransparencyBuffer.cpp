@@ -0,0 +1,183 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/TransparencyBuffer.h"
+
+#include "graphics/shaders/ModelVertexShader.h"
+#include "graphics/shaders/ModelOitFragmentShader.h"
+#include "graphics/shaders/OitCompositeVertexShader.h"
+#include "graphics/shaders/OitCompositeFragmentShader.h"
+
+TransparencyBuffer::TransparencyBuffer() :
+    framebuffer_(0),
+    accumTexture_(0),
+    revealageTexture_(0),
+    depthBuffer_(0),
+    width_(0),
+    height_(0),
+    previousFramebuffer_(0)
+{
+    program_.create();
+    program_.attach(GL_VERTEX_SHADER, ModelVertexShader);
+    program_.attach(GL_FRAGMENT_SHADER, ModelOitFragmentShader);
+    program_.link();
+
+    program_.use();
+    glUniform1i(program_.getUniform("tex"), 0);
+
+    compositeProgram_.create();
+    compositeProgram_.attach(GL_VERTEX_SHADER, OitCompositeVertexShader);
+    compositeProgram_.attach(GL_FRAGMENT_SHADER, OitCompositeFragmentShader);
+    compositeProgram_.link();
+
+    compositeProgram_.use();
+    glUniform1i(compositeProgram_.getUniform("accumTex"), 0);
+    glUniform1i(compositeProgram_.getUniform("revealageTex"), 1);
+
+    glGenVertexArrays(1, &vertexArray_);
+
+    viewport_[0] = 0;
+    viewport_[1] = 0;
+    viewport_[2] = 0;
+    viewport_[3] = 0;
+}
+
+TransparencyBuffer::~TransparencyBuffer()
+{
+    destroyTargets();
+    glDeleteVertexArrays(1, &vertexArray_);
+}
+
+Program& TransparencyBuffer::program()
+{
+    return program_;
+}
+
+void TransparencyBuffer::begin()
+{
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer_);
+    glGetIntegerv(GL_VIEWPORT, viewport_);
+
+    if(viewport_[2] != width_ || viewport_[3] != height_)
+    {
+        resize(viewport_[2], viewport_[3]);
+    }
+
+    // opaque surfaces still hide transparent ones
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+    glBlitFramebuffer(
+        viewport_[0], viewport_[1], viewport_[0] + width_, viewport_[1] + height_,
+        0, 0, width_, height_,
+        GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glViewport(0, 0, width_, height_);
+
+    static const GLfloat kAccumClear[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static const GLfloat kRevealageClear[] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, kAccumClear);
+    glClearBufferfv(GL_COLOR, 1, kRevealageClear);
+
+    glDepthMask(GL_FALSE);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void TransparencyBuffer::end()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer_);
+    glViewport(viewport_[0], viewport_[1], viewport_[2], viewport_[3]);
+
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    compositeProgram_.use();
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTexture_);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, revealageTexture_);
+
+    glBindVertexArray(vertexArray_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+}
+
+void TransparencyBuffer::resize(GLsizei width, GLsizei height)
+{
+    destroyTargets();
+
+    width_ = width;
+    height_ = height;
+
+    glGenTextures(1, &accumTexture_);
+    glBindTexture(GL_TEXTURE_2D, accumTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+
+    glGenTextures(1, &revealageTexture_);
+    glBindTexture(GL_TEXTURE_2D, revealageTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+
+    // the depth blit needs the formats to match, the window may or may not have stencil
+    GLint stencilSize = 0;
+
+    if(previousFramebuffer_ == 0)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilSize);
+    }
+
+    glGenRenderbuffers(1, &depthBuffer_);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, stencilSize != 0 ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture_, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealageTexture_, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, stencilSize != 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer_);
+
+    static const GLenum kDrawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, kDrawBuffers);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        throw runtime_error("Transparency framebuffer incomplete");
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer_);
+}
+
+void TransparencyBuffer::destroyTargets()
+{
+    if(framebuffer_ != 0)
+    {
+        glDeleteFramebuffers(1, &framebuffer_);
+        glDeleteTextures(1, &accumTexture_);
+        glDeleteTextures(1, &revealageTexture_);
+        glDeleteRenderbuffers(1, &depthBuffer_);
+        framebuffer_ = 0;
+    }
+}
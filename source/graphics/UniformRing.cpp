@@ -0,0 +1,79 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/UniformRing.h"
+#include <cstring>
+
+UniformRing::UniformRing(size_t size) : size_(size), offset_(0)
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment_ = max(static_cast<size_t>(alignment), sizeof(glm::vec4));
+
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferData(GL_UNIFORM_BUFFER, size_, nullptr, GL_STREAM_DRAW);
+}
+
+UniformRing::~UniformRing()
+{
+    glDeleteBuffers(1, &buffer_);
+}
+
+size_t UniformRing::align(size_t size) const
+{
+    return (size + alignment_ - 1) / alignment_ * alignment_;
+}
+
+size_t UniformRing::write(const void* data, size_t size)
+{
+    assert(size <= size_);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+
+    if(offset_ + size > size_)
+    {
+        // the driver hands us new storage while draws still use the old
+        glBufferData(GL_UNIFORM_BUFFER, size_, nullptr, GL_STREAM_DRAW);
+        offset_ = 0;
+    }
+
+    void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, offset_, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+    if(mapped == nullptr)
+    {
+        throw runtime_error("Failed to map uniform buffer");
+    }
+
+    memcpy(mapped, data, size);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+    size_t offset = offset_;
+    offset_ = align(offset_ + size);
+    return offset;
+}
+
+void UniformRing::bind(UniformBlockBinding binding, size_t offset, size_t size) const
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer_, offset, size);
+}
+
+size_t UniformRing::size() const
+{
+    return size_;
+}
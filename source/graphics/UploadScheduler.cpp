@@ -0,0 +1,233 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/UploadScheduler.h"
+#include "Config.h"
+#include "Core.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static const size_t kStagingAlignment = 16;
+
+struct CompareByItem
+{
+    template<class T>
+    bool operator()(const T& a, const T& b) const
+    {
+        if(a.item != b.item)
+        {
+            return a.item < b.item;
+        }
+
+        return a.priority > b.priority;
+    }
+};
+
+struct CompareByPriority
+{
+    template<class T>
+    bool operator()(const T& a, const T& b) const
+    {
+        return a.priority > b.priority;
+    }
+};
+
+UploadScheduler::UploadScheduler() : stagingOffset_(0)
+{
+    Config& config = Core::get().config();
+
+    fp_t budgetMs = config.getFloat("UploadScheduler.budgetMs", 2.0);
+
+    if(budgetMs < 0.0)
+    {
+        throw runtime_error("Bad value for UploadScheduler.budgetMs");
+    }
+
+    int budgetKb = config.getInt("UploadScheduler.budgetKb", 4096);
+
+    if(budgetKb < 0)
+    {
+        throw runtime_error("Bad value for UploadScheduler.budgetKb");
+    }
+
+    // MiB
+    int stagingSize = config.getInt("UploadScheduler.stagingSize", 8);
+
+    if(stagingSize <= 0)
+    {
+        throw runtime_error("Bad value for UploadScheduler.stagingSize");
+    }
+
+    budgetSeconds_ = budgetMs / 1000.0;
+    budgetBytes_ = static_cast<size_t>(budgetKb) * 1024;
+    stagingSize_ = static_cast<size_t>(stagingSize) * 1024 * 1024;
+
+    glGenBuffers(1, &stagingBuffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stagingBuffer_);
+    glBufferData(GL_COPY_WRITE_BUFFER, stagingSize_, nullptr, GL_STREAM_DRAW);
+
+    static const uint8_t kGrey[] = { 0x80, 0x80, 0x80, 0xFF };
+
+    glGenTextures(1, &placeholderTexture_);
+    glBindTexture(GL_TEXTURE_2D, placeholderTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // default is GL_NEAREST_MIPMAP_LINEAR
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, kGrey);
+}
+
+UploadScheduler::~UploadScheduler()
+{
+    glDeleteBuffers(1, &stagingBuffer_);
+    glDeleteTextures(1, &placeholderTexture_);
+}
+
+void UploadScheduler::request(Uploader& uploader, const void* item, float priority)
+{
+    requests_.push_back({&uploader, item, priority});
+}
+
+void UploadScheduler::run()
+{
+    // an item can be requested many times a frame, keep the most important
+    sort(requests_.begin(), requests_.end(), CompareByItem());
+
+    size_t count = 0;
+
+    for(size_t i = 0; i < requests_.size(); i++)
+    {
+        if(count == 0 || requests_[i].item != requests_[count - 1].item)
+        {
+            requests_[count++] = requests_[i];
+        }
+    }
+
+    requests_.resize(count);
+    sort(requests_.begin(), requests_.end(), CompareByPriority());
+
+    stats_ = Stats();
+    stats_.requested = static_cast<int>(requests_.size());
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+    // the most important request is always served, so something gets uploaded every frame
+    for(const Request& request : requests_)
+    {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+
+        if(stats_.uploaded != 0 && (elapsed.count() >= budgetSeconds_ || stats_.bytes >= budgetBytes_))
+        {
+            break;
+        }
+
+        stats_.bytes += request.uploader->upload(request.item);
+        stats_.uploaded++;
+    }
+
+    requests_.clear();
+}
+
+GLuint UploadScheduler::placeholderTexture() const
+{
+    return placeholderTexture_;
+}
+
+void UploadScheduler::bufferData(GLenum target, size_t size, const void* data)
+{
+    glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+    bufferSubData(target, 0, size, data);
+}
+
+void UploadScheduler::bufferSubData(GLenum target, size_t offset, size_t size, const void* data)
+{
+    ptrdiff_t stagingOffset = stage(data, size);
+
+    if(stagingOffset < 0)
+    {
+        glBufferSubData(target, offset, size, data);
+        return;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, target, stagingOffset, offset, size);
+}
+
+void UploadScheduler::texImage2D(GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* data, size_t size)
+{
+    ptrdiff_t offset = stage(data, size);
+
+    if(offset < 0)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, data);
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer_);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, reinterpret_cast<GLvoid*>(offset));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void UploadScheduler::compressedTexImage2D(GLenum internalFormat, GLsizei width, GLsizei height, const void* data, size_t size)
+{
+    ptrdiff_t offset = stage(data, size);
+
+    if(offset < 0)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, static_cast<GLsizei>(size), data);
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer_);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, static_cast<GLsizei>(size), reinterpret_cast<GLvoid*>(offset));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+const UploadScheduler::Stats& UploadScheduler::stats() const
+{
+    return stats_;
+}
+
+ptrdiff_t UploadScheduler::stage(const void* data, size_t size)
+{
+    if(size == 0 || size > stagingSize_)
+    {
+        return -1;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stagingBuffer_);
+
+    if(stagingOffset_ + size > stagingSize_)
+    {
+        // like UniformRing, copies still reading the old storage keep it
+        glBufferData(GL_COPY_WRITE_BUFFER, stagingSize_, nullptr, GL_STREAM_DRAW);
+        stagingOffset_ = 0;
+    }
+
+    void* mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, stagingOffset_, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+    if(mapped == nullptr)
+    {
+        throw runtime_error("Failed to map staging buffer");
+    }
+
+    memcpy(mapped, data, size);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+
+    ptrdiff_t offset = static_cast<ptrdiff_t>(stagingOffset_);
+    stagingOffset_ = (stagingOffset_ + size + kStagingAlignment - 1) / kStagingAlignment * kStagingAlignment;
+    return offset;
+}
@@ -15,10 +15,10 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
-#ifndef BZR_GRAPHICS_UTIL_H
-#define BZR_GRAPHICS_UTIL_H
 
-void loadMat3ToUniform(const glm::mat3& mat, GLint location);
-void loadMat4ToUniform(const glm::mat4& mat, GLint location);
-
-#endif
+// per draw constants, see DrawConstants in UniformRing.h
+layout(std140) uniform DrawConstants
+{
+    mat4 worldMatrix;
+    float fade; // how much of the draw to keep, see Dither.glsl
+};
@@ -0,0 +1,37 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// per frame constants, see FrameConstants in UniformRing.h
+layout(std140) uniform FrameConstants
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    mat4 projectionViewMatrix;
+    mat3 normalMatrix;
+    vec4 cameraPosition;
+    vec3 lightPosition;
+    float worldRadius;
+};
+
+// the world is bent down around the camera as if on a sphere, this is how far a point is lowered
+// Frustum::cull does the same to what it tests
+float curveDrop(vec2 position)
+{
+    float angle = atan(distance(position, cameraPosition.xy) / worldRadius);
+    return worldRadius * (1.0 - cos(angle));
+}
@@ -0,0 +1,40 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+in vec2 fragTexCoord;
+flat in float fragFade;
+
+out vec4 fragColor;
+
+uniform sampler2D atlasTex;
+
+#include "graphics/shaders/Dither.glsl"
+
+void main()
+{
+    vec4 color = texture(atlasTex, fragTexCoord);
+
+    // fading in, the pixels the model keeps are discarded
+    if(color.a < 0.5 || dither(gl_FragCoord.xy) < 1.0 - fragFade)
+    {
+        discard;
+    }
+
+    fragColor = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,64 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+// a quad per instance, facing the camera around z, see ImpostorRenderer
+layout(location = 0) in vec2 corner;
+
+// per instance: center and radius, then slot, yaw and fade
+layout(location = 1) in vec4 instanceBounds;
+layout(location = 2) in vec4 instanceInfo;
+
+out vec2 fragTexCoord;
+flat out float fragFade;
+
+#include "graphics/shaders/FrameConstants.glsl"
+
+uniform int cellsPerRow;
+
+const float PI = 3.14159265359;
+
+// ImpostorRenderer::kViews
+const int VIEWS = 8;
+
+void main()
+{
+    vec3 center = instanceBounds.xyz;
+    float radius = instanceBounds.w;
+
+    vec2 toCamera = cameraPosition.xy - center.xy;
+    vec3 dir = vec3(toCamera / max(length(toCamera), 0.0001), 0.0);
+    vec3 right = cross(vec3(0.0, 0.0, 1.0), dir);
+
+    // views were baked counter-clockwise around the model's z, starting from its x
+    float angle = atan(toCamera.y, toCamera.x) - instanceInfo.y;
+    int view = int(floor(angle / (2.0 * PI) * float(VIEWS) + 0.5));
+    view = ((view % VIEWS) + VIEWS) % VIEWS;
+
+    vec4 worldPos = vec4(center + right * corner.x * radius + vec3(0.0, 0.0, corner.y * radius), 1.0);
+
+    worldPos.z = worldPos.z - curveDrop(worldPos.xy);
+
+    gl_Position = projectionViewMatrix * worldPos;
+
+    int cell = int(instanceInfo.x) * VIEWS + view;
+    vec2 cellOrigin = vec2(float(cell % cellsPerRow), float(cell / cellsPerRow));
+
+    fragTexCoord = (cellOrigin + corner * 0.5 + 0.5) / float(cellsPerRow);
+    fragFade = instanceInfo.z;
+}
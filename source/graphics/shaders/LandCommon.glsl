@@ -23,16 +23,11 @@ uniform sampler2DArray terrainTex;
 uniform sampler2DArray blendTex;
 uniform sampler2D normalTex;
 
+#include "graphics/shaders/FrameConstants.glsl"
+
 // lighting parameters
-uniform vec4 cameraPosition;
-uniform vec3 lightPosition;
 uniform vec3 lightIntensity;
 uniform vec3 Kd;
 uniform vec3 Ka;
 uniform vec3 Ks;
 uniform float shininess;
-
-uniform mat3 normalMatrix;
-uniform mat4 worldMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
@@ -0,0 +1,45 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+in FragmentData
+{
+    vec3 position;
+    vec3 normalTexCoord;
+    vec2 terrainTexCoord;
+    vec4 terrainInfo1;
+    vec4 terrainInfo2;
+    vec4 terrainInfo3;
+    vec4 terrainInfo4;
+    vec4 terrainInfo5;
+};
+
+out vec4 fragColor;
+
+#include "graphics/shaders/LandCommon.glsl"
+#include "graphics/shaders/LandFragmentCommon.glsl"
+
+// x and y of the normal maps of all layers, see LandArray::upload
+uniform sampler2DArray normalArrayTex;
+
+void main()
+{
+    vec2 nxy = texture(normalArrayTex, normalTexCoord).xy - vec2(0.5);
+    vec3 n = vec3(nxy, sqrt(max(0.25 - dot(nxy, nxy), 0.0)));
+    fragColor = vec4(hejl(terrainColor()) * phong(n), 1.0);
+}
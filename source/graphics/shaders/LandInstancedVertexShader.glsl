@@ -0,0 +1,108 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+// cell x, cell y and which vertex of the cell, see LandArray.cpp
+// 0-5 are the vertices of the cell's two triangles
+// 6 + corner * 2 is a corner of the cell at the top of a skirt, 7 + corner * 2 at the bottom
+layout(location = 0) in vec3 gridVertex;
+
+// per land: position x, position y, layer, skirt depth
+layout(location = 1) in vec4 instance;
+
+out FragmentData
+{
+    vec3 position;
+    vec3 normalTexCoord;
+    vec2 terrainTexCoord;
+    vec4 terrainInfo1;
+    vec4 terrainInfo2;
+    vec4 terrainInfo3;
+    vec4 terrainInfo4;
+    vec4 terrainInfo5;
+} fragData;
+
+#include "graphics/shaders/LandCommon.glsl"
+
+// 9x9 heights per layer
+uniform sampler2DArray heightTex;
+
+// 3 texels per cell per layer, see LandArray::upload
+uniform usampler2DArray cellTex;
+
+// corners numbered counter-clockwise from the south-west
+const ivec2 CORNERS[4] = ivec2[4](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+// triangle corners for each split direction, the same as LandRenderData
+const int SPLIT_NESW[6] = int[6](0, 1, 2, 2, 3, 0);
+const int SPLIT_NWSE[6] = int[6](0, 1, 3, 1, 2, 3);
+
+// cosine and sine of each number of 90 degree ccw rotations
+const vec2 ROTATIONS[4] = vec2[4](vec2(1.0, 0.0), vec2(0.0, 1.0), vec2(-1.0, 0.0), vec2(0.0, -1.0));
+
+vec2 rotateCoord(ivec2 corner, uint rotations, uint scale)
+{
+    vec2 c = vec2(corner) - vec2(0.5);
+    vec2 r = ROTATIONS[rotations];
+    return (vec2(c.x * r.x - c.y * r.y, c.x * r.y + c.y * r.x) + vec2(0.5)) * float(scale);
+}
+
+void main()
+{
+    ivec2 cell = ivec2(gridVertex.xy);
+    int code = int(gridVertex.z);
+    int layer = int(instance.z);
+
+    uvec4 textures = texelFetch(cellTex, ivec3(cell.x * 3, cell.y, layer), 0);
+    uvec4 blendTextures = texelFetch(cellTex, ivec3(cell.x * 3 + 1, cell.y, layer), 0);
+    uvec4 road = texelFetch(cellTex, ivec3(cell.x * 3 + 2, cell.y, layer), 0);
+
+    int cornerIndex;
+    float depth = 0.0;
+
+    if(code < 6)
+    {
+        cornerIndex = (road.a & 0x10u) != 0u ? SPLIT_NESW[code] : SPLIT_NWSE[code];
+    }
+    else
+    {
+        cornerIndex = (code - 6) / 2;
+        depth = float((code - 6) % 2) * instance.w;
+    }
+
+    ivec2 corner = CORNERS[cornerIndex];
+    ivec2 grid = cell + corner;
+    float height = texelFetch(heightTex, ivec3(grid, layer), 0).r;
+
+    vec4 modelPos = vec4(vec2(grid) * 24.0, height - depth, 1.0);
+    vec4 worldPos = vec4(modelPos.xy + instance.xy, modelPos.z, 1.0);
+
+    worldPos.z = worldPos.z - curveDrop(worldPos.xy);
+
+    gl_Position = projectionViewMatrix * worldPos;
+
+    // terrain textures are tiled twice per cell
+    fragData.position = (viewMatrix * worldPos).xyz;
+    fragData.normalTexCoord = vec3(modelPos.xy / 192.0, float(layer));
+    fragData.terrainTexCoord = vec2(corner) * 2.0;
+    fragData.terrainInfo1 = vec4(rotateCoord(corner, road.b & 3u, 1u), float(blendTextures.r), float(textures.r));
+    fragData.terrainInfo2 = vec4(rotateCoord(corner, (road.b >> 2u) & 3u, 1u), float(blendTextures.g), float(textures.g));
+    fragData.terrainInfo3 = vec4(rotateCoord(corner, (road.b >> 4u) & 3u, 1u), float(blendTextures.b), float(textures.b));
+    fragData.terrainInfo4 = vec4(rotateCoord(corner, (road.b >> 6u) & 3u, 1u), float(blendTextures.a), float(textures.a));
+    fragData.terrainInfo5 = vec4(rotateCoord(corner, road.a & 3u, (road.a >> 2u) & 3u), float(road.g), float(road.r));
+}
@@ -0,0 +1,62 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+in FragmentData
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+};
+
+out vec4 fragColor;
+
+#include "graphics/shaders/LandCommon.glsl"
+
+// Same lighting as LandFragmentShader.glsl, but with per-vertex normals
+vec3 phong()
+{
+    vec3 n = normalize(normal);
+    vec3 s = normalize(lightPosition - position);
+    vec3 v = normalize(-position);
+    vec3 h = normalize(v + s);
+
+    float cosine = max(dot(s, n), 0.0);
+    float gapped_cosine = cosine * 0.5 + floor(cosine * 3.0) * 0.25;
+
+    vec3 ambient = Ka;
+    vec3 diffuse = Kd * gapped_cosine;
+    vec3 specular = Ks * pow(max(dot(h, n), 0.0), shininess);
+
+    return lightIntensity * (ambient + diffuse + specular);
+}
+
+// Filmic tonemapping operators
+// Also applies gamma correction
+// http://filmicgames.com/archives/75
+vec3 hejl(vec3 color)
+{
+    vec3 x = max(vec3(0.0), color - vec3(0.004));
+    return (x * (6.2 * x + 0.5)) / (x * (6.2 * x + 1.7) + 0.06);
+}
+
+void main()
+{
+    // color is already linear
+    fragColor = vec4(hejl(color) * phong(), 1.0);
+}
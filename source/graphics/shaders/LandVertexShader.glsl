@@ -17,13 +17,12 @@
  */
 #version 410 core
 
-layout(location = 0) in vec3 vertexPosition;
-layout(location = 1) in vec2 terrainTexCoord;
-layout(location = 2) in vec4 terrainInfo1;
-layout(location = 3) in vec4 terrainInfo2;
-layout(location = 4) in vec4 terrainInfo3;
-layout(location = 5) in vec4 terrainInfo4;
-layout(location = 6) in vec4 terrainInfo5;
+// packed per vertex, see LandRenderData.cpp
+layout(location = 0) in float height;
+layout(location = 1) in uvec4 grid; // grid x, grid y, corner dx | dy << 1
+layout(location = 2) in uvec4 textures;
+layout(location = 3) in uvec4 blendTextures;
+layout(location = 4) in uvec4 road; // road texture, road blend texture, rotations, road rotation/scale
 
 out FragmentData
 {
@@ -38,25 +37,36 @@ out FragmentData
 } fragData;
 
 #include "graphics/shaders/LandCommon.glsl"
+#include "graphics/shaders/DrawConstants.glsl"
 
-const float WORLD_RADIUS = 10000.0;
+// cosine and sine of each number of 90 degree ccw rotations
+const vec2 ROTATIONS[4] = vec2[4](vec2(1.0, 0.0), vec2(0.0, 1.0), vec2(-1.0, 0.0), vec2(0.0, -1.0));
+
+vec2 rotateCoord(ivec2 corner, uint rotations, uint scale)
+{
+    vec2 c = vec2(corner) - vec2(0.5);
+    vec2 r = ROTATIONS[rotations];
+    return (vec2(c.x * r.x - c.y * r.y, c.x * r.y + c.y * r.x) + vec2(0.5)) * float(scale);
+}
 
 void main()
 {
-    vec4 modelPos = vec4(vertexPosition, 1.0);
+    ivec2 corner = ivec2(grid.z & 1u, grid.z >> 1u);
+
+    vec4 modelPos = vec4(vec2(grid.xy) * 24.0, height, 1.0);
     vec4 worldPos = worldMatrix * modelPos;
 
-    float angle = atan(distance(worldPos.xy, cameraPosition.xy) / WORLD_RADIUS);
-    worldPos.z = worldPos.z - WORLD_RADIUS * (1.0 - cos(angle));
+    worldPos.z = worldPos.z - curveDrop(worldPos.xy);
 
-    gl_Position = projectionMatrix * viewMatrix * worldPos;
+    gl_Position = projectionViewMatrix * worldPos;
 
+    // terrain textures are tiled twice per cell
     fragData.position = (viewMatrix * worldPos).xyz;
     fragData.normalTexCoord = modelPos.xy / 192.0;
-    fragData.terrainTexCoord = terrainTexCoord;
-    fragData.terrainInfo1 = terrainInfo1;
-    fragData.terrainInfo2 = terrainInfo2;
-    fragData.terrainInfo3 = terrainInfo3;
-    fragData.terrainInfo4 = terrainInfo4;
-    fragData.terrainInfo5 = terrainInfo5;
+    fragData.terrainTexCoord = vec2(corner) * 2.0;
+    fragData.terrainInfo1 = vec4(rotateCoord(corner, road.b & 3u, 1u), float(blendTextures.r), float(textures.r));
+    fragData.terrainInfo2 = vec4(rotateCoord(corner, (road.b >> 2u) & 3u, 1u), float(blendTextures.g), float(textures.g));
+    fragData.terrainInfo3 = vec4(rotateCoord(corner, (road.b >> 4u) & 3u, 1u), float(blendTextures.b), float(textures.b));
+    fragData.terrainInfo4 = vec4(rotateCoord(corner, (road.b >> 6u) & 3u, 1u), float(blendTextures.a), float(textures.a));
+    fragData.terrainInfo5 = vec4(rotateCoord(corner, road.a & 3u, (road.a >> 2u) & 3u), float(road.g), float(road.r));
 }
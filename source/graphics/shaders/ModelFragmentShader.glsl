@@ -18,12 +18,21 @@
 #version 410 core
 
 in vec2 fragTexCoord;
+flat in float fragFade;
 
 out vec4 fragColor;
 
 uniform sampler2D tex;
 
+#include "graphics/shaders/Dither.glsl"
+
 void main()
 {
+    // fading out for an impostor, which keeps the rest of the pixels
+    if(fragFade < 1.0 && dither(gl_FragCoord.xy) >= fragFade)
+    {
+        discard;
+    }
+
     fragColor = texture(tex, fragTexCoord);
 }
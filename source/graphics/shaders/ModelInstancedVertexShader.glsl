@@ -0,0 +1,43 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+// UNORM16 over the mesh bounds, the world matrix includes MeshRenderData::positionMatrix
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+// per instance, takes locations 3 to 6, see RenderQueue::setInstanceAttributes
+layout(location = 3) in mat4 worldMatrix;
+
+out vec2 fragTexCoord;
+flat out float fragFade;
+
+#include "graphics/shaders/FrameConstants.glsl"
+
+void main()
+{
+    vec4 modelPos = vec4(vertexPosition, 1.0);
+    vec4 worldPos = worldMatrix * modelPos;
+    
+    worldPos.z = worldPos.z - curveDrop(worldPos.xy);
+
+    gl_Position = projectionViewMatrix * worldPos;
+    fragTexCoord = texCoord;
+    fragFade = 1.0;
+}
@@ -0,0 +1,41 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+// weighted blended order independent transparency, McGuire and Bavoil 2013
+// see TransparencyBuffer
+
+in vec2 fragTexCoord;
+flat in float fragFade;
+
+layout(location = 0) out vec4 accum;
+layout(location = 1) out float revealage;
+
+uniform sampler2D tex;
+
+void main()
+{
+    vec4 color = texture(tex, fragTexCoord);
+    color.a *= fragFade;
+
+    // their equation 10, nearer and more opaque surfaces count for more
+    float weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+
+    accum = vec4(color.rgb * color.a, color.a) * weight;
+    revealage = color.a;
+}
@@ -17,26 +17,25 @@
  */
 #version 410 core
 
+// UNORM16 over the mesh bounds, the world matrix includes MeshRenderData::positionMatrix
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
 
 out vec2 fragTexCoord;
+flat out float fragFade;
 
-uniform vec4 cameraPosition;
-uniform mat4 worldMatrix;
-uniform mat4 projectionViewMatrix;
-
-const float WORLD_RADIUS = 10000.0;
+#include "graphics/shaders/FrameConstants.glsl"
+#include "graphics/shaders/DrawConstants.glsl"
 
 void main()
 {
     vec4 modelPos = vec4(vertexPosition, 1.0);
     vec4 worldPos = worldMatrix * modelPos;
     
-    float angle = atan(distance(worldPos.xy, cameraPosition.xy) / WORLD_RADIUS);
-    worldPos.z = worldPos.z - WORLD_RADIUS * (1.0 - cos(angle));
+    worldPos.z = worldPos.z - curveDrop(worldPos.xy);
 
     gl_Position = projectionViewMatrix * worldPos;
     fragTexCoord = texCoord;
+    fragFade = fade;
 }
@@ -15,15 +15,12 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
-#include "graphics/util.h"
-#include <glm/gtc/type_ptr.hpp>
+#version 410 core
 
-void loadMat3ToUniform(const glm::mat3& mat, GLint location)
-{
-    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat));
-}
+// only the query's sample count matters, color writes are off
+out vec4 fragColor;
 
-void loadMat4ToUniform(const glm::mat4& mat, GLint location)
+void main()
 {
-    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+    fragColor = vec4(1.0);
 }
@@ -0,0 +1,35 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+// a corner of the unit box, see OcclusionCuller
+layout(location = 0) in vec3 corner;
+
+#include "graphics/shaders/FrameConstants.glsl"
+
+uniform vec3 boxCenter;
+uniform vec3 boxExtents;
+
+void main()
+{
+    vec4 worldPos = vec4(boxCenter + corner * boxExtents, 1.0);
+
+    worldPos.z = worldPos.z - curveDrop(worldPos.xy);
+
+    gl_Position = projectionViewMatrix * worldPos;
+}
@@ -0,0 +1,41 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#version 410 core
+
+in vec2 fragTexCoord;
+
+out vec4 fragColor;
+
+uniform sampler2D accumTex;
+uniform sampler2D revealageTex;
+
+void main()
+{
+    float revealage = texture(revealageTex, fragTexCoord).r;
+
+    if(revealage == 1.0)
+    {
+        discard;
+    }
+
+    vec4 accum = texture(accumTex, fragTexCoord);
+    vec3 average = accum.rgb / clamp(accum.a, 1e-4, 5e4);
+
+    // blended over what's there by 1 - revealage
+    fragColor = vec4(average, 1.0 - revealage);
+}
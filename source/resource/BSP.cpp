@@ -20,10 +20,14 @@
 #include "BinReader.h"
 
 BSPNode::BSPNode()
-{}
+{
+    bounds_.radius = 0.0;
+}
 
 BSPNode::BSPNode(BinReader& reader, BSPTreeType treeType, uint32_t nodeType)
 {
+    bounds_.radius = 0.0;
+
     read(reader, partition_);
 
     if(nodeType == 0x42506e6e || nodeType == 0x4250496e) // BPnn, BPIn
@@ -107,6 +111,11 @@ BSPPortal::BSPPortal(BinReader& reader, BSPTreeType treeType)
     }
 }
 
+const Sphere& BSPNode::bounds() const
+{
+    return bounds_;
+}
+
 void read(BinReader& reader, unique_ptr<BSPNode>& node, BSPTreeType treeType)
 {
     uint32_t nodeType = reader.readInt();
@@ -0,0 +1,63 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "resource/DegradeInfo.h"
+#include "BinReader.h"
+
+static void read(BinReader& reader, DegradeInfo::Degrade& degrade)
+{
+    degrade.modelId = reader.readInt();
+    assert((degrade.modelId & 0xFF000000) == static_cast<uint32_t>(ResourceType::kModel));
+
+    degrade.mode = reader.readInt();
+
+    degrade.minDistance = reader.readFloat();
+    degrade.idealDistance = reader.readFloat();
+    degrade.maxDistance = reader.readFloat();
+    assert(degrade.minDistance <= degrade.maxDistance);
+}
+
+DegradeInfo::DegradeInfo(uint32_t id, const void* data, size_t size) : ResourceImpl{id}
+{
+    BinReader reader(data, size);
+
+    uint32_t resourceId = reader.readInt();
+    assert(resourceId == id);
+    UNUSED(resourceId);
+
+    uint32_t numDegrades = reader.readInt();
+    degrades.resize(numDegrades);
+
+    for(Degrade& degrade : degrades)
+    {
+        read(reader, degrade);
+    }
+
+    assert(reader.remaining() == 0);
+}
+
+size_t DegradeInfo::findDegrade(fp_t distance) const
+{
+    size_t i = 0;
+
+    while(i + 1 < degrades.size() && distance > degrades[i].maxDistance)
+    {
+        i++;
+    }
+
+    return i;
+}
@@ -30,6 +30,8 @@ CellStruct::CellStruct(CellStruct&& other)
     triangleFans = move(other.triangleFans);
     hitTriangleFans = move(other.hitTriangleFans);
     hitTree = move(other.hitTree);
+    boundsMin = other.boundsMin;
+    boundsMax = other.boundsMax;
 }
 
 CellStruct::~CellStruct()
@@ -41,6 +43,8 @@ CellStruct& CellStruct::operator=(CellStruct&& other)
     triangleFans = move(other.triangleFans);
     hitTriangleFans = move(other.hitTriangleFans);
     hitTree = move(other.hitTree);
+    boundsMin = other.boundsMin;
+    boundsMax = other.boundsMax;
     return *this;
 }
 
@@ -68,6 +72,17 @@ static void read(BinReader& reader, CellStruct& part)
         UNUSED(vertexNum);
 
         read(reader, part.vertices[i]);
+
+        if(i == 0)
+        {
+            part.boundsMin = part.vertices[i].position;
+            part.boundsMax = part.vertices[i].position;
+        }
+        else
+        {
+            part.boundsMin = glm::min(part.boundsMin, part.vertices[i].position);
+            part.boundsMax = glm::max(part.boundsMax, part.vertices[i].position);
+        }
     }
 
     for(uint32_t i = 0; i < numTriangleFans; i++)
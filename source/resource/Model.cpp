@@ -17,6 +17,7 @@
  */
 #include "resource/Model.h"
 #include "resource/BSP.h"
+#include "resource/DegradeInfo.h"
 #include "resource/ImgColor.h"
 #include "resource/ImgTex.h"
 #include "resource/Surface.h"
@@ -50,6 +51,26 @@ static vector<TriangleFan> readTriangleFans(BinReader& reader)
     return triangleFans;
 }
 
+static vector<ResourcePtr> loadDegrades(uint32_t modelId, const DegradeInfo& degradeInfo)
+{
+    size_t self = 0;
+
+    while(self < degradeInfo.degrades.size() && degradeInfo.degrades[self].modelId != modelId)
+    {
+        self++;
+    }
+
+    // only load the less detailed models, so none of them can load us again
+    vector<ResourcePtr> degrades(degradeInfo.degrades.size());
+
+    for(size_t i = self + 1; i < degradeInfo.degrades.size(); i++)
+    {
+        degrades[i] = Core::get().resourceCache().get(degradeInfo.degrades[i].modelId);
+    }
+
+    return degrades;
+}
+
 Model::Model(uint32_t id, const void* data, size_t size) : ResourceImpl{id}, needsDepthSort{false}
 {
     BinReader reader(data, size);
@@ -105,17 +126,43 @@ Model::Model(uint32_t id, const void* data, size_t size) : ResourceImpl{id}, nee
     glm::vec3 sortCenter;
     read(reader, sortCenter);
 
+    bounds.center = glm::vec3{0.0, 0.0, 0.0};
+    bounds.radius = 0.0;
+
     if(flags & kHasDrawingBSP)
     {
         triangleFans = readTriangleFans(reader);
 
         unique_ptr<BSPNode> drawingBSP;
         read(reader, drawingBSP, BSPTreeType::kDrawing);
+        bounds = drawingBSP->bounds();
+    }
+
+    if(bounds.radius == 0.0 && !vertices.empty())
+    {
+        // a leaf at the root of the drawing BSP has no bounds
+        glm::vec3 minPosition = vertices.front().position;
+        glm::vec3 maxPosition = minPosition;
+
+        for(const Vertex& vertex : vertices)
+        {
+            minPosition = glm::min(minPosition, vertex.position);
+            maxPosition = glm::max(maxPosition, vertex.position);
+        }
+
+        bounds.center = (minPosition + maxPosition) * fp_t(0.5);
+
+        for(const Vertex& vertex : vertices)
+        {
+            bounds.radius = max(bounds.radius, glm::length(vertex.position - bounds.center));
+        }
     }
 
     if(flags & kHasDegrade)
     {
-        /*degradeId*/ reader.readInt();
+        uint32_t degradeId = reader.readInt();
+        degradeInfo = Core::get().resourceCache().get(degradeId);
+        degrades = loadDegrades(id, degradeInfo->cast<DegradeInfo>());
     }
 
     assert(reader.remaining() == 0);
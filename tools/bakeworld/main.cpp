@@ -0,0 +1,306 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "Core.h"
+#include "DatFile.h"
+#include "Land.h"
+#include "WorldFile.h"
+#include <SDL_main.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+ * Bakes every landblock in the cell dat into a world file for LandcellManager.worldFile
+ * Usage: bakeworld [output path] [number of threads]
+ *
+ * First every landblock is read and decoded, so each one can be initialized with all its
+ * neighbors present, then they're initialized, baked and written out in parallel
+ */
+
+typedef chrono::high_resolution_clock Clock;
+
+enum Stage
+{
+    kRead,
+    kDecode,
+    kInit,
+    kBake,
+    kWrite,
+    kNumStages
+};
+
+static const char* const kStageNames[kNumStages] = { "read", "decode", "init", "bake", "write" };
+
+class WorldBaker : Noncopyable
+{
+public:
+    WorldBaker(const string& path, int numThreads);
+
+    void run();
+
+private:
+    void runThreads(void (WorldBaker::*func)(int));
+    void work(void (WorldBaker::*func)(int));
+    void decodeBlock(int i);
+    void bakeBlock(int i);
+    void addTime(Stage stage, Clock::time_point& start);
+    void report(Clock::duration decodeTime, Clock::duration bakeTime) const;
+
+    WorldFileWriter writer_;
+    int numThreads_;
+
+    // indexed by x * 256 + y, null where the landblock does not exist
+    vector<unique_ptr<Land>> lands_;
+    vector<vector<uint8_t>> landData_;
+
+    atomic<int> nextBlock_;
+    atomic<int> numBlocks_;
+    atomic<int> numStaticObjects_;
+    atomic<int64_t> stageTimes_[kNumStages]; // nanoseconds, summed over all threads
+
+    mutex errorMutex_; // protects error_
+    exception_ptr error_;
+};
+
+WorldBaker::WorldBaker(const string& path, int numThreads) :
+    writer_(path),
+    numThreads_(numThreads),
+    lands_(WorldFile::kNumBlocks),
+    landData_(WorldFile::kNumBlocks)
+{
+    numBlocks_ = 0;
+    numStaticObjects_ = 0;
+
+    for(atomic<int64_t>& stageTime : stageTimes_)
+    {
+        stageTime = 0;
+    }
+}
+
+void WorldBaker::run()
+{
+    Clock::time_point start = Clock::now();
+    runThreads(&WorldBaker::decodeBlock);
+
+    Clock::time_point decodeEnd = Clock::now();
+    runThreads(&WorldBaker::bakeBlock);
+
+    writer_.finish();
+
+    report(decodeEnd - start, Clock::now() - decodeEnd);
+}
+
+void WorldBaker::runThreads(void (WorldBaker::*func)(int))
+{
+    nextBlock_ = 0;
+
+    vector<thread> threads;
+
+    for(int i = 0; i < numThreads_; i++)
+    {
+        threads.push_back(thread(bind(&WorldBaker::work, this, func)));
+    }
+
+    for(thread& t : threads)
+    {
+        t.join();
+    }
+
+    if(error_)
+    {
+        rethrow_exception(error_);
+    }
+}
+
+void WorldBaker::work(void (WorldBaker::*func)(int))
+{
+    try
+    {
+        for(;;)
+        {
+            int i = nextBlock_++;
+
+            if(i >= WorldFile::kNumBlocks)
+            {
+                break;
+            }
+
+            (this->*func)(i);
+        }
+    }
+    catch(...)
+    {
+        // stop everyone else too, rethrown on the main thread
+        nextBlock_ = WorldFile::kNumBlocks;
+
+        lock_guard<mutex> lock(errorMutex_);
+        error_ = current_exception();
+    }
+}
+
+void WorldBaker::decodeBlock(int i)
+{
+    LandcellId id(i / 256, i % 256);
+
+    Clock::time_point start = Clock::now();
+
+    vector<uint8_t> data = Core::get().cellDat().read(id.value());
+    addTime(kRead, start);
+
+    if(data.empty())
+    {
+        return;
+    }
+
+    lands_[i].reset(new Land(data.data(), data.size()));
+    landData_[i] = move(data);
+    addTime(kDecode, start);
+}
+
+void WorldBaker::bakeBlock(int i)
+{
+    if(!lands_[i])
+    {
+        return;
+    }
+
+    int x = i / 256;
+    int y = i % 256;
+
+    Land::Neighbors neighbors;
+
+    for(int dx = -1; dx <= 1; dx++)
+    {
+        for(int dy = -1; dy <= 1; dy++)
+        {
+            int nx = x + dx;
+            int ny = y + dy;
+
+            if(nx < 0 || nx > 0xFF || ny < 0 || ny > 0xFF)
+            {
+                neighbors[dx + 1][dy + 1] = nullptr;
+            }
+            else
+            {
+                neighbors[dx + 1][dy + 1] = lands_[nx * 256 + ny].get();
+            }
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+
+    // initialize a copy, the decoded land is a neighbor of others being initialized right now
+    Land land(landData_[i].data(), landData_[i].size());
+    addTime(kDecode, start);
+
+    land.init(neighbors);
+    addTime(kInit, start);
+
+    vector<uint8_t> baked = land.bake();
+    addTime(kBake, start);
+
+    writer_.add(LandcellId(x, y), landData_[i], baked);
+    addTime(kWrite, start);
+
+    numBlocks_++;
+    numStaticObjects_ += static_cast<int>(land.staticObjects().size());
+}
+
+void WorldBaker::addTime(Stage stage, Clock::time_point& start)
+{
+    Clock::time_point now = Clock::now();
+    stageTimes_[stage] += chrono::duration_cast<chrono::nanoseconds>(now - start).count();
+    start = now;
+}
+
+void WorldBaker::report(Clock::duration decodeTime, Clock::duration bakeTime) const
+{
+    double decodeSeconds = chrono::duration_cast<chrono::duration<double>>(decodeTime).count();
+    double bakeSeconds = chrono::duration_cast<chrono::duration<double>>(bakeTime).count();
+    double totalSeconds = decodeSeconds + bakeSeconds;
+    double fileMiB = static_cast<double>(writer_.size()) / (1024.0 * 1024.0);
+    int numBlocks = numBlocks_;
+
+    printf("baked %d landblocks with %d static objects using %d threads\n", numBlocks, static_cast<int>(numStaticObjects_), numThreads_);
+    printf("decode pass %.2f s, bake pass %.2f s, total %.2f s\n", decodeSeconds, bakeSeconds, totalSeconds);
+    printf("%.1f landblocks/s, %.1f MiB/s, world file is %.1f MiB\n",
+        numBlocks / totalSeconds, fileMiB / totalSeconds, fileMiB);
+    printf("thread time per stage:\n");
+
+    for(int stage = 0; stage < kNumStages; stage++)
+    {
+        double ms = static_cast<double>(stageTimes_[stage]) / 1.0e6;
+        printf("  %-8s %10.1f ms %8.3f ms/landblock\n", kStageNames[stage], ms, numBlocks > 0 ? ms / numBlocks : 0.0);
+    }
+}
+
+static string g_outputPath = "data/world.bin";
+static int g_numThreads = 1;
+
+static void bakeWorld()
+{
+    WorldBaker baker{g_outputPath, g_numThreads};
+    baker.run();
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc > 3)
+    {
+        fprintf(stderr, "Usage: %s [output path] [number of threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(argc > 1)
+    {
+        g_outputPath = argv[1];
+    }
+
+    if(argc > 2)
+    {
+        g_numThreads = atoi(argv[2]);
+    }
+    else
+    {
+        g_numThreads = max(static_cast<int>(thread::hardware_concurrency()), 1);
+    }
+
+    if(g_numThreads < 1)
+    {
+        fprintf(stderr, "Bad number of threads\n");
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        Core::executeTool(bakeWorld);
+    }
+    catch(const runtime_error& e)
+    {
+        fprintf(stderr, "An error ocurred: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
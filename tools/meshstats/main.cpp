@@ -0,0 +1,127 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "graphics/MeshBuilder.h"
+#include "resource/Model.h"
+#include "Core.h"
+#include "DatFile.h"
+#include "ResourceCache.h"
+#include <SDL_main.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Builds the mesh of every model in the portal dat the way MeshRenderData does and reports
+ * how many vertices are transformed per triangle, the ACMR, with a FIFO cache of
+ * MeshBuilder::kReportCacheSize vertices, before and after
+ * Usage: meshstats
+ *
+ * fans: a vertex per fan index, drawn as triangle fans, which is what meshes used to be
+ * lists: shared vertices, the fans split into triangles in the same order
+ * vertex cache: reordered for the vertex cache
+ * overdraw: reordered for the vertex cache and then for overdraw
+ */
+
+typedef chrono::high_resolution_clock Clock;
+
+struct Totals
+{
+    Totals() : models(0), fanVertices(0), vertices(0), triangles(0), listCacheMisses(0), cacheMisses(0), overdrawCacheMisses(0)
+    {}
+
+    int models;
+    int64_t fanVertices;
+    int64_t vertices;
+    int64_t triangles;
+    int64_t listCacheMisses;
+    int64_t cacheMisses;
+    int64_t overdrawCacheMisses;
+};
+
+static double acmr(int64_t misses, int64_t triangles)
+{
+    return triangles > 0 ? static_cast<double>(misses) / static_cast<double>(triangles) : 0.0;
+}
+
+static void sweepModels()
+{
+    Clock::time_point start = Clock::now();
+    Totals totals;
+
+    for(uint32_t id : Core::get().portalDat().list())
+    {
+        if((id & 0xFF000000) != static_cast<uint32_t>(ResourceType::kModel))
+        {
+            continue;
+        }
+
+        ResourcePtr resource = Core::get().resourceCache().get(id);
+        const Model& model = resource->cast<Model>();
+
+        MeshBuilder builder{false};
+        builder.build(model.surfaces, model.vertices, model.triangleFans, model.hitTriangleFans, ResourcePtr());
+
+        MeshBuilder overdrawBuilder{true};
+        overdrawBuilder.build(model.surfaces, model.vertices, model.triangleFans, model.hitTriangleFans, ResourcePtr());
+
+        const MeshBuilder::Stats& stats = builder.stats();
+
+        totals.models++;
+        totals.fanVertices += stats.fanVertices;
+        totals.vertices += stats.vertices;
+        totals.triangles += stats.triangles;
+        totals.listCacheMisses += stats.listCacheMisses;
+        totals.cacheMisses += stats.cacheMisses;
+        totals.overdrawCacheMisses += overdrawBuilder.stats().cacheMisses;
+    }
+
+    double seconds = chrono::duration_cast<chrono::duration<double>>(Clock::now() - start).count();
+
+    printf("%d models, %lld triangles in %.2f s\n", totals.models, static_cast<long long>(totals.triangles), seconds);
+    printf("vertices: fans %lld, shared %lld (%.1f%%)\n",
+        static_cast<long long>(totals.fanVertices),
+        static_cast<long long>(totals.vertices),
+        totals.fanVertices > 0 ? 100.0 * static_cast<double>(totals.vertices) / static_cast<double>(totals.fanVertices) : 0.0);
+    printf("ACMR with a cache of %d: fans %.3f, lists %.3f, vertex cache %.3f, overdraw %.3f\n",
+        MeshBuilder::kReportCacheSize,
+        acmr(totals.fanVertices, totals.triangles),
+        acmr(totals.listCacheMisses, totals.triangles),
+        acmr(totals.cacheMisses, totals.triangles),
+        acmr(totals.overdrawCacheMisses, totals.triangles));
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc > 1)
+    {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        Core::executeTool(sweepModels);
+    }
+    catch(const runtime_error& e)
+    {
+        fprintf(stderr, "An error ocurred: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/*
+ * Bael'Zharon's Respite
+ * Copyright (C) 2014 Daniel Skorupski
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "Core.h"
+#include "DatFile.h"
+#include "Land.h"
+#include <SDL_main.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+/*
+ * Loads and initializes the landblocks around a center, then casts rays across them
+ * with castRayAcrossLands, the way LandcellManager::castRay does, and reports the rate
+ * Usage: raybench [center x] [center y] [radius] [number of rays]
+ *
+ * The rays start a little above the ground within the radius and look down at shallow angles,
+ * they're the same every run
+ */
+
+typedef chrono::high_resolution_clock Clock;
+
+// the rays only go this far
+static const fp_t kMaxDist = fp_t(2000.0);
+
+// indexed by x * 256 + y, null where the landblock isn't loaded
+class LandGrid : public LandFinder
+{
+public:
+    LandGrid() : lands_(256 * 256)
+    {}
+
+    const Land* findLand(LandcellId id) override
+    {
+        return lands_[id.x() * 256 + id.y()].get();
+    }
+
+    unique_ptr<Land>& at(int x, int y)
+    {
+        return lands_[x * 256 + y];
+    }
+
+private:
+    vector<unique_ptr<Land>> lands_;
+};
+
+static int g_centerX = 0x31;
+static int g_centerY = 0xD6;
+static int g_radius = 5;
+static int g_numRays = 100000;
+
+static void loadLands(LandGrid& grid)
+{
+    // one more around the edge, so every land we cast against is initialized with its neighbors
+    int loadRadius = g_radius + 1;
+
+    for(int x = max(g_centerX - loadRadius, 0); x <= min(g_centerX + loadRadius, 0xFF); x++)
+    {
+        for(int y = max(g_centerY - loadRadius, 0); y <= min(g_centerY + loadRadius, 0xFF); y++)
+        {
+            vector<uint8_t> data = Core::get().cellDat().read(LandcellId(x, y).value());
+
+            if(!data.empty())
+            {
+                grid.at(x, y).reset(new Land(data.data(), data.size()));
+            }
+        }
+    }
+
+    for(int x = max(g_centerX - g_radius, 0); x <= min(g_centerX + g_radius, 0xFF); x++)
+    {
+        for(int y = max(g_centerY - g_radius, 0); y <= min(g_centerY + g_radius, 0xFF); y++)
+        {
+            if(!grid.at(x, y))
+            {
+                continue;
+            }
+
+            Land::Neighbors neighbors;
+
+            for(int dx = -1; dx <= 1; dx++)
+            {
+                for(int dy = -1; dy <= 1; dy++)
+                {
+                    int nx = x + dx;
+                    int ny = y + dy;
+
+                    if(nx < 0 || nx > 0xFF || ny < 0 || ny > 0xFF)
+                    {
+                        neighbors[dx + 1][dy + 1] = nullptr;
+                    }
+                    else
+                    {
+                        neighbors[dx + 1][dy + 1] = grid.at(nx, ny).get();
+                    }
+                }
+            }
+
+            grid.at(x, y)->init(neighbors);
+        }
+    }
+}
+
+static void benchmarkRays()
+{
+    LandGrid grid;
+    loadLands(grid);
+
+    LandcellId center(g_centerX, g_centerY);
+
+    mt19937 generator(0);
+    uniform_real_distribution<fp_t> position(-g_radius * Land::kBlockSize, (g_radius + 1) * Land::kBlockSize);
+    uniform_real_distribution<fp_t> altitude(2.0, 50.0);
+    uniform_real_distribution<fp_t> heading(0.0, fp_t(2.0) * pi());
+    uniform_real_distribution<fp_t> pitch(glm::radians(fp_t(-45.0)), glm::radians(fp_t(-1.0)));
+
+    size_t numRays = static_cast<size_t>(g_numRays);
+    vector<glm::vec3> starts(numRays);
+    vector<glm::vec3> directions(numRays);
+
+    for(size_t i = 0; i < numRays; i++)
+    {
+        fp_t x = position(generator);
+        fp_t y = position(generator);
+
+        // the ground under the start, zero where the landblock doesn't exist
+        int bx = static_cast<int>(floor(x / Land::kBlockSize));
+        int by = static_cast<int>(floor(y / Land::kBlockSize));
+        const Land* land = grid.findLand(LandcellId(center.x() + bx, center.y() + by));
+        fp_t height = land != nullptr ? land->calcHeight(x - bx * Land::kBlockSize, y - by * Land::kBlockSize) : fp_t(0.0);
+
+        fp_t h = heading(generator);
+        fp_t p = pitch(generator);
+        starts[i] = glm::vec3(x, y, height + altitude(generator));
+        directions[i] = glm::vec3(cos(h) * cos(p), sin(h) * cos(p), sin(p));
+    }
+
+    Clock::time_point start = Clock::now();
+
+    int numHits = 0;
+
+    for(size_t i = 0; i < numRays; i++)
+    {
+        fp_t dist;
+
+        if(castRayAcrossLands(grid, center, starts[i], directions[i], kMaxDist, dist))
+        {
+            numHits++;
+        }
+    }
+
+    double seconds = chrono::duration_cast<chrono::duration<double>>(Clock::now() - start).count();
+
+    printf("%d rays around %02X%02X within %d landblocks, %d hits in %.3f s\n",
+        g_numRays, g_centerX, g_centerY, g_radius, numHits, seconds);
+    printf("%.0f rays/s\n", seconds > 0.0 ? numRays / seconds : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 1 && argc != 3 && argc != 4 && argc != 5)
+    {
+        fprintf(stderr, "Usage: %s [center x] [center y] [radius] [number of rays]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(argc > 2)
+    {
+        g_centerX = static_cast<int>(strtol(argv[1], nullptr, 0));
+        g_centerY = static_cast<int>(strtol(argv[2], nullptr, 0));
+    }
+
+    if(argc > 3)
+    {
+        g_radius = atoi(argv[3]);
+    }
+
+    if(argc > 4)
+    {
+        g_numRays = atoi(argv[4]);
+    }
+
+    if(g_centerX < 0x00 || g_centerX > 0xFF || g_centerY < 0x00 || g_centerY > 0xFF || g_radius < 0 || g_numRays < 1)
+    {
+        fprintf(stderr, "Bad arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        Core::executeTool(benchmarkRays);
+    }
+    catch(const runtime_error& e)
+    {
+        fprintf(stderr, "An error ocurred: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}